@@ -0,0 +1,471 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/* QUIC kernel implementation
+ * (C) Copyright Red Hat Corp. 2023
+ *
+ * This file is part of the QUIC kernel implementation
+ *
+ * Tracepoints for QUIC connections.  They are included after socket.h, so the QUIC
+ * structures and helpers used to fill the entries are visible here.  All times are in us.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM quic
+
+#if !defined(_TRACE_QUIC_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_QUIC_H
+
+#include <linux/tracepoint.h>
+
+TRACE_DEFINE_ENUM(QUIC_CRYPTO_APP);
+TRACE_DEFINE_ENUM(QUIC_CRYPTO_INITIAL);
+TRACE_DEFINE_ENUM(QUIC_CRYPTO_HANDSHAKE);
+TRACE_DEFINE_ENUM(QUIC_CRYPTO_EARLY);
+
+#define show_quic_level(level)						\
+	__print_symbolic(level,						\
+			 { QUIC_CRYPTO_APP,		"APP" },		\
+			 { QUIC_CRYPTO_INITIAL,		"INITIAL" },		\
+			 { QUIC_CRYPTO_HANDSHAKE,	"HANDSHAKE" },		\
+			 { QUIC_CRYPTO_EARLY,		"EARLY" })
+
+TRACE_DEFINE_ENUM(QUIC_CONG_SLOW_START);
+TRACE_DEFINE_ENUM(QUIC_CONG_RECOVERY_PERIOD);
+TRACE_DEFINE_ENUM(QUIC_CONG_CONGESTION_AVOIDANCE);
+
+#define show_quic_cong_state(state)					\
+	__print_symbolic(state,						\
+			 { QUIC_CONG_SLOW_START,	"SLOW_START" },		\
+			 { QUIC_CONG_RECOVERY_PERIOD,	"RECOVERY_PERIOD" },	\
+			 { QUIC_CONG_CONGESTION_AVOIDANCE, "CONGESTION_AVOIDANCE" })
+
+/* A new connection attempt is queued on a listen socket, waiting for accept(). */
+TRACE_EVENT(quic_conn_request,
+
+	TP_PROTO(const struct sock *sk, const struct quic_request_sock *req),
+
+	TP_ARGS(sk, req),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(const void *, req)
+		__field(u32, version)
+		__field(u8, retry)
+		__array(u8, saddr, sizeof(union quic_addr))
+		__array(u8, daddr, sizeof(union quic_addr))
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->req = req;
+		__entry->version = req->version;
+		__entry->retry = req->retry;
+		memcpy(__entry->saddr, &req->saddr, sizeof(__entry->saddr));
+		memcpy(__entry->daddr, &req->daddr, sizeof(__entry->daddr));
+	),
+
+	TP_printk("sk=%p req=%p saddr=%pISpc daddr=%pISpc version=0x%x retry=%u",
+		  __entry->skaddr, __entry->req, __entry->saddr, __entry->daddr,
+		  __entry->version, __entry->retry)
+);
+
+/* accept() created 'nsk' for a request: 'queue_us' is the time the request waited in the
+ * accept queue, 'init_us' the time to initialize the socket from the listen socket, and
+ * 'setup_us' the time to bind, route, add connection IDs, install the Initial keys and
+ * process the packets queued on the request.
+ */
+TRACE_EVENT(quic_accept,
+
+	TP_PROTO(const struct sock *sk, const struct sock *nsk, u32 queue_us, u32 init_us,
+		 u32 setup_us),
+
+	TP_ARGS(sk, nsk, queue_us, init_us, setup_us),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(const void *, nskaddr)
+		__field(u32, queue_us)
+		__field(u32, init_us)
+		__field(u32, setup_us)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->nskaddr = nsk;
+		__entry->queue_us = queue_us;
+		__entry->init_us = init_us;
+		__entry->setup_us = setup_us;
+	),
+
+	TP_printk("sk=%p nsk=%p queue_us=%u init_us=%u setup_us=%u",
+		  __entry->skaddr, __entry->nskaddr, __entry->queue_us, __entry->init_us,
+		  __entry->setup_us)
+);
+
+/* Both send and receive 1-RTT keys are installed, and the socket becomes established.
+ * The time from quic_accept (or connect()) to this event is the handshake time, most of
+ * which is spent in the userspace TLS handshake.
+ */
+TRACE_EVENT(quic_handshake_done,
+
+	TP_PROTO(const struct sock *sk),
+
+	TP_ARGS(sk),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u32, version)
+		__field(u8, serv)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->version = quic_packet(sk)->version;
+		__entry->serv = quic_is_serv(sk);
+	),
+
+	TP_printk("sk=%p version=0x%x serv=%u", __entry->skaddr, __entry->version,
+		  __entry->serv)
+);
+
+/* Packets sent and received: 'len' is the length of the packet on the wire, including its
+ * header and AEAD tag.
+ */
+DECLARE_EVENT_CLASS(quic_packet_template,
+
+	TP_PROTO(const struct sock *sk, u8 level, s64 number, u16 len, u8 path),
+
+	TP_ARGS(sk, level, number, len, path),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(s64, number)
+		__field(u16, len)
+		__field(u8, level)
+		__field(u8, path)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->number = number;
+		__entry->len = len;
+		__entry->level = level;
+		__entry->path = path;
+	),
+
+	TP_printk("sk=%p level=%s number=%lld len=%u path=%u", __entry->skaddr,
+		  show_quic_level(__entry->level), __entry->number, __entry->len,
+		  __entry->path)
+);
+
+DEFINE_EVENT(quic_packet_template, quic_packet_sent,
+	TP_PROTO(const struct sock *sk, u8 level, s64 number, u16 len, u8 path),
+	TP_ARGS(sk, level, number, len, path)
+);
+
+DEFINE_EVENT(quic_packet_template, quic_packet_recv,
+	TP_PROTO(const struct sock *sk, u8 level, s64 number, u16 len, u8 path),
+	TP_ARGS(sk, level, number, len, path)
+);
+
+/* rfc9002#section-6.1: a sent packet is declared lost, 'age_us' after it was sent. */
+TRACE_EVENT(quic_packet_lost,
+
+	TP_PROTO(const struct sock *sk, u8 level, s64 number, u16 len, u32 age_us),
+
+	TP_ARGS(sk, level, number, len, age_us),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(s64, number)
+		__field(u32, age_us)
+		__field(u16, len)
+		__field(u8, level)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->number = number;
+		__entry->age_us = age_us;
+		__entry->len = len;
+		__entry->level = level;
+	),
+
+	TP_printk("sk=%p level=%s number=%lld len=%u age_us=%u", __entry->skaddr,
+		  show_quic_level(__entry->level), __entry->number, __entry->len,
+		  __entry->age_us)
+);
+
+/* Frames on the send side: 'number' is the first packet number the frame was sent in, or
+ * -1 if it was not sent yet.
+ */
+DECLARE_EVENT_CLASS(quic_frame_template,
+
+	TP_PROTO(const struct sock *sk, const struct quic_frame *frame),
+
+	TP_ARGS(sk, frame),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(s64, number)
+		__field(u16, len)
+		__field(u8, type)
+		__field(u8, level)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->number = frame->number;
+		__entry->len = frame->len;
+		__entry->type = frame->type;
+		__entry->level = frame->level;
+	),
+
+	TP_printk("sk=%p type=0x%x level=%s len=%u number=%lld", __entry->skaddr,
+		  __entry->type, show_quic_level(__entry->level), __entry->len,
+		  __entry->number)
+);
+
+DEFINE_EVENT(quic_frame_template, quic_frame_create,
+	TP_PROTO(const struct sock *sk, const struct quic_frame *frame),
+	TP_ARGS(sk, frame)
+);
+
+DEFINE_EVENT(quic_frame_template, quic_frame_ack,
+	TP_PROTO(const struct sock *sk, const struct quic_frame *frame),
+	TP_ARGS(sk, frame)
+);
+
+DEFINE_EVENT(quic_frame_template, quic_frame_retransmit,
+	TP_PROTO(const struct sock *sk, const struct quic_frame *frame),
+	TP_ARGS(sk, frame)
+);
+
+/* A received frame of 'len' bytes was processed. */
+TRACE_EVENT(quic_frame_process,
+
+	TP_PROTO(const struct sock *sk, u64 type, u8 level, u32 len),
+
+	TP_ARGS(sk, type, level, len),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u64, type)
+		__field(u32, len)
+		__field(u8, level)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->type = type;
+		__entry->len = len;
+		__entry->level = level;
+	),
+
+	TP_printk("sk=%p type=0x%llx level=%s len=%u", __entry->skaddr, __entry->type,
+		  show_quic_level(__entry->level), __entry->len)
+);
+
+/* rfc9002#section-6.2: the probe timeout fired for 'level', with 'pto_count' PTOs before. */
+TRACE_EVENT(quic_pto_fire,
+
+	TP_PROTO(const struct sock *sk, u8 level, u8 pto_count, u32 pto),
+
+	TP_ARGS(sk, level, pto_count, pto),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u32, pto)
+		__field(u8, pto_count)
+		__field(u8, level)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->pto = pto;
+		__entry->pto_count = pto_count;
+		__entry->level = level;
+	),
+
+	TP_printk("sk=%p level=%s pto_count=%u pto=%u", __entry->skaddr,
+		  show_quic_level(__entry->level), __entry->pto_count, __entry->pto)
+);
+
+/* The congestion window, slow start threshold or congestion state of the active path
+ * changed on an ACK, a loss or an ECN-CE increase.
+ */
+TRACE_EVENT(quic_cong_update,
+
+	TP_PROTO(const struct sock *sk, const struct quic_cong *cong),
+
+	TP_ARGS(sk, cong),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u64, pacing_rate)
+		__field(u32, window)
+		__field(u32, ssthresh)
+		__field(u32, inflight)
+		__field(u8, state)
+		__field(u8, algo)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->pacing_rate = cong->pacing_rate;
+		__entry->window = cong->window;
+		__entry->ssthresh = cong->ssthresh;
+		__entry->inflight = quic_outq(sk)->inflight;
+		__entry->state = cong->state;
+		__entry->algo = cong->algo;
+	),
+
+	TP_printk("sk=%p algo=%u state=%s window=%u ssthresh=%u inflight=%u pacing_rate=%llu",
+		  __entry->skaddr, __entry->algo, show_quic_cong_state(__entry->state),
+		  __entry->window, __entry->ssthresh, __entry->inflight,
+		  __entry->pacing_rate)
+);
+
+/* rfc9002#section-5: an RTT sample was taken from an ACK, all times in us. */
+TRACE_EVENT(quic_rtt_update,
+
+	TP_PROTO(const struct sock *sk, const struct quic_cong *cong, u32 ack_delay),
+
+	TP_ARGS(sk, cong, ack_delay),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u32, latest_rtt)
+		__field(u32, min_rtt)
+		__field(u32, smoothed_rtt)
+		__field(u32, rttvar)
+		__field(u32, ack_delay)
+		__field(u32, pto)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->latest_rtt = cong->latest_rtt;
+		__entry->min_rtt = cong->min_rtt;
+		__entry->smoothed_rtt = cong->smoothed_rtt;
+		__entry->rttvar = cong->rttvar;
+		__entry->ack_delay = ack_delay;
+		__entry->pto = cong->pto;
+	),
+
+	TP_printk("sk=%p latest_rtt=%u min_rtt=%u smoothed_rtt=%u rttvar=%u ack_delay=%u pto=%u",
+		  __entry->skaddr, __entry->latest_rtt, __entry->min_rtt,
+		  __entry->smoothed_rtt, __entry->rttvar, __entry->ack_delay, __entry->pto)
+);
+
+/* Sending is blocked by flow control: 'stream_id' is -1 for the connection-level limit,
+ * and 'max_bytes' is the limit reached.
+ */
+TRACE_EVENT(quic_flow_blocked,
+
+	TP_PROTO(const struct sock *sk, s64 stream_id, u64 max_bytes),
+
+	TP_ARGS(sk, stream_id, max_bytes),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(s64, stream_id)
+		__field(u64, max_bytes)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->stream_id = stream_id;
+		__entry->max_bytes = max_bytes;
+	),
+
+	TP_printk("sk=%p stream_id=%lld max_bytes=%llu", __entry->skaddr, __entry->stream_id,
+		  __entry->max_bytes)
+);
+
+/* rfc9001#section-6: the 1-RTT keys were updated, initiated locally or by the peer. */
+TRACE_EVENT(quic_key_update,
+
+	TP_PROTO(const struct sock *sk, u8 key_phase, u8 local),
+
+	TP_ARGS(sk, key_phase, local),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u8, key_phase)
+		__field(u8, local)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->key_phase = key_phase;
+		__entry->local = local;
+	),
+
+	TP_printk("sk=%p key_phase=%u local=%u", __entry->skaddr, __entry->key_phase,
+		  __entry->local)
+);
+
+/* rfc9000#section-9: the connection migrated to the alternate path, which was validated.
+ * 'local' is set if the local address changed, and unset if the peer's did.
+ */
+TRACE_EVENT(quic_path_migrate,
+
+	TP_PROTO(const struct sock *sk, struct quic_path_group *paths, u8 local),
+
+	TP_ARGS(sk, paths, local),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__array(u8, old_saddr, sizeof(union quic_addr))
+		__array(u8, old_daddr, sizeof(union quic_addr))
+		__array(u8, saddr, sizeof(union quic_addr))
+		__array(u8, daddr, sizeof(union quic_addr))
+		__field(u8, local)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		memcpy(__entry->old_saddr, quic_path_saddr(paths, 1), sizeof(union quic_addr));
+		memcpy(__entry->old_daddr, quic_path_daddr(paths, 1), sizeof(union quic_addr));
+		memcpy(__entry->saddr, quic_path_saddr(paths, 0), sizeof(union quic_addr));
+		memcpy(__entry->daddr, quic_path_daddr(paths, 0), sizeof(union quic_addr));
+		__entry->local = local;
+	),
+
+	TP_printk("sk=%p local=%u %pISpc->%pISpc to %pISpc->%pISpc", __entry->skaddr,
+		  __entry->local, __entry->old_saddr, __entry->old_daddr, __entry->saddr,
+		  __entry->daddr)
+);
+
+/* rfc9000#section-3: the sending ('send' set) or receiving part of a stream changed state
+ * to 'state', one of enum quic_stream_state in uapi.  "Ready" and "Reset Read" are never
+ * reported: a stream is created "Ready", and its receiving part is released as soon as a
+ * RESET_STREAM is processed, with the reset passed on as a QUIC_EVENT_STREAM_UPDATE event.
+ */
+TRACE_EVENT(quic_stream_update,
+
+	TP_PROTO(const struct sock *sk, const struct quic_stream *stream, u8 send),
+
+	TP_ARGS(sk, stream, send),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(s64, stream_id)
+		__field(u8, state)
+		__field(u8, send)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->stream_id = stream->id;
+		__entry->state = send ? stream->send.state : stream->recv.state;
+		__entry->send = send;
+	),
+
+	TP_printk("sk=%p stream_id=%lld send=%u state=%u", __entry->skaddr,
+		  __entry->stream_id, __entry->send, __entry->state)
+);
+
+#endif /* _TRACE_QUIC_H */
+
+#include <trace/define_trace.h>
@@ -87,6 +87,10 @@ struct quic_stream_info {
 #define QUIC_SOCKOPT_SESSION_TICKET			12
 #define QUIC_SOCKOPT_CRYPTO_SECRET			13
 #define QUIC_SOCKOPT_TRANSPORT_PARAM_EXT		14
+#define QUIC_SOCKOPT_NOTSENT_LOWAT			15
+#define QUIC_SOCKOPT_STREAM_PRIORITY			16
+#define QUIC_SOCKOPT_LOAD_BALANCER			17
+#define QUIC_SOCKOPT_CPU_AFFINITY			18
 
 #define QUIC_VERSION_V1			0x1
 #define QUIC_VERSION_V2			0x6b3343cf
@@ -110,7 +114,8 @@ struct quic_transport_param {
 	__u64	max_stream_data_bidi_local;
 	__u64	max_stream_data_bidi_remote;
 	__u64	max_stream_data_uni;
-	__u64	reserved[4];
+	__u32	min_ack_delay;
+	__u8	reserved[28];
 };
 
 struct quic_config {
@@ -123,7 +128,9 @@ struct quic_config {
 	__u8	stream_data_nodelay;
 	__u8	receive_session_ticket;
 	__u8	certificate_request;
-	__u8	reserved[43];
+	__u8	ack_eliciting_threshold;
+	__u8	ack_reordering_threshold;
+	__u8	reserved[41];
 };
 
 struct quic_crypto_secret {
@@ -138,6 +145,7 @@ struct quic_crypto_secret {
 enum quic_cong_algo {
 	QUIC_CONG_ALG_RENO,
 	QUIC_CONG_ALG_CUBIC,
+	QUIC_CONG_ALG_PRAGUE,
 	QUIC_CONG_ALG_MAX,
 };
 
@@ -147,6 +155,28 @@ struct quic_errinfo {
 	__u32	reserved;
 };
 
+struct quic_stream_priority {
+	__s64	stream_id;
+	__u8	urgency;
+	__u8	incremental;
+	__u16	weight;
+	__u8	reserved[4];
+};
+
+/* QUIC-LB routable connection IDs in draft-ietf-quic-load-balancers */
+#define QUIC_LB_SERVER_ID_MAX_LEN	15
+#define QUIC_LB_KEY_LEN			16
+
+struct quic_load_balancer {
+	__u8	config_id;
+	__u8	server_id_len;
+	__u8	nonce_len;
+	__u8	encrypt;
+	__u8	server_id[QUIC_LB_SERVER_ID_MAX_LEN];
+	__u8	key[QUIC_LB_KEY_LEN];
+	__u8	reserved;
+};
+
 struct quic_connection_id_info {
 	__u8	dest;
 	__u8	reserved[3];
@@ -220,6 +250,39 @@ union quic_event {
 	__u8	key_update_phase;
 };
 
+/* Socket diagnostics APIs: the INET_DIAG_INFO of a QUIC socket dumped through sock_diag
+ * with the INET_DIAG_REQ_PROTOCOL attribute set to IPPROTO_QUIC.  Times are in usec.
+ */
+#define QUIC_DIAG_CONN_ID_MAX_LEN	20
+
+struct quic_info {
+	__u8	cong_algo;	/* enum quic_cong_algo */
+	__u8	cong_state;	/* Slow start, recovery period, congestion avoidance */
+	__u8	pto_count;
+	__u8	key_phase;
+	__u32	mss;
+	__u32	window;
+	__u32	ssthresh;
+	__u32	inflight;
+	__u32	smoothed_rtt;
+	__u32	latest_rtt;
+	__u32	min_rtt;
+	__u32	rttvar;
+	__u32	pto;
+	__u64	pacing_rate;	/* Bytes/sec */
+	__u64	bytes_sent;	/* Stream data sent */
+	__u64	bytes_read;	/* Stream data read by the application */
+	__u16	local_streams_bidi;	/* Open streams initiated locally */
+	__u16	local_streams_uni;
+	__u16	peer_streams_bidi;	/* Open streams initiated by the peer */
+	__u16	peer_streams_uni;
+	__u8	scid_len;
+	__u8	dcid_len;
+	__u8	scid[QUIC_DIAG_CONN_ID_MAX_LEN];	/* Active source connection ID */
+	__u8	dcid[QUIC_DIAG_CONN_ID_MAX_LEN];	/* Active dest connection ID */
+	__u8	reserved[6];
+};
+
 enum {
 	QUIC_TRANSPORT_ERROR_NONE			= 0x00,
 	QUIC_TRANSPORT_ERROR_INTERNAL			= 0x01,
@@ -47,6 +47,7 @@ u32 quic_sock_hash_size(void)
 {
 	return quic_hashinfo.chash.size;
 }
+EXPORT_SYMBOL_GPL(quic_sock_hash_size);
 
 u32 quic_sock_hash(struct net *net, union quic_addr *s, union quic_addr *d)
 {
@@ -58,27 +59,32 @@ u32 quic_sock_hash(struct net *net, union quic_addr *s, union quic_addr *d)
 
 	return jhash_3words(saddr, ports, net_hash_mix(net), daddr) & (quic_sock_hash_size() - 1);
 }
+EXPORT_SYMBOL_GPL(quic_sock_hash);
 
 struct quic_shash_head *quic_sock_head(u32 hash)
 {
 	return &quic_hashinfo.chash.hash[hash];
 }
+EXPORT_SYMBOL_GPL(quic_sock_head);
 
 u32 quic_listen_sock_hash_size(void)
 {
 	return quic_hashinfo.lhash.size;
 }
+EXPORT_SYMBOL_GPL(quic_listen_sock_hash_size);
 
 u32 quic_listen_sock_hash(struct net *net, u16 port)
 {
 	return jhash_2words((__force u32)port, net_hash_mix(net), 0) &
 		(quic_listen_sock_hash_size() - 1);
 }
+EXPORT_SYMBOL_GPL(quic_listen_sock_hash);
 
 struct quic_shash_head *quic_listen_sock_head(u32 hash)
 {
 	return &quic_hashinfo.lhash.hash[hash];
 }
+EXPORT_SYMBOL_GPL(quic_listen_sock_head);
 
 struct quic_shash_head *quic_source_conn_id_head(struct net *net, u8 *scid, u32 len)
 {
@@ -94,6 +100,16 @@ struct quic_uhash_head *quic_udp_sock_head(struct net *net, u16 port)
 	return &ht->hash[jhash_2words((__force u32)port, net_hash_mix(net), 0) & (ht->size - 1)];
 }
 
+struct quic_uhash_head *quic_udp_sock_head_at(u32 hash)
+{
+	return &quic_hashinfo.uhash.hash[hash];
+}
+
+u32 quic_udp_sock_hash_size(void)
+{
+	return quic_hashinfo.uhash.size;
+}
+
 u32 quic_addr_hash(struct net *net, union quic_addr *a)
 {
 	u32 addr = (a->sa.sa_family == AF_INET6) ? jhash(&a->v6.sin6_addr, 16, 0) :
@@ -224,6 +240,7 @@ u8 quic_get_var(u8 **pp, u32 *plen, u64 *val)
 	*val = v;
 	return len;
 }
+EXPORT_SYMBOL_GPL(quic_get_var);
 
 /* Reads a fixed-length integer from the buffer. */
 u32 quic_get_int(u8 **pp, u32 *plen, u64 *val, u32 len)
@@ -292,6 +309,7 @@ u8 *quic_put_var(u8 *p, u64 num)
 	*p |= QUIC_VARINT_8BYTE_PREFIX;
 	return p + 8;
 }
+EXPORT_SYMBOL_GPL(quic_put_var);
 
 /* Writes a fixed-length integer to the buffer in network byte order. */
 u8 *quic_put_int(u8 *p, u64 num, u8 len)
@@ -333,6 +351,7 @@ u8 *quic_put_varint(u8 *p, u64 num, u8 len)
 		return NULL;
 	}
 }
+EXPORT_SYMBOL_GPL(quic_put_varint);
 
 u8 *quic_put_data(u8 *p, u8 *data, u32 len)
 {
@@ -344,7 +363,7 @@ u8 *quic_put_data(u8 *p, u8 *data, u32 len)
 }
 
 /* Writes a transport parameter as two varints: ID and value length, followed by value. */
-u8 *quic_put_param(u8 *p, u16 id, u64 value)
+u8 *quic_put_param(u8 *p, u64 id, u64 value)
 {
 	p = quic_put_var(p, id);
 	p = quic_put_var(p, quic_var_len(value));
@@ -178,6 +178,8 @@ u32 quic_listen_sock_hash_size(void);
 
 struct quic_shash_head *quic_source_conn_id_head(struct net *net, u8 *scid, u32 len);
 struct quic_uhash_head *quic_udp_sock_head(struct net *net, u16 port);
+struct quic_uhash_head *quic_udp_sock_head_at(u32 hash);
+u32 quic_udp_sock_hash_size(void);
 u32 quic_addr_hash(struct net *net, union quic_addr *a);
 
 void quic_hash_tables_destroy(void);
@@ -190,7 +192,7 @@ u8 quic_get_param(u64 *pdest, u8 **pp, u32 *plen);
 u8 quic_get_var(u8 **pp, u32 *plen, u64 *val);
 u8 quic_var_len(u64 n);
 
-u8 *quic_put_param(u8 *p, u16 id, u64 value);
+u8 *quic_put_param(u8 *p, u64 id, u64 value);
 u8 *quic_put_data(u8 *p, u8 *data, u32 len);
 u8 *quic_put_varint(u8 *p, u64 num, u8 len);
 u8 *quic_put_int(u8 *p, u64 num, u8 len);
@@ -12,6 +12,7 @@
 
 #include <linux/jiffies.h>
 #include <linux/quic.h>
+#include <net/inet_ecn.h>
 #include <net/sock.h>
 
 #include "common.h"
@@ -486,6 +487,94 @@ static void quic_reno_on_init(struct quic_cong *cong)
 {
 }
 
+/* PRAGUE APIs */
+struct quic_prague {
+	u64 round_start;	/* Start of the current CE observation round */
+	u32 acked_ecn;		/* ECN-marked packets newly reported in this round */
+	u32 acked_ce;		/* CE-marked packets newly reported in this round */
+	u32 alpha;		/* Moving average of the CE fraction, scaled by ALPHA_MAX */
+};
+
+/* rfc8257#section-3.3: g = 1/16, alpha initialized to 1. */
+#define QUIC_PRAGUE_ALPHA_SHIFT		10
+#define QUIC_PRAGUE_ALPHA_MAX		BIT(QUIC_PRAGUE_ALPHA_SHIFT)
+#define QUIC_PRAGUE_G_SHIFT		4
+
+static void quic_prague_on_ecn_count(struct quic_cong *cong, u32 acked, u32 ce)
+{
+	struct quic_prague *prague = quic_cong_priv(cong);
+	u32 fraction;
+
+	prague->acked_ecn += acked;
+	prague->acked_ce += ce;
+
+	/* Fold the marking fraction into alpha once per RTT. */
+	if (cong->time - prague->round_start < cong->smoothed_rtt)
+		return;
+
+	if (prague->acked_ecn) {
+		/* rfc8257#section-3.3:
+		 *   F = (#bytes marked) / (#bytes acked)
+		 *   alpha = (1 - g) * alpha + g * F
+		 *
+		 * Packet counts from ACK_ECN frames stand in for byte counts.
+		 */
+		fraction = div_u64((u64)min(prague->acked_ce, prague->acked_ecn) <<
+				   QUIC_PRAGUE_ALPHA_SHIFT, prague->acked_ecn);
+		prague->alpha -= prague->alpha >> QUIC_PRAGUE_G_SHIFT;
+		prague->alpha += fraction >> QUIC_PRAGUE_G_SHIFT;
+	}
+	pr_debug("%s: acked_ecn: %u, acked_ce: %u, alpha: %u\n",
+		 __func__, prague->acked_ecn, prague->acked_ce, prague->alpha);
+
+	prague->round_start = cong->time;
+	prague->acked_ecn = 0;
+	prague->acked_ce = 0;
+}
+
+static void quic_prague_on_process_ecn(struct quic_cong *cong)
+{
+	struct quic_prague *prague = quic_cong_priv(cong);
+	u64 reduction;
+
+	switch (cong->state) {
+	case QUIC_CONG_SLOW_START:
+		pr_debug("%s: slow_start -> recovery, cwnd: %u, ssthresh: %u\n",
+			 __func__, cong->window, cong->ssthresh);
+		break;
+	case QUIC_CONG_RECOVERY_PERIOD:
+		return;
+	case QUIC_CONG_CONGESTION_AVOIDANCE:
+		pr_debug("%s: cong_avoid -> recovery, cwnd: %u, ssthresh: %u\n",
+			 __func__, cong->window, cong->ssthresh);
+		break;
+	default:
+		pr_debug("%s: wrong congestion state: %d\n", __func__, cong->state);
+		return;
+	}
+
+	/* rfc8257#section-3.3: cwnd = cwnd * (1 - alpha / 2)
+	 *
+	 * Unlike a loss, a CE mark from an L4S AQM only scales the window down in
+	 * proportion to the extent of congestion, at most once per RTT.
+	 */
+	reduction = ((u64)cong->window * prague->alpha) >> (QUIC_PRAGUE_ALPHA_SHIFT + 1);
+	cong->recovery_time = cong->time;
+	cong->state = QUIC_CONG_RECOVERY_PERIOD;
+	cong->ssthresh = max_t(u32, cong->window - reduction, cong->min_window);
+	cong->window = cong->ssthresh;
+}
+
+static void quic_prague_on_init(struct quic_cong *cong)
+{
+	struct quic_prague *prague = quic_cong_priv(cong);
+
+	prague->alpha = QUIC_PRAGUE_ALPHA_MAX;
+	prague->round_start = 0;
+	prague->acked_ecn = 0;
+	prague->acked_ce = 0;
+}
+
 static struct quic_cong_ops quic_congs[] = {
 	{ /* QUIC_CONG_ALG_RENO */
 		.on_packet_acked = quic_reno_on_packet_acked,
@@ -501,6 +590,13 @@ static struct quic_cong_ops quic_congs[] = {
 		.on_packet_sent = quic_cubic_on_packet_sent,
 		.on_rtt_update = quic_cubic_on_rtt_update,
 	},
+	{ /* QUIC_CONG_ALG_PRAGUE */
+		.on_packet_acked = quic_reno_on_packet_acked,
+		.on_packet_lost = quic_reno_on_packet_lost,
+		.on_process_ecn = quic_prague_on_process_ecn,
+		.on_init = quic_prague_on_init,
+		.on_ecn_count = quic_prague_on_ecn_count,
+	},
 };
 
 /* COMMON APIs */
@@ -522,6 +618,21 @@ void quic_cong_on_process_ecn(struct quic_cong *cong)
 }
 EXPORT_SYMBOL_GPL(quic_cong_on_process_ecn);
 
+void quic_cong_on_ecn_count(struct quic_cong *cong, u32 acked, u32 ce)
+{
+	if (cong->ops->on_ecn_count)
+		cong->ops->on_ecn_count(cong, acked, ce);
+}
+EXPORT_SYMBOL_GPL(quic_cong_on_ecn_count);
+
+/* ECT codepoint to mark outgoing packets with once ECN is in use on the path. */
+u8 quic_cong_ecn(struct quic_cong *cong)
+{
+	/* rfc9331#section-4.1: L4S senders use ECT(1); Classic senders keep ECT(0). */
+	return cong->algo == QUIC_CONG_ALG_PRAGUE ? INET_ECN_ECT_1 : INET_ECN_ECT_0;
+}
+EXPORT_SYMBOL_GPL(quic_cong_ecn);
+
 /* Update Probe Timeout (PTO) and loss detection delay based on RTT stats. */
 static void quic_cong_pto_update(struct quic_cong *cong)
 {
@@ -690,3 +801,39 @@ void quic_cong_init(struct quic_cong *cong)
 	quic_cong_set_algo(cong, QUIC_CONG_ALG_RENO);
 	quic_cong_set_srtt(cong, QUIC_RTT_INIT);
 }
+EXPORT_SYMBOL_GPL(quic_cong_init);
+
+/* Brings the retained state of a path that becomes active again up to date with the settings
+ * of the path it takes over from: the peer's max_ack_delay, the window cap from flow control,
+ * the MSS and the algorithm, which are per connection rather than per path.
+ */
+void quic_cong_restore(struct quic_cong *cong, struct quic_cong *from)
+{
+	cong->max_ack_delay = from->max_ack_delay;
+	cong->max_window = from->max_window;
+	cong->initial_srtt = from->initial_srtt;
+	quic_cong_set_mss(cong, from->mss);
+	if (cong->algo != from->algo)
+		quic_cong_set_algo(cong, from->algo);
+}
+EXPORT_SYMBOL_GPL(quic_cong_restore);
+
+/* rfc9000#section-9.4: Resets the congestion controller and the RTT estimator to the initial
+ * values of rfc9002#appendix-A.4 and rfc9002#appendix-B.3 for a new path, keeping the
+ * configured algorithm, limits and MSS.
+ */
+void quic_cong_reset(struct quic_cong *cong)
+{
+	cong->min_rtt_valid = 0;
+	cong->is_rtt_set = 0;
+	cong->min_rtt = 0;
+
+	cong->recovery_time = 0;
+	cong->pacing_rate = 0;
+	cong->pacing_time = 0;
+
+	cong->window = cong->min_window;
+	quic_cong_set_algo(cong, cong->algo);
+	quic_cong_set_srtt(cong, cong->initial_srtt);
+}
+EXPORT_SYMBOL_GPL(quic_cong_reset);
@@ -90,6 +90,7 @@ struct quic_cong_ops {
 	void (*on_packet_sent)(struct quic_cong *cong, u64 time, u32 bytes, s64 number);
 	void (*on_ack_recv)(struct quic_cong *cong, u32 bytes, u64 max_rate);
 	void (*on_rtt_update)(struct quic_cong *cong);
+	void (*on_ecn_count)(struct quic_cong *cong, u32 acked, u32 ce);
 };
 
 static inline void quic_cong_set_mss(struct quic_cong *cong, u32 mss)
@@ -113,6 +114,8 @@ static inline void *quic_cong_priv(struct quic_cong *cong)
 void quic_cong_on_packet_acked(struct quic_cong *cong, u64 time, u32 bytes, s64 number);
 void quic_cong_on_packet_lost(struct quic_cong *cong, u64 time, u32 bytes, s64 number);
 void quic_cong_on_process_ecn(struct quic_cong *cong);
+void quic_cong_on_ecn_count(struct quic_cong *cong, u32 acked, u32 ce);
+u8 quic_cong_ecn(struct quic_cong *cong);
 
 void quic_cong_on_packet_sent(struct quic_cong *cong, u64 time, u32 bytes, s64 number);
 void quic_cong_on_ack_recv(struct quic_cong *cong, u32 bytes, u64 max_rate);
@@ -121,3 +124,6 @@ void quic_cong_rtt_update(struct quic_cong *cong, u64 time, u32 ack_delay);
 void quic_cong_set_srtt(struct quic_cong *cong, u32 srtt);
 void quic_cong_set_algo(struct quic_cong *cong, u8 algo);
 void quic_cong_init(struct quic_cong *cong);
+
+void quic_cong_restore(struct quic_cong *cong, struct quic_cong *from);
+void quic_cong_reset(struct quic_cong *cong);
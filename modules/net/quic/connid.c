@@ -11,6 +11,7 @@
  */
 
 #include <linux/quic.h>
+#include <crypto/aes.h>
 #include <net/sock.h>
 
 #include "common.h"
@@ -204,6 +205,7 @@ void quic_conn_id_set_init(struct quic_conn_id_set *id_set, bool source)
 	id_set->entry_size = source ? sizeof(struct quic_source_conn_id) :
 				      sizeof(struct quic_dest_conn_id);
 	INIT_LIST_HEAD(&id_set->head);
+	id_set->cpu = -1;
 }
 
 void quic_conn_id_set_free(struct quic_conn_id_set *id_set)
@@ -225,3 +227,132 @@ void quic_conn_id_set_param(struct quic_conn_id_set *id_set, struct quic_transpo
 {
 	id_set->max_count = p->active_connection_id_limit;
 }
+
+struct quic_conn_id_lb {
+	struct crypto_aes_ctx aes;	/* Expanded key for single-pass encryption */
+	u8 server_id[QUIC_LB_SERVER_ID_MAX_LEN];
+	u8 server_id_len;
+	u8 nonce_len;
+	u8 config_id;
+	u8 encrypt;
+};
+
+/* Generate a new source Connection ID.  Without a QUIC-LB config, this is a random ID of
+ * QUIC_CONN_ID_DEF_LEN bytes, with the owning CPU in bytes 1-2 if it is CPU-affine.
+ * Otherwise, per draft-ietf-quic-load-balancers#section-3:
+ *
+ *   First Octet (8) = Config Rotation (3) || CID Len or Random Bits (5),
+ *   Server ID (8..120) || Nonce (32..144)
+ *
+ * where the Length Self-Description is always used in the first octet, so that the receive
+ * path can find the ID length in short headers.  Server ID and Nonce are encrypted as one
+ * AES-128-ECB block when encryption is configured (Single-Pass Encryption).
+ */
+void quic_conn_id_source_generate(struct quic_conn_id_set *id_set, struct quic_conn_id *conn_id)
+{
+	struct quic_conn_id_lb *lb = id_set->lb;
+	u8 *p = conn_id->data, block[QUIC_CONN_ID_LB_BLOCK_LEN];
+
+	if (!lb) {
+		quic_conn_id_generate(conn_id);
+		if (id_set->cpu < 0) {
+			/* Never let a random ID look CPU-affine to the receive path. */
+			if ((*p & QUIC_CONN_ID_CPU_MARK) == QUIC_CONN_ID_CPU_MARK)
+				*p &= ~BIT(5);
+			return;
+		}
+		*p |= QUIC_CONN_ID_CPU_MARK;
+		p[1] = (u8)(id_set->cpu >> 8);
+		p[2] = (u8)id_set->cpu;
+		return;
+	}
+
+	conn_id->len = 1 + lb->server_id_len + lb->nonce_len;
+	*p++ = (u8)(lb->config_id << 5) | (conn_id->len - 1);
+	memcpy(p, lb->server_id, lb->server_id_len);
+	get_random_bytes(p + lb->server_id_len, lb->nonce_len);
+	if (!lb->encrypt)
+		return;
+
+	aes_encrypt(&lb->aes, block, p);
+	memcpy(p, block, QUIC_CONN_ID_LB_BLOCK_LEN);
+	memzero_explicit(block, sizeof(block));
+}
+
+/* Return the length of source Connection IDs issued with this id_set. */
+u8 quic_conn_id_source_len(struct quic_conn_id_set *id_set)
+{
+	struct quic_conn_id_lb *lb = id_set->lb;
+
+	return lb ? 1 + lb->server_id_len + lb->nonce_len : QUIC_CONN_ID_DEF_LEN;
+}
+
+/* Install a QUIC-LB config for issuing routable source Connection IDs, or remove it if
+ * server_id_len is 0.  Only Single-Pass Encryption is supported for encrypted configs,
+ * which requires server_id_len + nonce_len to be 16.
+ */
+int quic_conn_id_set_lb(struct quic_conn_id_set *id_set, struct quic_load_balancer *lb)
+{
+	struct quic_conn_id_lb *new;
+
+	if (!lb->server_id_len) {
+		quic_conn_id_lb_free(id_set);
+		return 0;
+	}
+
+	if (lb->config_id > QUIC_CONN_ID_LB_CONFIG_MAX ||
+	    lb->server_id_len > QUIC_LB_SERVER_ID_MAX_LEN ||
+	    lb->nonce_len < QUIC_CONN_ID_LB_NONCE_MIN ||
+	    lb->server_id_len + lb->nonce_len > QUIC_CONN_ID_LB_PLAIN_MAX)
+		return -EINVAL;
+	if (lb->encrypt && lb->server_id_len + lb->nonce_len != QUIC_CONN_ID_LB_BLOCK_LEN)
+		return -EINVAL;
+	if (id_set->cpu_affine) /* The QUIC-LB format has no room for the CPU. */
+		return -EINVAL;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+	if (lb->encrypt && aes_expandkey(&new->aes, lb->key, sizeof(lb->key))) {
+		kfree_sensitive(new);
+		return -EINVAL;
+	}
+	memcpy(new->server_id, lb->server_id, lb->server_id_len);
+	new->server_id_len = lb->server_id_len;
+	new->nonce_len = lb->nonce_len;
+	new->config_id = lb->config_id;
+	new->encrypt = !!lb->encrypt;
+
+	quic_conn_id_lb_free(id_set);
+	id_set->lb = new;
+	return 0;
+}
+
+/* Report the QUIC-LB config.  The encryption key is never copied back to userspace. */
+void quic_conn_id_get_lb(struct quic_conn_id_set *id_set, struct quic_load_balancer *lb)
+{
+	struct quic_conn_id_lb *cur = id_set->lb;
+
+	memset(lb, 0, sizeof(*lb));
+	if (!cur)
+		return;
+	memcpy(lb->server_id, cur->server_id, cur->server_id_len);
+	lb->server_id_len = cur->server_id_len;
+	lb->nonce_len = cur->nonce_len;
+	lb->config_id = cur->config_id;
+	lb->encrypt = cur->encrypt;
+}
+
+int quic_conn_id_lb_dup(struct quic_conn_id_set *to, struct quic_conn_id_set *from)
+{
+	if (!from->lb)
+		return 0;
+	to->lb = kmemdup(from->lb, sizeof(*from->lb), GFP_KERNEL);
+	return to->lb ? 0 : -ENOMEM;
+}
+
+void quic_conn_id_lb_free(struct quic_conn_id_set *id_set)
+{
+	kfree_sensitive(id_set->lb);
+	id_set->lb = NULL;
+}
@@ -14,6 +14,19 @@
 
 #define QUIC_CONN_ID_TOKEN_LEN	16
 
+/* QUIC-LB routable Connection IDs in draft-ietf-quic-load-balancers. */
+#define QUIC_CONN_ID_LB_CONFIG_MAX	6	/* Config rotation 0b111 marks unroutable IDs */
+#define QUIC_CONN_ID_LB_NONCE_MIN	4
+#define QUIC_CONN_ID_LB_PLAIN_MAX	19	/* Max server ID length + nonce length */
+#define QUIC_CONN_ID_LB_BLOCK_LEN	16	/* Single-pass AES-128-ECB block size */
+
+struct quic_conn_id_lb;
+
+/* CPU-affine Connection IDs carry 0b111 in the top bits of the first octet, the config
+ * rotation that QUIC-LB reserves for unroutable IDs, followed by the owning CPU in 2 bytes.
+ */
+#define QUIC_CONN_ID_CPU_MARK		0xe0
+
 /* Common fields shared by both source and destination Connection IDs */
 struct quic_common_conn_id {
 	struct quic_conn_id id;	/* The actual Connection ID value and its length */
@@ -40,9 +53,12 @@ struct quic_conn_id_set {
 	/* Connection ID to use for a new path (e.g., after migration) */
 	struct quic_common_conn_id *alt;
 	struct list_head head;	/* Head of the linked list of available connection IDs */
+	struct quic_conn_id_lb *lb;	/* QUIC-LB config for issuing routable source IDs */
+	s32 cpu;		/* CPU encoded into source IDs, or -1 if not CPU-affine */
 	u8 entry_size;		/* Size of each connection ID entry (in bytes) in the list */
 	u8 max_count;		/* active_connection_id_limit in rfc9000#section-18.2 */
 	u8 count;		/* Current number of connection IDs in the list */
+	u8 cpu_affine;		/* Encode the owning CPU into source IDs once it is known */
 };
 
 static inline u32 quic_conn_id_first_number(struct quic_conn_id_set *id_set)
@@ -65,6 +81,15 @@ static inline void quic_conn_id_generate(struct quic_conn_id *conn_id)
 	conn_id->len = QUIC_CONN_ID_DEF_LEN;
 }
 
+/* Return the CPU encoded in a CPU-affine Connection ID, or -1 if it is not one. */
+static inline int quic_conn_id_cpu(u8 *data, u32 len)
+{
+	if (len < QUIC_CONN_ID_DEF_LEN ||
+	    (data[0] & QUIC_CONN_ID_CPU_MARK) != QUIC_CONN_ID_CPU_MARK)
+		return -1;
+	return (data[1] << 8) | data[2];
+}
+
 /* Select an alternate destination Connection ID for a new path (e.g., after migration). */
 static inline bool quic_conn_id_select_alt(struct quic_conn_id_set *id_set, bool active)
 {
@@ -161,3 +186,11 @@ void quic_conn_id_get_param(struct quic_conn_id_set *id_set, struct quic_transpo
 void quic_conn_id_set_param(struct quic_conn_id_set *id_set, struct quic_transport_param *p);
 void quic_conn_id_set_init(struct quic_conn_id_set *id_set, bool source);
 void quic_conn_id_set_free(struct quic_conn_id_set *id_set);
+
+void quic_conn_id_source_generate(struct quic_conn_id_set *id_set, struct quic_conn_id *conn_id);
+u8 quic_conn_id_source_len(struct quic_conn_id_set *id_set);
+
+int quic_conn_id_set_lb(struct quic_conn_id_set *id_set, struct quic_load_balancer *lb);
+void quic_conn_id_get_lb(struct quic_conn_id_set *id_set, struct quic_load_balancer *lb);
+int quic_conn_id_lb_dup(struct quic_conn_id_set *to, struct quic_conn_id_set *from);
+void quic_conn_id_lb_free(struct quic_conn_id_set *id_set);
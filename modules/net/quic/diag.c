@@ -0,0 +1,387 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/* QUIC kernel implementation
+ * (C) Copyright Red Hat Corp. 2023
+ *
+ * This file is part of the QUIC kernel implementation
+ *
+ * Socket diagnostics (sock_diag) for QUIC, so ss and other monitoring tools can dump QUIC
+ * sockets with inet_diag filtering by address, port and state.
+ *
+ * Written or modified by:
+ *    Xin Long <lucien.xin@gmail.com>
+ */
+
+#include <linux/inet_diag.h>
+#include <linux/sock_diag.h>
+#include <linux/version.h>
+#include <linux/module.h>
+#include <net/netlink.h>
+
+#include "socket.h"
+
+static const char *quic_diag_cong_algos[QUIC_CONG_ALG_MAX] = {
+	[QUIC_CONG_ALG_RENO]	= "reno",
+	[QUIC_CONG_ALG_CUBIC]	= "cubic",
+	[QUIC_CONG_ALG_PRAGUE]	= "prague",
+};
+
+static void quic_diag_get_info(struct sock *sk, struct inet_diag_msg *r, void *_info)
+{
+	struct quic_stream_table *streams = quic_streams(sk);
+	struct quic_outqueue *outq = quic_outq(sk);
+	struct quic_cong *cong = quic_cong(sk);
+	struct quic_info *info = _info;
+	struct quic_conn_id_set *id_set;
+	struct quic_conn_id *conn_id;
+
+	memset(info, 0, sizeof(*info));
+	if (quic_is_listen(sk))
+		return;
+
+	info->cong_algo = cong->algo;
+	info->cong_state = cong->state;
+	info->pto_count = outq->pto_count;
+	info->key_phase = quic_crypto(sk, QUIC_CRYPTO_APP)->key_phase;
+	info->mss = quic_packet_mss(quic_packet(sk));
+	info->window = cong->window;
+	info->ssthresh = cong->ssthresh;
+	info->inflight = outq->inflight;
+	info->smoothed_rtt = cong->smoothed_rtt;
+	info->latest_rtt = cong->latest_rtt;
+	info->min_rtt = cong->min_rtt;
+	info->rttvar = cong->rttvar;
+	info->pto = cong->pto;
+	info->pacing_rate = READ_ONCE(cong->pacing_rate);
+	info->bytes_sent = outq->bytes;
+	info->bytes_read = quic_inq(sk)->bytes;
+
+	info->local_streams_bidi = streams->send.streams_bidi;
+	info->local_streams_uni = streams->send.streams_uni;
+	info->peer_streams_bidi = streams->recv.streams_bidi;
+	info->peer_streams_uni = streams->recv.streams_uni;
+
+	/* The connection ID sets are empty until the socket is connected or accepted. */
+	id_set = quic_source(sk);
+	if (id_set->active) {
+		conn_id = quic_conn_id_active(id_set);
+		info->scid_len = conn_id->len;
+		memcpy(info->scid, conn_id->data, conn_id->len);
+	}
+	id_set = quic_dest(sk);
+	if (id_set->active) {
+		conn_id = quic_conn_id_active(id_set);
+		info->dcid_len = conn_id->len;
+		memcpy(info->dcid, conn_id->data, conn_id->len);
+	}
+}
+
+static int quic_diag_fill(struct sock *sk, struct sk_buff *skb, struct netlink_callback *cb,
+			  const struct inet_diag_req_v2 *req, u16 nlmsg_flags, bool net_admin)
+{
+	struct inet_diag_msg *r;
+	int ext = req->idiag_ext;
+	struct nlmsghdr *nlh;
+	struct nlattr *attr;
+	u8 algo;
+
+	nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+			cb->nlh->nlmsg_type, sizeof(*r), nlmsg_flags);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	r = nlmsg_data(nlh);
+	inet_diag_msg_common_fill(r, sk);
+	r->idiag_state = sk->sk_state;
+	r->idiag_timer = 0;
+	r->idiag_retrans = 0;
+	r->idiag_expires = 0;
+	r->idiag_rqueue = sk_rmem_alloc_get(sk);
+	r->idiag_wqueue = READ_ONCE(sk->sk_wmem_queued);
+
+	if (inet_diag_msg_attrs_fill(sk, skb, r, ext, sk_user_ns(NETLINK_CB(cb->skb).sk),
+				     net_admin))
+		goto errout;
+
+	if (ext & (1 << (INET_DIAG_SKMEMINFO - 1))) {
+		if (sock_diag_put_meminfo(sk, skb, INET_DIAG_SKMEMINFO))
+			goto errout;
+	}
+
+	if (ext & (1 << (INET_DIAG_MEMINFO - 1))) {
+		struct inet_diag_meminfo minfo = {
+			.idiag_rmem = sk_rmem_alloc_get(sk),
+			.idiag_wmem = READ_ONCE(sk->sk_wmem_queued),
+			.idiag_fmem = sk->sk_forward_alloc,
+			.idiag_tmem = sk_wmem_alloc_get(sk),
+		};
+
+		if (nla_put(skb, INET_DIAG_MEMINFO, sizeof(minfo), &minfo))
+			goto errout;
+	}
+
+	if (ext & (1 << (INET_DIAG_CONG - 1))) {
+		algo = quic_cong(sk)->algo;
+		if (algo < QUIC_CONG_ALG_MAX &&
+		    nla_put_string(skb, INET_DIAG_CONG, quic_diag_cong_algos[algo]))
+			goto errout;
+	}
+
+	if (ext & (1 << (INET_DIAG_INFO - 1))) {
+		attr = nla_reserve_64bit(skb, INET_DIAG_INFO, sizeof(struct quic_info),
+					 INET_DIAG_PAD);
+		if (!attr)
+			goto errout;
+		quic_diag_get_info(sk, r, nla_data(attr));
+	}
+
+	nlmsg_end(skb, nlh);
+	return 0;
+
+errout:
+	nlmsg_cancel(skb, nlh);
+	return -EMSGSIZE;
+}
+
+static size_t quic_diag_msg_size(void)
+{
+	return NLMSG_ALIGN(sizeof(struct inet_diag_msg))
+		+ nla_total_size(sizeof(struct quic_info))
+		+ nla_total_size(1)	/* INET_DIAG_SHUTDOWN */
+		+ nla_total_size(1)	/* INET_DIAG_TOS */
+		+ nla_total_size(1)	/* INET_DIAG_TCLASS */
+		+ nla_total_size(4)	/* INET_DIAG_MARK */
+		+ nla_total_size(4)	/* INET_DIAG_CLASS_ID */
+		+ nla_total_size(sizeof(struct inet_diag_sockopt))
+		+ nla_total_size(sizeof(struct inet_diag_meminfo))
+		+ nla_total_size(SK_MEMINFO_VARS * sizeof(u32))
+		+ nla_total_size(sizeof("prague"))	/* INET_DIAG_CONG */
+		+ nla_total_size(sizeof(u64))	/* INET_DIAG_CGROUP_ID */
+		+ 64;
+}
+
+static bool quic_diag_bc_sk(struct netlink_callback *cb, struct sock *sk)
+{
+	struct inet_diag_dump_data *cb_data = cb->data;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 18, 0)
+	return inet_diag_bc_sk(cb_data, sk);
+#else
+	return inet_diag_bc_sk(cb_data->inet_diag_nla_bc, sk);
+#endif
+}
+
+/* Sockets are filled in batches: they are collected with a reference held under RCU, and
+ * then filled with the socket lock held, as the CIDs and congestion state are changed under
+ * it.  'cb->args[1]' is the position in the bucket to resume the dump at.
+ */
+#define QUIC_DIAG_BATCH	32
+
+static int quic_diag_dump_head(struct sk_buff *skb, struct netlink_callback *cb,
+			       const struct inet_diag_req_v2 *r, struct quic_shash_head *head,
+			       bool net_admin)
+{
+	struct net *net = sock_net(skb->sk);
+	struct sock *sks[QUIC_DIAG_BATCH];
+	u32 pos[QUIC_DIAG_BATCH], num, skip, i;
+	struct hlist_nulls_node *node;
+	int count, err = 0;
+	struct sock *sk;
+
+next:
+	skip = cb->args[1];
+	count = 0;
+	num = 0;
+	rcu_read_lock();
+	sk_nulls_for_each_rcu(sk, node, &head->head) {
+		if (!net_eq(sock_net(sk), net))
+			continue;
+		if (num++ < skip)
+			continue;
+		if (!(r->idiag_states & (1 << sk->sk_state)))
+			continue;
+		if (r->sdiag_family != AF_UNSPEC && sk->sk_family != r->sdiag_family)
+			continue;
+		if (!quic_diag_bc_sk(cb, sk))
+			continue;
+		if (!refcount_inc_not_zero(&sk->sk_refcnt))
+			continue;
+		pos[count] = num - 1;
+		sks[count++] = sk;
+		if (count == QUIC_DIAG_BATCH)
+			break;
+	}
+	rcu_read_unlock();
+
+	for (i = 0; i < count; i++) {
+		sk = sks[i];
+		if (!err) {
+			lock_sock(sk);
+			err = quic_diag_fill(sk, skb, cb, r, NLM_F_MULTI, net_admin);
+			release_sock(sk);
+			if (err)
+				cb->args[1] = pos[i];
+		}
+		sock_put(sk);
+	}
+	if (err)
+		return err;
+	if (count == QUIC_DIAG_BATCH) {
+		cb->args[1] = pos[count - 1] + 1;
+		goto next;
+	}
+	return 0;
+}
+
+/* 'cb->args[0]' walks the listening socket buckets first, then the connection buckets.  Each
+ * table is skipped when none of the requested states can be found in it.
+ */
+static void quic_diag_dump(struct sk_buff *skb, struct netlink_callback *cb,
+			   const struct inet_diag_req_v2 *r)
+{
+	u32 lsize = quic_listen_sock_hash_size(), size = lsize + quic_sock_hash_size();
+	bool net_admin = netlink_net_capable(cb->skb, CAP_NET_ADMIN);
+	struct quic_shash_head *head;
+	u32 hash = cb->args[0];
+
+	if (!(r->idiag_states & TCPF_LISTEN) && hash < lsize)
+		hash = lsize;
+	if (!(r->idiag_states & ~TCPF_LISTEN))
+		size = lsize;
+
+	for (; hash < size; hash++) {
+		head = hash < lsize ? quic_listen_sock_head(hash) : quic_sock_head(hash - lsize);
+		if (quic_diag_dump_head(skb, cb, r, head, net_admin))
+			break;
+		cb->args[1] = 0;
+	}
+	cb->args[0] = hash;
+}
+
+static bool quic_diag_match(struct sock *sk, const struct inet_diag_req_v2 *req)
+{
+	const struct inet_diag_sockid *id = &req->id;
+	struct inet_sock *inet = inet_sk(sk);
+
+	if (inet->inet_sport != id->idiag_sport || inet->inet_dport != id->idiag_dport)
+		return false;
+	if (req->sdiag_family == AF_INET)
+		return inet->inet_rcv_saddr == id->idiag_src[0] &&
+		       inet->inet_daddr == id->idiag_dst[0];
+	return !memcmp(&sk->sk_v6_rcv_saddr, id->idiag_src, sizeof(struct in6_addr)) &&
+	       !memcmp(&sk->sk_v6_daddr, id->idiag_dst, sizeof(struct in6_addr));
+}
+
+static void quic_diag_addr(union quic_addr *a, const struct inet_diag_req_v2 *req,
+			   const __be32 *addr, __be16 port)
+{
+	memset(a, 0, sizeof(*a));
+	if (req->sdiag_family == AF_INET || ipv6_addr_v4mapped((const struct in6_addr *)addr)) {
+		a->v4.sin_family = AF_INET;
+		a->v4.sin_port = port;
+		a->v4.sin_addr.s_addr = req->sdiag_family == AF_INET ? addr[0] : addr[3];
+		return;
+	}
+	a->v6.sin6_family = AF_INET6;
+	a->v6.sin6_port = port;
+	memcpy(&a->v6.sin6_addr, addr, sizeof(struct in6_addr));
+}
+
+/* Look up the socket of the exact 4-tuple in 'req', or the listening socket on its source
+ * port if no connection matches.
+ */
+static struct sock *quic_diag_lookup(struct net *net, const struct inet_diag_req_v2 *req)
+{
+	const struct inet_diag_sockid *id = &req->id;
+	struct hlist_nulls_node *node;
+	struct quic_shash_head *head;
+	union quic_addr sa, da;
+	struct sock *sk;
+
+	quic_diag_addr(&sa, req, id->idiag_src, id->idiag_sport);
+	quic_diag_addr(&da, req, id->idiag_dst, id->idiag_dport);
+
+	head = quic_sock_head(quic_sock_hash(net, &sa, &da));
+	rcu_read_lock();
+	sk_nulls_for_each_rcu(sk, node, &head->head) {
+		if (net_eq(sock_net(sk), net) && quic_diag_match(sk, req) &&
+		    refcount_inc_not_zero(&sk->sk_refcnt))
+			goto out;
+	}
+	head = quic_listen_sock_head(quic_listen_sock_hash(net, ntohs(id->idiag_sport)));
+	sk_nulls_for_each_rcu(sk, node, &head->head) {
+		if (net_eq(sock_net(sk), net) && quic_diag_match(sk, req) &&
+		    refcount_inc_not_zero(&sk->sk_refcnt))
+			goto out;
+	}
+	sk = NULL;
+out:
+	rcu_read_unlock();
+	return sk;
+}
+
+static int quic_diag_dump_one(struct netlink_callback *cb, const struct inet_diag_req_v2 *req)
+{
+	struct sk_buff *in_skb = cb->skb;
+	struct net *net = sock_net(in_skb->sk);
+	struct sk_buff *rep;
+	struct sock *sk;
+	int err;
+
+	sk = quic_diag_lookup(net, req);
+	if (!sk)
+		return -ENOENT;
+
+	err = sock_diag_check_cookie(sk, req->id.idiag_cookie);
+	if (err)
+		goto out;
+
+	rep = nlmsg_new(quic_diag_msg_size(), GFP_KERNEL);
+	if (!rep) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	lock_sock(sk);
+	err = quic_diag_fill(sk, rep, cb, req, 0, netlink_net_capable(in_skb, CAP_NET_ADMIN));
+	release_sock(sk);
+	if (err) {
+		WARN_ON(err == -EMSGSIZE);
+		kfree_skb(rep);
+		goto out;
+	}
+
+	err = nlmsg_unicast(net->diag_nlsk, rep, NETLINK_CB(in_skb).portid);
+out:
+	sock_put(sk);
+	return err;
+}
+
+static const struct inet_diag_handler quic_diag_handler = {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)
+	.owner		 = THIS_MODULE,
+#endif
+	.dump		 = quic_diag_dump,
+	.dump_one	 = quic_diag_dump_one,
+	.idiag_get_info	 = quic_diag_get_info,
+	.idiag_type	 = IPPROTO_QUIC,
+	.idiag_info_size = sizeof(struct quic_info),
+};
+
+static int __init quic_diag_init(void)
+{
+	return inet_diag_register(&quic_diag_handler);
+}
+
+static void __exit quic_diag_exit(void)
+{
+	inet_diag_unregister(&quic_diag_handler);
+}
+
+module_init(quic_diag_init);
+module_exit(quic_diag_exit);
+
+MODULE_ALIAS_NET_PF_PROTO_TYPE(PF_NETLINK, NETLINK_SOCK_DIAG, 2-261 /* AF_INET - IPPROTO_QUIC */);
+MODULE_ALIAS_NET_PF_PROTO_TYPE(PF_NETLINK, NETLINK_SOCK_DIAG, 10-261 /* AF_INET6 - IPPROTO_QUIC */);
+MODULE_AUTHOR("Xin Long <lucien.xin@gmail.com>");
+MODULE_DESCRIPTION("QUIC socket monitoring via SOCK_DIAG");
+MODULE_LICENSE("GPL");
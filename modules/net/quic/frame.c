@@ -17,6 +17,8 @@
 #include <net/proto_memory.h>
 #endif
 
+#include <trace/events/quic.h>
+
 /* rfc9000#section-19.3:
  *
  * ACK or ACK_ECN Frame {
@@ -107,7 +109,6 @@ static struct quic_frame *quic_frame_ack_create(struct sock *sk, void *data, u8
 	frame->len = (u16)(p - frame->data);
 	frame->size = frame->len;
 	frame->level = level;
-
 	return frame;
 }
 
@@ -481,7 +482,7 @@ static struct quic_frame *quic_frame_new_conn_id_create(struct sock *sk, void *d
 	p = quic_put_var(p, seqno);
 	p = quic_put_var(p, *prior);
 	/* Generate value for the new source connection ID (SCID). */
-	quic_conn_id_generate(&scid);
+	quic_conn_id_source_generate(id_set, &scid);
 	p = quic_put_var(p, scid.len);
 	p = quic_put_data(p, scid.data, scid.len);
 	/* rfc9000#section-10.3:
@@ -835,6 +836,7 @@ static struct quic_frame *quic_frame_data_blocked_create(struct sock *sk, void *
 	if (!frame)
 		return ERR_PTR(-ENOMEM);
 	quic_put_data(frame->data, buf, frame_len);
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_FRM_OUTDATABLOCKS);
 
 	return frame;
 }
@@ -868,6 +870,7 @@ static struct quic_frame *quic_frame_stream_data_blocked_create(struct sock *sk,
 		return ERR_PTR(-ENOMEM);
 	quic_put_data(frame->data, buf, frame_len);
 	frame->stream = stream;
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_FRM_OUTSTREAMBLOCKS);
 
 	return frame;
 }
@@ -1052,6 +1055,7 @@ static int quic_frame_ack_process(struct sock *sk, struct quic_frame *frame, u8
 {
 	u64 largest, smallest, range, delay, count, gap, i, ecn_count[QUIC_ECN_MAX];
 	u8 *p = frame->data, level = frame->level;
+	u64 *peer, ecn_acked = 0, ecn_ce = 0;
 	struct quic_inqueue *inq = quic_inq(sk);
 	struct quic_cong *cong = quic_cong(sk);
 	struct quic_pnspace *space;
@@ -1100,15 +1104,30 @@ static int quic_frame_ack_process(struct sock *sk, struct quic_frame *frame, u8
 		    !quic_get_var(&p, &len, &ecn_count[QUIC_ECN_ECT1]) ||
 		    !quic_get_var(&p, &len, &ecn_count[QUIC_ECN_CE]))
 			return -EINVAL;
+		/* Report how many newly acknowledged packets carried an ECN codepoint and how
+		 * many of them were CE-marked, so that a scalable controller can track the
+		 * marking fraction rather than only its increase.
+		 */
+		peer = space->ecn_count[QUIC_ECN_PEER];
+		for (i = 0; i < QUIC_ECN_MAX; i++) {
+			if (ecn_count[i] > peer[i])
+				ecn_acked += ecn_count[i] - peer[i];
+		}
+		if (ecn_count[QUIC_ECN_CE] > peer[QUIC_ECN_CE])
+			ecn_ce = ecn_count[QUIC_ECN_CE] - peer[QUIC_ECN_CE];
+		quic_cong_on_ecn_count(cong, (u32)min_t(u64, ecn_acked, U32_MAX),
+				       (u32)min_t(u64, ecn_ce, U32_MAX));
 		/* If the ECN-CE counter reported by the peer has increased, this could be a
 		 * new congestion event.
 		 */
 		if (quic_pnspace_set_ecn_count(space, ecn_count)) {
 			quic_cong_on_process_ecn(cong);
 			quic_outq_sync_window(sk, cong->window);
+			trace_quic_cong_update(sk, cong);
 		}
 	}
 
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_FRM_INACKS);
 	return (int)(frame->len - len);
 }
 
@@ -1389,6 +1408,7 @@ static int quic_frame_reset_stream_process(struct sock *sk, struct quic_frame *f
 	 */
 	stream->recv.state = update.state;
 	stream->recv.finalsz = update.finalsz;
+	trace_quic_stream_update(sk, stream, 0);
 
 	/* rfc9000#section-19.4:
 	 *
@@ -1451,8 +1471,9 @@ static int quic_frame_stop_sending_process(struct sock *sk, struct quic_frame *f
 	quic_inq_event_recv(sk, QUIC_EVENT_STREAM_UPDATE, &update, sizeof(update));
 
 	stream->send.state = update.state;
+	trace_quic_stream_update(sk, stream, 1);
 	quic_outq_list_purge(sk, &outq->transmitted_list, stream);
-	quic_outq_list_purge(sk, &outq->stream_list, stream);
+	quic_outq_stream_purge(sk, stream);
 out:
 	return (int)(frame->len - len);
 }
@@ -1662,6 +1683,7 @@ static int quic_frame_data_blocked_process(struct sock *sk, struct quic_frame *f
 
 	if (!quic_get_var(&p, &len, &max_bytes))
 		return -EINVAL;
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_FRM_INDATABLOCKS);
 	recv_max_bytes = inq->max_bytes;
 
 	/* rfc9000#section-19.12:
@@ -1670,7 +1692,7 @@ static int quic_frame_data_blocked_process(struct sock *sk, struct quic_frame *f
 	 *
 	 * Similar to quic_inq_flow_control(), but MAX_DATA is sent unconditionally.
 	 */
-	window = inq->max_data;
+	window = inq->window;
 	if (sk_under_memory_pressure(sk))
 		window >>= 1;
 
@@ -1697,6 +1719,7 @@ static int quic_frame_stream_data_blocked_process(struct sock *sk, struct quic_f
 	if (!quic_get_var(&p, &len, &stream_id) ||
 	    !quic_get_var(&p, &len, &max_bytes))
 		return -EINVAL;
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_FRM_INSTREAMBLOCKS);
 
 	stream = quic_stream_get(streams, (s64)stream_id, 0, quic_is_serv(sk), false);
 	if (IS_ERR(stream)) {
@@ -1801,12 +1824,14 @@ static int quic_frame_path_response_process(struct sock *sk, struct quic_frame *
 	 * to become the new active path.
 	 */
 	sk->sk_prot->unhash(sk);
-	quic_path_swap(paths);
+	quic_path_swap(sk, paths);
 	sk->sk_prot->hash(sk);
 	quic_set_sk_addr(sk, quic_path_saddr(paths, 0), 1);
 	quic_set_sk_addr(sk, quic_path_daddr(paths, 0), 0);
 	/* Notify application of updated path; indicate whether it is a local address change. */
 	local = !quic_cmp_sk_addr(sk, quic_path_saddr(paths, 1), quic_path_saddr(paths, 0));
+	trace_quic_path_migrate(sk, paths, local);
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_CONN_MIGRATIONS);
 	quic_inq_event_recv(sk, QUIC_EVENT_CONNECTION_MIGRATION, &local, sizeof(local));
 
 	/* Update path ID for all control and transmitted frames, reset route, and use the
@@ -1816,6 +1841,8 @@ static int quic_frame_path_response_process(struct sock *sk, struct quic_frame *
 	__sk_dst_reset(sk);
 	quic_outq_update_path(sk);
 	quic_conn_id_swap_active(quic_dest(sk));
+	/* The new path comes with its own congestion window. */
+	quic_outq_sync_window(sk, quic_cong(sk)->window);
 
 out:
 	len -= 8;
@@ -1880,6 +1907,67 @@ static struct quic_frame *quic_frame_datagram_create(struct sock *sk, void *data
 	return frame;
 }
 
+/* draft-ietf-quic-ack-frequency#section-5:
+ *
+ * IMMEDIATE_ACK Frame {
+ *   Type (i) = 0x1f,
+ * }
+ *
+ * A sender can use an IMMEDIATE_ACK frame to request that the peer send an ACK frame
+ * immediately, e.g. along with a PTO probe.
+ */
+static struct quic_frame *quic_frame_immediate_ack_create(struct sock *sk, void *data, u8 type)
+{
+	u8 *p, buf[QUIC_FRAME_BUF_SMALL];
+	struct quic_frame *frame;
+	u32 frame_len;
+
+	p = quic_put_var(buf, type);
+	frame_len = (u32)(p - buf);
+
+	frame = quic_frame_alloc(frame_len, NULL, GFP_ATOMIC);
+	if (!frame)
+		return ERR_PTR(-ENOMEM);
+	quic_put_data(frame->data, buf, frame_len);
+
+	return frame;
+}
+
+/* draft-ietf-quic-ack-frequency#section-4:
+ *
+ * ACK_FREQUENCY Frame {
+ *   Type (i) = 0xaf,
+ *   Sequence Number (i),
+ *   Ack-Eliciting Threshold (i),
+ *   Request Max Ack Delay (i),
+ *   Reordering Threshold (i),
+ * }
+ *
+ * An ACK_FREQUENCY frame tells the peer how many ack-eliciting packets it may receive and how
+ * long it may wait before sending an acknowledgment, and how much reordering to tolerate.
+ */
+static struct quic_frame *quic_frame_ack_frequency_create(struct sock *sk, void *data, u8 type)
+{
+	u8 *p, buf[QUIC_FRAME_BUF_LARGE];
+	struct quic_outqueue *outq = data;
+	struct quic_frame *frame;
+	u32 frame_len;
+
+	p = quic_put_var(buf, type);
+	p = quic_put_var(p, outq->ack_freq_seqno);
+	p = quic_put_var(p, outq->ack_freq_threshold);
+	p = quic_put_var(p, outq->ack_freq_delay);
+	p = quic_put_var(p, outq->ack_freq_reorder);
+	frame_len = (u32)(p - buf);
+
+	frame = quic_frame_alloc(frame_len, NULL, GFP_ATOMIC);
+	if (!frame)
+		return ERR_PTR(-ENOMEM);
+	quic_put_data(frame->data, buf, frame_len);
+
+	return frame;
+}
+
 static int quic_frame_invalid_process(struct sock *sk, struct quic_frame *frame, u8 type)
 {
 	/* rfc9000#section-12.4:
@@ -1933,6 +2021,59 @@ static int quic_frame_datagram_process(struct sock *sk, struct quic_frame *frame
 	return (int)(frame->len - len);
 }
 
+static int quic_frame_immediate_ack_process(struct sock *sk, struct quic_frame *frame, u8 type)
+{
+	/* draft-ietf-quic-ack-frequency#section-3:
+	 *
+	 * Endpoints MUST NOT send ACK_FREQUENCY or IMMEDIATE_ACK frames if the peer did not
+	 * send the min_ack_delay transport parameter.
+	 */
+	if (!quic_inq(sk)->min_ack_delay) {
+		frame->errcode = QUIC_TRANSPORT_ERROR_PROTOCOL_VIOLATION;
+		return -EINVAL;
+	}
+	return 0; /* No content.  The ACK is sent immediately as for any non-STREAM frame. */
+}
+
+static int quic_frame_ack_frequency_process(struct sock *sk, struct quic_frame *frame, u8 type)
+{
+	u64 seqno, threshold, delay, reorder;
+	struct quic_inqueue *inq = quic_inq(sk);
+	u32 len = frame->len;
+	u8 *p = frame->data;
+
+	if (!quic_get_var(&p, &len, &seqno) || !quic_get_var(&p, &len, &threshold) ||
+	    !quic_get_var(&p, &len, &delay) || !quic_get_var(&p, &len, &reorder))
+		return -EINVAL;
+
+	/* draft-ietf-quic-ack-frequency#section-4:
+	 *
+	 * Receiving a value (Request Max Ack Delay) smaller than the min_ack_delay advertised by
+	 * the receiver is invalid and MUST be treated as a connection error of type
+	 * PROTOCOL_VIOLATION.
+	 */
+	if (!inq->min_ack_delay || delay < inq->min_ack_delay) {
+		frame->errcode = QUIC_TRANSPORT_ERROR_PROTOCOL_VIOLATION;
+		return -EINVAL;
+	}
+
+	/* On receipt of an ACK_FREQUENCY frame, the endpoint will update its values only if
+	 * the Sequence Number exceeds the largest Sequence Number processed so far.
+	 */
+	if (seqno < inq->ack_freq_seqno)
+		goto out;
+	inq->ack_freq_seqno = seqno + 1;
+
+	/* The requested policy replaces the local one set through quic_config. */
+	inq->ack_threshold = (u32)min_t(u64, threshold, U32_MAX - 1) + 1;
+	inq->ack_delay = (u32)min_t(u64, delay, QUIC_MAX_ACK_DELAY - 1);
+	inq->ack_reorder = (u32)min_t(u64, reorder, U32_MAX);
+	pr_debug("%s: seqno: %llu, threshold: %u, delay: %u, reorder: %u\n", __func__, seqno,
+		 inq->ack_threshold, inq->ack_delay, inq->ack_reorder);
+out:
+	return (int)(frame->len - len);
+}
+
 static void quic_frame_padding_ack(struct sock *sk, struct quic_frame *frame)
 {
 }
@@ -1963,6 +2104,7 @@ static void quic_frame_reset_stream_ack(struct sock *sk, struct quic_frame *fram
 	 * the stream enters the "Reset Recvd" state, which is a terminal state.
 	 */
 	stream->send.state = update.state;
+	trace_quic_stream_update(sk, stream, 1);
 	quic_stream_put(streams, stream, quic_is_serv(sk), true); /* Release the send stream. */
 	sk->sk_write_space(sk); /* Wake up processes blocked while attempting to open a stream. */
 }
@@ -2003,6 +2145,7 @@ static void quic_frame_stream_ack(struct sock *sk, struct quic_frame *frame)
 	 * stream enters the "Data Recvd" state, which is a terminal state.
 	 */
 	stream->send.state = update.state;
+	trace_quic_stream_update(sk, stream, 1);
 	quic_stream_put(streams, stream, quic_is_serv(sk), true); /* Release the send stream. */
 	sk->sk_write_space(sk); /* Wake up processes blocked while attempting to open a stream. */
 }
@@ -2087,6 +2230,14 @@ static void quic_frame_datagram_ack(struct sock *sk, struct quic_frame *frame)
 {
 }
 
+static void quic_frame_immediate_ack_ack(struct sock *sk, struct quic_frame *frame)
+{
+}
+
+static void quic_frame_ack_frequency_ack(struct sock *sk, struct quic_frame *frame)
+{
+}
+
 #define quic_frame_create_and_process_and_ack(type, eliciting) \
 	{ \
 		.frame_create	= quic_frame_##type##_create, \
@@ -2127,7 +2278,7 @@ static struct quic_frame_ops quic_frame_ops[QUIC_FRAME_MAX + 1] = {
 	quic_frame_create_and_process_and_ack(connection_close, 0),
 	quic_frame_create_and_process_and_ack(connection_close, 0),
 	quic_frame_create_and_process_and_ack(handshake_done, 1),
-	quic_frame_create_and_process_and_ack(invalid, 0),
+	quic_frame_create_and_process_and_ack(immediate_ack, 1),
 	quic_frame_create_and_process_and_ack(invalid, 0), /* 0x20 */
 	quic_frame_create_and_process_and_ack(invalid, 0),
 	quic_frame_create_and_process_and_ack(invalid, 0),
@@ -2146,6 +2297,8 @@ static struct quic_frame_ops quic_frame_ops[QUIC_FRAME_MAX + 1] = {
 	quic_frame_create_and_process_and_ack(invalid, 0),
 	quic_frame_create_and_process_and_ack(datagram, 1), /* 0x30 */
 	quic_frame_create_and_process_and_ack(datagram, 1),
+	/* Types between 0x32 and 0xae are left unset and rejected as unknown frames. */
+	[QUIC_FRAME_ACK_FREQUENCY] = quic_frame_create_and_process_and_ack(ack_frequency, 1),
 };
 
 void quic_frame_ack(struct sock *sk, struct quic_frame *frame)
@@ -2160,7 +2313,9 @@ void quic_frame_ack(struct sock *sk, struct quic_frame *frame)
 int quic_frame_process(struct sock *sk, struct quic_frame *frame)
 {
 	struct quic_packet *packet = quic_packet(sk);
-	u8 type, level = frame->level;
+	u8 level = frame->level;
+	u64 type;
+	u32 len;
 	int ret;
 
 	if (!frame->len) {
@@ -2174,11 +2329,27 @@ int quic_frame_process(struct sock *sk, struct quic_frame *frame)
 	}
 
 	while (frame->len > 0) {
-		type = *frame->data++;
-		frame->len--;
+		/* Frame types are varints; ACK_FREQUENCY (0xaf) takes two bytes on the wire. */
+		len = frame->len;
+		if (!quic_get_var(&frame->data, &len, &type)) {
+			packet->errcode = QUIC_TRANSPORT_ERROR_FRAME_ENCODING;
+			return -EINVAL;
+		}
+		/* rfc9000#section-12.4:
+		 *
+		 * To ensure simple and efficient implementations of frame parsing, a frame
+		 * type MUST use the shortest possible encoding.  An endpoint MAY treat the
+		 * receipt of a frame type that uses a longer encoding than necessary as a
+		 * connection error of type PROTOCOL_VIOLATION.
+		 */
+		if (frame->len - len != quic_var_len(type)) {
+			packet->errcode = QUIC_TRANSPORT_ERROR_PROTOCOL_VIOLATION;
+			return -EINVAL;
+		}
+		frame->len = (u16)len;
 
-		if (type > QUIC_FRAME_MAX) {
-			pr_debug("%s: unsupported frame, type: %x, level: %d\n",
+		if (type > QUIC_FRAME_MAX || !quic_frame_ops[type].frame_process) {
+			pr_debug("%s: unsupported frame, type: %llx, level: %d\n",
 				 __func__, type, level);
 			/* rfc9000#section-12.4:
 			 *
@@ -2188,19 +2359,20 @@ int quic_frame_process(struct sock *sk, struct quic_frame *frame)
 			packet->errcode = QUIC_TRANSPORT_ERROR_FRAME_ENCODING;
 			return -EPROTONOSUPPORT;
 		} else if (!quic_frame_level_valid(level, type)) {
-			pr_debug("%s: invalid frame, type: %x, level: %d\n",
+			pr_debug("%s: invalid frame, type: %llx, level: %d\n",
 				 __func__, type, level);
 			return -EINVAL;
 		}
 		ret = quic_frame_ops[type].frame_process(sk, frame, type);
 		if (ret < 0) {
-			pr_debug("%s: failed, type: %x, level: %d, err: %d\n",
+			pr_debug("%s: failed, type: %llx, level: %d, err: %d\n",
 				 __func__, type, level, ret);
 			packet->errframe = type;
 			packet->errcode = frame->errcode;
 			return ret;
 		}
-		pr_debug("%s: done, type: %x, level: %d\n", __func__, type, level);
+		pr_debug("%s: done, type: %llx, level: %d\n", __func__, type, level);
+		trace_quic_frame_process(sk, type, level, ret);
 		if (quic_frame_ops[type].ack_eliciting) {
 			packet->ack_requested = 1;
 			/* Require immediate ACKs for non-stream or stream-FIN frames. */
@@ -2224,12 +2396,13 @@ int quic_frame_process(struct sock *sk, struct quic_frame *frame)
 	}
 	return 0;
 }
+EXPORT_SYMBOL_GPL(quic_frame_process);
 
 struct quic_frame *quic_frame_create(struct sock *sk, u8 type, void *data)
 {
 	struct quic_frame *frame;
 
-	if (type > QUIC_FRAME_MAX)
+	if (type > QUIC_FRAME_MAX || !quic_frame_ops[type].frame_create)
 		return ERR_PTR(-EINVAL);
 	frame = quic_frame_ops[type].frame_create(sk, data, type);
 	if (IS_ERR(frame)) {
@@ -2241,8 +2414,10 @@ struct quic_frame *quic_frame_create(struct sock *sk, u8 type, void *data)
 		frame->type = type;
 	frame->ack_eliciting = quic_frame_ops[type].ack_eliciting;
 	pr_debug("%s: done, type: %x, len: %u\n", __func__, type, frame->len);
+	trace_quic_frame_create(sk, frame);
 	return frame;
 }
+EXPORT_SYMBOL_GPL(quic_frame_create);
 
 struct quic_frame *quic_frame_alloc(u32 size, u8 *data, gfp_t gfp)
 {
@@ -2300,6 +2475,7 @@ void quic_frame_put(struct quic_frame *frame)
 	if (refcount_dec_and_test(&frame->refcnt))
 		quic_frame_free(frame);
 }
+EXPORT_SYMBOL_GPL(quic_frame_put);
 
 /* Appends stream data to a QUIC frame. */
 int quic_frame_stream_append(struct sock *sk, struct quic_frame *frame,
@@ -2511,7 +2687,7 @@ int quic_frame_build_transport_params_ext(struct sock *sk, struct quic_transport
 			/* Write preferred address parameter with an associated conn ID and
 			 * stateless reset token.
 			 */
-			quic_conn_id_generate(&conn_id);
+			quic_conn_id_source_generate(quic_source(sk), &conn_id);
 			err = quic_crypto_generate_stateless_reset_token(crypto, conn_id.data,
 									 conn_id.len, token,
 									 QUIC_CONN_ID_TOKEN_LEN);
@@ -2596,6 +2772,10 @@ int quic_frame_build_transport_params_ext(struct sock *sk, struct quic_transport
 		p = quic_put_param(p, QUIC_TRANSPORT_PARAM_MAX_DATAGRAM_FRAME_SIZE,
 				   params->max_datagram_frame_size);
 	}
+	if (params->min_ack_delay) {
+		p = quic_put_param(p, QUIC_TRANSPORT_PARAM_MIN_ACK_DELAY,
+				   params->min_ack_delay);
+	}
 	*len = p - data;
 	return 0;
 }
@@ -2826,6 +3006,13 @@ int quic_frame_parse_transport_params_ext(struct sock *sk, struct quic_transport
 				return -EINVAL;
 			params->max_datagram_frame_size = value;
 			break;
+		case QUIC_TRANSPORT_PARAM_MIN_ACK_DELAY:
+			if (!quic_get_param(&value, &p, &len))
+				return -EINVAL;
+			if (value >= QUIC_MAX_ACK_DELAY)
+				return -EINVAL;
+			params->min_ack_delay = value;
+			break;
 		case QUIC_TRANSPORT_PARAM_STATELESS_RESET_TOKEN:
 			if (quic_is_serv(sk))
 				return -EINVAL;
@@ -2878,5 +3065,13 @@ int quic_frame_parse_transport_params_ext(struct sock *sk, struct quic_transport
 		}
 	}
 
+	/* draft-ietf-quic-ack-frequency#section-3:
+	 *
+	 * Receiving a min_ack_delay greater than the max_ack_delay MUST be treated as a
+	 * connection error of type TRANSPORT_PARAMETER_ERROR.
+	 */
+	if (params->min_ack_delay > params->max_ack_delay)
+		return -EINVAL;
+
 	return quic_packet_select_version(sk, versions, count);
 }
@@ -43,9 +43,11 @@ enum {
 	QUIC_FRAME_CONNECTION_CLOSE = 0x1c,
 	QUIC_FRAME_CONNECTION_CLOSE_APP = 0x1d,
 	QUIC_FRAME_HANDSHAKE_DONE = 0x1e,
+	QUIC_FRAME_IMMEDIATE_ACK = 0x1f, /* draft-ietf-quic-ack-frequency */
 	QUIC_FRAME_DATAGRAM = 0x30, /* RFC 9221 */
 	QUIC_FRAME_DATAGRAM_LEN = 0x31,
-	QUIC_FRAME_MAX = QUIC_FRAME_DATAGRAM_LEN,
+	QUIC_FRAME_ACK_FREQUENCY = 0xaf, /* draft-ietf-quic-ack-frequency */
+	QUIC_FRAME_MAX = QUIC_FRAME_ACK_FREQUENCY,
 };
 
 enum {
@@ -70,6 +72,7 @@ enum {
 	QUIC_TRANSPORT_PARAM_GREASE_QUIC_BIT = 0x2ab2,
 	QUIC_TRANSPORT_PARAM_VERSION_INFORMATION = 0x11,
 	QUIC_TRANSPORT_PARAM_DISABLE_1RTT_ENCRYPTION = 0xbaad,
+	QUIC_TRANSPORT_PARAM_MIN_ACK_DELAY = 0xff04de1b,
 };
 
 /* Arguments passed to create a STREAM frame */
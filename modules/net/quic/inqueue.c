@@ -17,6 +17,8 @@
 #include <net/proto_memory.h>
 #endif
 
+#include <trace/events/quic.h>
+
 /* Frees socket receive memory resources after read. */
 static void quic_inq_rfree(int len, struct sock *sk)
 {
@@ -39,6 +41,47 @@ static void quic_inq_set_owner_r(int len, struct sock *sk)
 
 #define QUIC_INQ_RWND_SHIFT	4
 
+/* Grow the receive windows based on how fast the application reads data, similar to
+ * tcp_rcv_space_adjust().  The amount of data read over one smoothed RTT is measured,
+ * and the connection and stream windows are raised to twice that, so the peer is never
+ * limited by flow control while its congestion window is still growing.  The windows
+ * never shrink and are bounded by sysctl_quic_rmem[2], with sk_rcvbuf following them.
+ */
+static void quic_inq_rcv_space_adjust(struct sock *sk, struct quic_stream *stream)
+{
+	u32 rtt = quic_cong(sk)->smoothed_rtt;
+	struct quic_inqueue *inq = quic_inq(sk);
+	u64 now, copied, window, max;
+
+	now = quic_ktime_get_us();
+	if (!inq->rcv_space_time) { /* Start the first measurement. */
+		inq->rcv_space_time = now;
+		return;
+	}
+	if (now - inq->rcv_space_time < rtt)
+		return;
+
+	copied = inq->bytes - inq->rcv_space_bytes;
+	inq->rcv_space_bytes = inq->bytes;
+	inq->rcv_space_time = now;
+
+	/* Skip if the read rate did not increase, or the user set SO_RCVBUF explicitly. */
+	if (copied <= inq->rcv_space || (sk->sk_userlocks & SOCK_RCVBUF_LOCK) ||
+	    sk_under_memory_pressure(sk))
+		return;
+	inq->rcv_space = copied;
+
+	max = min_t(u64, READ_ONCE(sysctl_quic_rmem[2]) >> 1, S32_MAX / 2);
+	window = min(copied << 1, max);
+	if (window > inq->window) {
+		inq->window = window;
+		if (sk->sk_rcvbuf < (int)window * 2)
+			WRITE_ONCE(sk->sk_rcvbuf, (int)window * 2);
+	}
+	if (window > stream->recv.window)
+		stream->recv.window = window;
+}
+
 /* Update receive flow control windows and send MAX_DATA or MAX_STREAM_DATA frames if needed. */
 void quic_inq_flow_control(struct sock *sk, struct quic_stream *stream, u32 bytes)
 {
@@ -56,8 +99,10 @@ void quic_inq_flow_control(struct sock *sk, struct quic_stream *stream, u32 byte
 	stream->recv.bytes += bytes;
 	inq->bytes += bytes;
 
+	quic_inq_rcv_space_adjust(sk, stream);
+
 	 /* Check and update connection-level flow control. */
-	window = inq->max_data;
+	window = inq->window;
 	if (inq->bytes + window - inq->max_bytes >=
 	    max(mss, (window >> QUIC_INQ_RWND_SHIFT))) {
 		/* Reduce window increment if memory pressure detected. */
@@ -119,6 +164,7 @@ static void quic_inq_stream_tail(struct sock *sk, struct quic_stream *stream,
 		 * enters the "Data Recvd" state.
 		 */
 		stream->recv.state = update.state;
+		trace_quic_stream_update(sk, stream, 0);
 		/* Release stream and update limits to allow opening new streams. */
 		quic_stream_put(quic_streams(sk), stream, quic_is_serv(sk), false);
 	}
@@ -214,6 +260,19 @@ int quic_inq_stream_recv(struct sock *sk, struct quic_frame *frame)
 		update.id = stream->id;
 		update.state = QUIC_STREAM_RECV_STATE_RECV;
 		quic_inq_event_recv(sk, QUIC_EVENT_STREAM_UPDATE, &update, sizeof(update));
+
+		/* rfc9000#section-3.2:
+		 *
+		 * The receiving part of a stream initiated by a peer is created when the first
+		 * STREAM, STREAM_DATA_BLOCKED, or RESET_STREAM frame is received for that stream.
+		 * The initial state is "Recv".
+		 *
+		 * Streams are allocated zeroed, so "Recv" is set, and traced, on the first data.
+		 */
+		if (stream->recv.state != update.state) {
+			stream->recv.state = update.state;
+			trace_quic_stream_update(sk, stream, 0);
+		}
 	}
 	head = &inq->stream_list;
 	if (stream->recv.offset < offset) { /* Out-of-order: insert in frame list in order. */
@@ -266,6 +325,7 @@ int quic_inq_stream_recv(struct sock *sk, struct quic_frame *frame)
 			 */
 			stream->recv.state = update.state;
 			stream->recv.finalsz = update.finalsz;
+			trace_quic_stream_update(sk, stream, 0);
 		}
 		list_add_tail(&frame->list, head);
 		stream->recv.frags++;
@@ -321,6 +381,7 @@ void quic_inq_list_purge(struct sock *sk, struct list_head *head, struct quic_st
 	}
 	quic_inq_rfree(bytes, sk);
 }
+EXPORT_SYMBOL_GPL(quic_inq_list_purge);
 
 /* Handle in-order crypto (handshake) frame delivery.
  *
@@ -483,6 +544,64 @@ int quic_inq_handshake_recv(struct sock *sk, struct quic_frame *frame)
 	return 0;
 }
 
+/* Check whether the ack-eliciting 1-RTT packet just received has to be acknowledged right
+ * away under the ACK policy in effect.  Otherwise the ACK waits for the ack delay timer, or
+ * for an ACK sent for a later packet.
+ */
+bool quic_inq_ack_immediate(struct sock *sk)
+{
+	struct quic_pnspace *space = quic_pnspace(sk, QUIC_CRYPTO_APP);
+	struct quic_inqueue *inq = quic_inq(sk);
+
+	/* rfc9000#section-13.2.2:
+	 *
+	 * A receiver SHOULD send an ACK frame after receiving at least two ack-eliciting
+	 * packets.
+	 *
+	 * draft-ietf-quic-ack-frequency#section-6.1:
+	 *
+	 * When an endpoint receives more than Ack-Eliciting Threshold ack-eliciting packets
+	 * since the last ACK was sent, it sends an ACK frame immediately.
+	 */
+	inq->ack_eliciting++;
+	if (inq->ack_threshold && inq->ack_eliciting >= inq->ack_threshold)
+		return true;
+
+	/* rfc9000#section-13.2.1:
+	 *
+	 * An endpoint SHOULD generate and send an ACK frame without delay when ... the packet
+	 * has a packet number larger than the highest-numbered ack-eliciting packet that has
+	 * been received and there are missing packets between that packet and this packet.
+	 *
+	 * draft-ietf-quic-ack-frequency#section-6.2 generalizes it: an immediate ACK is sent
+	 * when the largest received packet number is at least Reordering Threshold beyond a
+	 * missing packet that has not been reported yet.  Only the smallest missing packet is
+	 * tracked, so each hole triggers at most one ACK.
+	 */
+	if (!inq->ack_reorder || !quic_pnspace_has_gap(space) ||
+	    space->base_pn == inq->ack_missing)
+		return false;
+	if (space->max_pn_seen - space->base_pn < inq->ack_reorder)
+		return false;
+	inq->ack_missing = space->base_pn;
+	return true;
+}
+
+/* An ACK frame for all ack-eliciting 1-RTT packets received so far is going on the wire:
+ * restart counting towards the Ack-Eliciting Threshold, and turn a pending ack delay timer
+ * back into the idle timer, as there is nothing left for it to acknowledge.
+ */
+void quic_inq_ack_sent(struct sock *sk)
+{
+	struct quic_inqueue *inq = quic_inq(sk);
+
+	inq->ack_eliciting = 0;
+	if (inq->sack_flag == QUIC_SACK_FLAG_APP) {
+		inq->sack_flag = QUIC_SACK_FLAG_NONE;
+		quic_timer_reset(sk, QUIC_TIMER_IDLE, inq->timeout);
+	}
+}
+
 /* Populate transport parameters from inqueue. */
 void quic_inq_get_param(struct sock *sk, struct quic_transport_param *p)
 {
@@ -500,6 +619,7 @@ void quic_inq_get_param(struct sock *sk, struct quic_transport_param *p)
 	p->grease_quic_bit = inq->grease_quic_bit;
 	p->stateless_reset = inq->stateless_reset;
 	p->max_ack_delay = inq->max_ack_delay;
+	p->min_ack_delay = inq->min_ack_delay;
 	p->max_data = inq->max_data;
 }
 
@@ -528,10 +648,13 @@ void quic_inq_set_param(struct sock *sk, struct quic_transport_param *p)
 	inq->grease_quic_bit = p->grease_quic_bit;
 	inq->stateless_reset = p->stateless_reset;
 	inq->max_ack_delay = p->max_ack_delay;
+	inq->min_ack_delay = p->min_ack_delay;
 	inq->max_data = p->max_data;
 
+	inq->ack_delay = inq->max_ack_delay;
 	inq->timeout = inq->max_idle_timeout;
 	inq->max_bytes = inq->max_data;
+	inq->window = inq->max_data;
 	sk->sk_rcvbuf = (int)p->max_data * 2;
 }
 
@@ -616,6 +739,8 @@ void quic_inq_init(struct sock *sk)
 	INIT_LIST_HEAD(&inq->stream_list);
 	INIT_LIST_HEAD(&inq->early_list);
 	INIT_LIST_HEAD(&inq->recv_list);
+
+	inq->ack_missing = -1;
 }
 
 void quic_inq_free(struct sock *sk)
@@ -27,9 +27,29 @@ struct quic_inqueue {
 	/* Flow Control */
 	u64 max_bytes;			/* Maximum data allowed to be received */
 	u64 bytes;			/* Data already read by the application */
+	u64 window;			/* Connection-level receive window, auto-tuned */
+
+	/* Receive window auto-tuning, similar to TCP's rcvq_space */
+	u64 rcv_space;			/* Highest data read by the application in one RTT */
+	u64 rcv_space_bytes;		/* inq->bytes at the start of the measurement */
+	u64 rcv_space_time;		/* Start time of the measurement (us) */
+
+	/* ACK policy in effect: the local one from quic_config, until the peer requests
+	 * another one in an ACK_FREQUENCY frame (draft-ietf-quic-ack-frequency#section-4).
+	 */
+	u64 ack_freq_seqno;		/* Smallest ACK_FREQUENCY Sequence Number to accept */
+	u32 ack_threshold;		/* Unacked ack-eliciting packets to ACK at, 0 for none */
+	u32 ack_reorder;		/* Reordering Threshold, 0 to ignore reordering */
+	u32 ack_delay;			/* Delay for ACKs not sent immediately (us) */
+	u32 ack_eliciting;		/* Ack-eliciting packets received since the last ACK */
+	s64 ack_missing;		/* Smallest missing packet number already reported */
 
 	u8 sack_flag:2;			/* SACK timer handling flag; See QUIC_SACK_FLAG_* */
 
+	/* Local ACK policy, from quic_config */
+	u8 ack_eliciting_threshold;	/* ACK every N ack-eliciting packets, 0 for timer only */
+	u8 ack_reordering_threshold;	/* ACK when a packet is missing by N, 0 to disable */
+
 	/* Transport Parameters (local) */
 	/* Transport parameter Version Information related in rfc9368#section-3 */
 	u8 disable_compatible_version:1;
@@ -42,6 +62,8 @@ struct quic_inqueue {
 	u16 max_udp_payload_size;	/* Transport parameter in rfc9000#section-18.2 */
 	u32 max_idle_timeout;		/* Transport parameter in rfc9000#section-18.2 */
 	u32 max_ack_delay;		/* Transport parameter in rfc9000#section-18.2 */
+	/* Transport parameter in draft-ietf-quic-ack-frequency#section-3 */
+	u32 min_ack_delay;
 	u64 max_data;			/* Transport parameter in rfc9000#section-18.2 */
 	u64 highest;			/* Highest received offset across all streams */
 	u32 timeout;			/* Idle timeout duration*/
@@ -58,6 +80,8 @@ void quic_inq_backlog_tail(struct sock *sk, struct sk_buff *skb);
 void quic_inq_data_read(struct sock *sk, u32 bytes);
 
 void quic_inq_flow_control(struct sock *sk, struct quic_stream *stream, u32 bytes);
+bool quic_inq_ack_immediate(struct sock *sk);
+void quic_inq_ack_sent(struct sock *sk);
 void quic_inq_get_param(struct sock *sk, struct quic_transport_param *p);
 void quic_inq_set_param(struct sock *sk, struct quic_transport_param *p);
 void quic_inq_init(struct sock *sk);
@@ -0,0 +1,327 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/* QUIC kernel implementation
+ * (C) Copyright Red Hat Corp. 2023
+ *
+ * This file is kernel benchmark of the QUIC kernel implementation
+ *
+ * Microbenchmarks for the per-packet primitives: variable-length integer encoding, ACK frame
+ * creation, STREAM frame processing and AEAD packet protection.  They run in tight loops on
+ * a QUIC socket that is never connected and on synthetic skbs, so no network is needed:
+ *
+ *   # insmod quic.ko && insmod quic_microbench_test.ko [iterations=N]
+ *   # dmesg | grep quic_bench:
+ *
+ * Each result is printed as "quic_bench: <name> <ns/op> ns/op <ops/s> ops/s", the format of
+ * microbench_baseline.txt.  "./runtest.sh microbench" in the tests directory loads it and
+ * compares the results with the baseline.
+ *
+ * Written or modified by:
+ *    Xin Long <lucien.xin@gmail.com>
+ */
+
+#include <linux/completion.h>
+#include <linux/skbuff.h>
+#include <linux/module.h>
+#include <linux/quic.h>
+#include <kunit/test.h>
+#include <net/sock.h>
+#include <net/tls.h>
+
+#include "socket.h"
+
+static unsigned int iterations = 100000;
+module_param(iterations, uint, 0644);
+MODULE_PARM_DESC(iterations, "Number of operations measured by each benchmark");
+
+/* Type (1) + Stream ID (1) + Offset (4) + Length (2) */
+#define QUIC_BENCH_STREAM_HLEN	8
+#define QUIC_BENCH_OFFSET_MAX	0x3fffffffULL	/* Largest 4-byte varint for the offset */
+#define QUIC_BENCH_PURGE	16	/* STREAM frames queued before freeing them */
+#define QUIC_BENCH_DCID_LEN	8
+
+static void quic_bench_report(struct kunit *test, const char *name, u64 ns, u32 ops)
+{
+	u64 tenths, rate;
+
+	if (!ops)
+		return;
+	ns = max_t(u64, ns, 1);
+	tenths = div_u64(ns * 10, ops);
+	rate = div64_u64((u64)ops * NSEC_PER_SEC, ns);
+	kunit_info(test, "quic_bench: %-28s %8llu.%llu ns/op %12llu ops/s\n", name,
+		   tenths / 10, tenths % 10, rate);
+}
+
+static struct socket *quic_bench_sock_create(struct kunit *test)
+{
+	struct socket *sock;
+	int err;
+
+	err = __sock_create(&init_net, PF_INET, SOCK_DGRAM, IPPROTO_QUIC, &sock, 1);
+	KUNIT_ASSERT_EQ(test, err, 0);
+	return sock;
+}
+
+/* rfc9000#section-a.1: the sample variable-length integers, one of each encoded length. */
+static u64 quic_bench_vars[] = { 37, 15293, 494878333, 151288809941952652ULL };
+
+static void quic_bench_varint(struct kunit *test)
+{
+	u8 buf[sizeof(quic_bench_vars)], *p;
+	u32 i, j, len, n = ARRAY_SIZE(quic_bench_vars);
+	u64 start, val = 0;
+
+	start = ktime_get_ns();
+	for (i = 0; i < iterations; i++) {
+		p = buf;
+		for (j = 0; j < n; j++)
+			p = quic_put_var(p, quic_bench_vars[j]);
+	}
+	quic_bench_report(test, "varint_encode", ktime_get_ns() - start, iterations * n);
+
+	start = ktime_get_ns();
+	for (i = 0; i < iterations; i++) {
+		p = buf;
+		len = sizeof(buf);
+		for (j = 0; j < n; j++)
+			quic_get_var(&p, &len, &val);
+	}
+	quic_bench_report(test, "varint_decode", ktime_get_ns() - start, iterations * n);
+
+	/* Make sure the decode loop measured real work. */
+	p = buf;
+	len = sizeof(buf);
+	for (j = 0; j < n; j++) {
+		KUNIT_EXPECT_NE(test, quic_get_var(&p, &len, &val), 0);
+		KUNIT_EXPECT_EQ(test, val, quic_bench_vars[j]);
+	}
+}
+
+/* Build the ACK frame for a pnspace holding @ranges ACK Ranges, as done for every ACK sent. */
+static void quic_bench_ack_create(struct kunit *test)
+{
+	struct quic_gap_ack_block gabs[QUIC_PN_MAP_MAX_GABS];
+	u32 ranges[] = { 1, 8, QUIC_PN_MAP_MAX_GABS + 1 };
+	u8 level = QUIC_CRYPTO_APP;
+	struct quic_pnspace *space;
+	struct quic_frame *frame;
+	struct socket *sock;
+	char name[32];
+	u32 i, j, ops;
+	u64 start;
+
+	sock = quic_bench_sock_create(test);
+	space = quic_pnspace(sock->sk, level);
+
+	lock_sock(sock->sk);
+	for (i = 0; i < ARRAY_SIZE(ranges); i++) {
+		quic_pnspace_free(space);
+		memset(space, 0, sizeof(*space));
+		if (quic_pnspace_init(space))
+			break;
+		space->time = quic_ktime_get_us();
+		/* Receive every other packet number to get one gap per additional range. */
+		for (j = 0; j < ranges[i]; j++)
+			quic_pnspace_mark(space, (s64)j * 2);
+		KUNIT_EXPECT_EQ(test, quic_pnspace_num_gabs(space, gabs), ranges[i] - 1);
+
+		start = ktime_get_ns();
+		for (ops = 0; ops < iterations; ops++) {
+			frame = quic_frame_create(sock->sk, QUIC_FRAME_ACK, &level);
+			if (IS_ERR(frame))
+				break;
+			quic_frame_put(frame);
+		}
+		snprintf(name, sizeof(name), "ack_create_%u_ranges", ranges[i]);
+		quic_bench_report(test, name, ktime_get_ns() - start, ops);
+		KUNIT_EXPECT_EQ(test, ops, iterations);
+	}
+	release_sock(sock->sk);
+
+	sock_release(sock);
+}
+
+/* Process in-order STREAM frames from a synthetic skb into a peer-initiated stream, the way
+ * quic_packet_app_process() hands over a decrypted packet payload.
+ */
+static void quic_bench_stream_process(struct kunit *test)
+{
+	u32 sizes[] = { 64, 1200 }, i, ops;
+	struct quic_stream *stream;
+	struct quic_inqueue *inq;
+	struct quic_frame frame;
+	struct socket *sock;
+	struct sk_buff *skb;
+	s64 stream_id = 1;
+	u64 start, offset;
+	char name[32];
+	u8 *p;
+	int err;
+
+	sock = quic_bench_sock_create(test);
+	inq = quic_inq(sock->sk);
+
+	lock_sock(sock->sk);
+	/* Lift connection-level flow control; stream-level is lifted once the stream exists. */
+	inq->max_bytes = QUIC_BENCH_OFFSET_MAX * ARRAY_SIZE(sizes);
+	for (i = 0; i < ARRAY_SIZE(sizes); i++, stream_id += 4) {
+		skb = alloc_skb(QUIC_BENCH_STREAM_HLEN + sizes[i], GFP_KERNEL);
+		if (!skb)
+			break;
+		p = skb_put_zero(skb, QUIC_BENCH_STREAM_HLEN + sizes[i]);
+		p = quic_put_var(p, QUIC_FRAME_STREAM | QUIC_STREAM_BIT_OFF | QUIC_STREAM_BIT_LEN);
+		p = quic_put_var(p, stream_id);
+		p = quic_put_varint(p, 0, 4);
+		quic_put_varint(p, sizes[i], 2);
+
+		err = 0;
+		offset = 0;
+		start = ktime_get_ns();
+		for (ops = 0; ops < iterations; ops++) {
+			if (offset + sizes[i] > QUIC_BENCH_OFFSET_MAX)
+				break;
+			quic_put_varint(skb->data + 2, offset, 4);
+			memset(&frame, 0, sizeof(frame));
+			frame.data = skb->data;
+			frame.len = (u16)skb->len;
+			frame.skb = skb;
+			err = quic_frame_process(sock->sk, &frame);
+			if (err)
+				break;
+			if (!offset) { /* Stream just opened: lift its flow control as well. */
+				stream = list_first_entry(&inq->recv_list, struct quic_frame,
+							  list)->stream;
+				stream->recv.max_bytes = QUIC_BENCH_OFFSET_MAX;
+			}
+			offset += sizes[i];
+			if (!((ops + 1) % QUIC_BENCH_PURGE))
+				quic_inq_list_purge(sock->sk, &inq->recv_list, NULL);
+		}
+		snprintf(name, sizeof(name), "stream_process_%u", sizes[i]);
+		quic_bench_report(test, name, ktime_get_ns() - start, ops);
+		KUNIT_EXPECT_EQ(test, err, 0);
+
+		quic_inq_list_purge(sock->sk, &inq->recv_list, NULL);
+		kfree_skb(skb);
+	}
+	release_sock(sock->sk);
+
+	sock_release(sock);
+}
+
+static DECLARE_COMPLETION(quic_bench_crypto_done);
+
+static void quic_bench_encrypt_done(struct sk_buff *skb, int err)
+{
+	complete(&quic_bench_crypto_done);
+}
+
+static u8 quic_bench_secret[QUIC_CRYPTO_SECRET_BUFFER_SIZE] = {
+	0x55, 0xe7, 0x18, 0x93, 0x73, 0x08, 0x09, 0xf6, 0xbf, 0xa1, 0xab, 0x66, 0xe8, 0xfc, 0x02,
+	0xde, 0x17, 0xfa, 0xbe, 0xc5, 0x4a, 0xe7, 0xe4, 0xb8, 0x25, 0x48, 0xff, 0xe9, 0xd6, 0x7d,
+	0x8e, 0x0e, 0x3b, 0x0d, 0x6a, 0x91, 0x2c, 0x44, 0x70, 0x5f, 0xc1, 0x86, 0x19, 0xa4, 0x2e,
+	0xb7, 0x63, 0xd8};
+
+static struct {
+	u32 type;
+	char *name;
+} quic_bench_ciphers[] = {
+	{ TLS_CIPHER_AES_GCM_128, "aes128gcm" },
+	{ TLS_CIPHER_AES_GCM_256, "aes256gcm" },
+	{ TLS_CIPHER_AES_CCM_128, "aes128ccm" },
+	{ TLS_CIPHER_CHACHA20_POLY1305, "chacha20poly1305" },
+};
+
+/* Protect a 1-RTT packet of @len bytes (header included) with the TX keys of @crypto: payload
+ * encryption plus header protection, exactly as quic_packet_xmit() does per packet.
+ */
+static int quic_bench_encrypt(struct kunit *test, struct quic_crypto *crypto, const char *cipher,
+			      u32 len)
+{
+	struct quic_skb_cb *cb;
+	struct sk_buff *skb;
+	char name[32];
+	u64 start;
+	u32 ops;
+	int err;
+
+	skb = alloc_skb(len + QUIC_TAG_LEN, GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+	skb_reset_transport_header(skb);
+	skb_put_zero(skb, len);
+	cb = QUIC_SKB_CB(skb);
+
+	err = 0;
+	start = ktime_get_ns();
+	for (ops = 0; ops < iterations; ops++) {
+		skb->data[0] = 0x43; /* Short header, fixed bit, 4-byte packet number. */
+		cb->number_offset = 1 + QUIC_BENCH_DCID_LEN;
+		cb->number_len = 4;
+		cb->number = ops;
+		cb->crypto_done = quic_bench_encrypt_done;
+		cb->resume = 0;
+		reinit_completion(&quic_bench_crypto_done);
+		err = quic_crypto_encrypt(crypto, skb);
+		if (err == -EINPROGRESS) { /* Async AEAD: wait for the payload to be done. */
+			wait_for_completion(&quic_bench_crypto_done);
+			err = 0;
+		}
+		if (err)
+			break;
+		skb_trim(skb, len); /* Drop the AEAD tag appended by the encryption. */
+	}
+	snprintf(name, sizeof(name), "encrypt_%s_%u", cipher, len);
+	quic_bench_report(test, name, ktime_get_ns() - start, ops);
+
+	kfree_skb(skb);
+	return err;
+}
+
+static void quic_bench_crypto(struct kunit *test)
+{
+	u32 sizes[] = { 64, 1200 }, i, j;
+	struct quic_crypto_secret srt = {};
+	struct quic_crypto *crypto;
+
+	crypto = kunit_kzalloc(test, sizeof(*crypto), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, crypto);
+
+	srt.send = 1;
+	memcpy(srt.secret, quic_bench_secret, sizeof(srt.secret));
+	for (i = 0; i < ARRAY_SIZE(quic_bench_ciphers); i++) {
+		srt.type = quic_bench_ciphers[i].type;
+		if (quic_crypto_set_secret(crypto, &srt, QUIC_VERSION_V1, 0)) {
+			/* The AEAD may not be built in this kernel; report it and go on. */
+			kunit_info(test, "quic_bench: %s unavailable\n",
+				   quic_bench_ciphers[i].name);
+			quic_crypto_free(crypto);
+			memset(crypto, 0, sizeof(*crypto));
+			continue;
+		}
+		for (j = 0; j < ARRAY_SIZE(sizes); j++)
+			KUNIT_EXPECT_EQ(test, quic_bench_encrypt(test, crypto,
+							       quic_bench_ciphers[i].name,
+							       sizes[j]), 0);
+		quic_crypto_free(crypto);
+		memset(crypto, 0, sizeof(*crypto));
+	}
+}
+
+static struct kunit_case quic_bench_cases[] = {
+	KUNIT_CASE(quic_bench_varint),
+	KUNIT_CASE(quic_bench_ack_create),
+	KUNIT_CASE(quic_bench_stream_process),
+	KUNIT_CASE(quic_bench_crypto),
+	{}
+};
+
+static struct kunit_suite quic_bench_suite = {
+	.name = "quic_bench",
+	.test_cases = quic_bench_cases,
+};
+
+kunit_test_suite(quic_bench_suite);
+
+MODULE_DESCRIPTION("Benchmark QUIC Kernel API functions");
+MODULE_LICENSE("GPL");
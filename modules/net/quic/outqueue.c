@@ -12,6 +12,8 @@
 
 #include "socket.h"
 
+#include <trace/events/quic.h>
+
 /* Return true a frame can not be transmitted based on congestion control and Anti-Amplification. */
 static bool quic_outq_limit_check(struct sock *sk, struct quic_frame *frame)
 {
@@ -136,6 +138,7 @@ int quic_outq_flow_control(struct sock *sk, struct quic_stream *stream, u16 byte
 				transmit = 1;
 			stream->send.last_max_bytes = stream->send.max_bytes;
 			stream->send.data_blocked = 1;
+			trace_quic_flow_blocked(sk, stream->id, stream->send.max_bytes);
 		}
 		blocked = 1;
 	}
@@ -150,6 +153,7 @@ int quic_outq_flow_control(struct sock *sk, struct quic_stream *stream, u16 byte
 				transmit = 1;
 			outq->last_max_bytes = outq->max_bytes;
 			outq->data_blocked = 1;
+			trace_quic_flow_blocked(sk, -1, outq->max_bytes);
 		}
 		blocked = 1;
 	}
@@ -176,6 +180,16 @@ u64 quic_outq_wspace(struct sock *sk, struct quic_stream *stream)
 	return len;
 }
 
+/* Returns true if the unsent data is below the QUIC_SOCKOPT_NOTSENT_LOWAT limit, similar to
+ * tcp_stream_memory_free().
+ */
+bool quic_outq_notsent_ok(struct sock *sk)
+{
+	struct quic_outqueue *outq = quic_outq(sk);
+
+	return !outq->notsent_lowat || outq->unsent_bytes < outq->notsent_lowat;
+}
+
 /* Applies pacing and Nagle’s algorithm. Returns true if sending should be delayed, false if
  * immediate send.
  */
@@ -210,12 +224,20 @@ static bool quic_outq_delay_check(struct sock *sk, u8 level, bool nodelay)
 	return true; /* Otherwise, delay sending to coalesce more data. */
 }
 
-/* Sends stream data frames. */
+/* Sends stream data frames, starting from the streams with the highest urgency.
+ *
+ * rfc9218#section-4.2: Within the same urgency, non-incremental streams are served one at a
+ * time in the order they were queued, while incremental streams take turns.  The turns are
+ * given by deficit round robin, so incremental streams share the bandwidth in proportion to
+ * their weights, regardless of the frame sizes each one queues.
+ */
 static void quic_outq_transmit_stream(struct sock *sk)
 {
 	struct quic_outqueue *outq = quic_outq(sk);
-	struct quic_frame *frame, *next;
+	struct quic_stream *stream;
+	struct quic_frame *frame;
 	struct list_head *head;
+	u8 urgency;
 
 	/* Although frame->level is always App, stream data may need to be sent at App or Early
 	 * level depending on key availability. Use outq->data_level to select the level.
@@ -223,23 +245,67 @@ static void quic_outq_transmit_stream(struct sock *sk)
 	if (!quic_crypto(sk, outq->data_level)->send_ready)
 		return;
 
-	head = &outq->stream_list;
-	list_for_each_entry_safe(frame, next, head, list) {
-		if (quic_packet_config(sk, outq->data_level, frame->path))
-			break;
-		if (quic_outq_limit_check(sk, frame))
-			break;
-		if (quic_outq_delay_check(sk, outq->data_level, frame->nodelay))
-			break;
-		if (quic_packet_tail(sk, frame)) {
+	for (urgency = 0; urgency < QUIC_STREAM_URGENCY_LEVELS; urgency++) {
+		head = &outq->stream_list[urgency];
+		while (!list_empty(head)) {
+			stream = list_first_entry(head, struct quic_stream, list);
+			frame = list_first_entry(&stream->send.frame_list, struct quic_frame, list);
+			if (stream->send.incremental && frame->bytes > stream->send.deficit) {
+				/* Out of credit: earn this round's quantum and yield the turn. */
+				stream->send.deficit += stream->send.weight *
+							QUIC_STREAM_WEIGHT_QUANTUM;
+				list_move_tail(&stream->list, head);
+				continue;
+			}
+			if (quic_packet_config(sk, outq->data_level, frame->path))
+				return;
+			if (quic_outq_limit_check(sk, frame))
+				return;
+			if (quic_outq_delay_check(sk, outq->data_level, frame->nodelay))
+				return;
+			if (!quic_packet_tail(sk, frame)) {
+				outq->count += quic_packet_create_and_xmit(sk);
+				continue; /* Re-append this frame. */
+			}
 			outq->stream_list_len -= frame->len;
-			continue;
+			if (stream->send.incremental)
+				stream->send.deficit -= frame->bytes;
+			if (list_empty(&stream->send.frame_list)) {
+				/* Nothing left on this stream; an idle stream keeps no credit. */
+				stream->send.deficit = 0;
+				list_del_init(&stream->list);
+			}
 		}
-		outq->count += quic_packet_create_and_xmit(sk);
-		next = frame;
 	}
 }
 
+/* Schedules a stream for transmission if it is not already waiting to send. */
+static void quic_outq_stream_queue(struct sock *sk, struct quic_stream *stream)
+{
+	struct quic_outqueue *outq = quic_outq(sk);
+
+	if (list_empty(&stream->list))
+		list_add_tail(&stream->list, &outq->stream_list[stream->send.urgency]);
+}
+
+/* Updates the priority of a stream, moving it to the new urgency if it has frames queued.
+ * A zero weight leaves the current weight unchanged.
+ */
+void quic_outq_stream_prioritize(struct sock *sk, struct quic_stream *stream, u8 urgency,
+				 u8 incremental, u16 weight)
+{
+	struct quic_outqueue *outq = quic_outq(sk);
+
+	if (weight)
+		stream->send.weight = weight;
+	stream->send.incremental = incremental;
+	if (stream->send.urgency == urgency)
+		return;
+	stream->send.urgency = urgency;
+	if (!list_empty(&stream->list))
+		list_move_tail(&stream->list, &outq->stream_list[urgency]);
+}
+
 /* Transmits pending frames at a specific encryption level from transmitted_list. */
 static void quic_outq_transmit_old(struct sock *sk, u8 level)
 {
@@ -328,7 +394,7 @@ static void quic_outq_set_owner_w(int len, struct sock *sk)
 	sk_mem_charge(sk, len);
 }
 
-/* Appends data to an existing stream frame at the tail of the stream_list if possible. */
+/* Appends data to an existing stream frame at the tail of the stream's queue if possible. */
 int quic_outq_stream_append(struct sock *sk, struct quic_msginfo *info, bool pack)
 {
 	struct quic_stream_table *streams = quic_streams(sk);
@@ -338,14 +404,14 @@ int quic_outq_stream_append(struct sock *sk, struct quic_msginfo *info, bool pac
 	struct list_head *head;
 	int len, bytes;
 
-	head = &outq->stream_list;
+	head = &stream->send.frame_list;
 	if (list_empty(head))
 		return -ENOENT;
-	/* Append only if it's the same stream, the frame is the last of a sendmsg (i.e.,
-	 * !nodelay) and it hasn't been transmitted yet (number < 0).
+	/* Append only if the frame is the last of a sendmsg (i.e., !nodelay) and it hasn't been
+	 * transmitted yet (number < 0).
 	 */
 	frame = list_last_entry(head, struct quic_frame, list);
-	if (frame->stream != stream || frame->nodelay || frame->number >= 0)
+	if (frame->nodelay || frame->number >= 0)
 		return -EINVAL;
 
 	len = frame->len;
@@ -362,6 +428,7 @@ int quic_outq_stream_append(struct sock *sk, struct quic_msginfo *info, bool pac
 		if (streams->send.active_stream_id == stream->id)
 			streams->send.active_stream_id = -1;
 		stream->send.state = QUIC_STREAM_SEND_STATE_SENT;
+		trace_quic_stream_update(sk, stream, 1);
 	}
 
 	/* Update accounting. */
@@ -375,7 +442,7 @@ int quic_outq_stream_append(struct sock *sk, struct quic_msginfo *info, bool pac
 	return bytes;
 }
 
-/* Queues a stream frame at the tail of the stream list and optionally triggers transmission. */
+/* Queues a stream frame at the tail of its stream's queue and optionally triggers transmission. */
 void quic_outq_stream_tail(struct sock *sk, struct quic_frame *frame, bool cork)
 {
 	struct quic_stream_table *streams = quic_streams(sk);
@@ -391,8 +458,10 @@ void quic_outq_stream_tail(struct sock *sk, struct quic_frame *frame, bool cork)
 	 * frame containing the FIN bit is sent, the sending part of the stream enters the
 	 * "Data Sent" state.
 	 */
-	if (stream->send.state == QUIC_STREAM_SEND_STATE_READY)
+	if (stream->send.state == QUIC_STREAM_SEND_STATE_READY) {
 		stream->send.state = QUIC_STREAM_SEND_STATE_SEND;
+		trace_quic_stream_update(sk, stream, 1);
+	}
 
 	if (frame->type & QUIC_STREAM_BIT_FIN &&
 	    stream->send.state == QUIC_STREAM_SEND_STATE_SEND) {
@@ -400,6 +469,7 @@ void quic_outq_stream_tail(struct sock *sk, struct quic_frame *frame, bool cork)
 		if (streams->send.active_stream_id == stream->id)
 			streams->send.active_stream_id = -1;
 		stream->send.state = QUIC_STREAM_SEND_STATE_SENT;
+		trace_quic_stream_update(sk, stream, 1);
 	}
 
 	/* Update accounting. */
@@ -411,7 +481,8 @@ void quic_outq_stream_tail(struct sock *sk, struct quic_frame *frame, bool cork)
 	outq->unsent_bytes += frame->bytes;
 	quic_outq_set_owner_w((int)frame->bytes, sk);
 
-	list_add_tail(&frame->list, &outq->stream_list);
+	list_add_tail(&frame->list, &stream->send.frame_list);
+	quic_outq_stream_queue(sk, stream);
 	if (!cork) /* If not corked, trigger transmission immediately. */
 		quic_outq_transmit(sk);
 }
@@ -625,6 +696,7 @@ static void quic_outq_psent_sack_frames(struct sock *sk, struct quic_packet_sent
 		quic_frame_put(frame); /* Drop reference held in frame_array. */
 
 		acked += frame->bytes;
+		trace_quic_frame_ack(sk, frame);
 		/* Remove from send/transmitted list and drop reference held by it. */
 		quic_frame_ack(sk, frame);
 	}
@@ -652,6 +724,7 @@ static void quic_outq_path_confirm(struct sock *sk, u8 level, s64 largest, s64 s
 		return;
 
 	/* Get new path MTU and check if raise timer is needed. */
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_CONN_PLPMTUDS);
 	pathmtu = quic_path_pl_recv(paths, &raise_timer, &complete);
 	if (pathmtu)
 		quic_packet_mss_update(sk, pathmtu + quic_packet_taglen(quic_packet(sk)));
@@ -662,6 +735,71 @@ static void quic_outq_path_confirm(struct sock *sk, u8 level, s64 largest, s64 s
 				 (u64)paths->plpmtud_interval * QUIC_PMTUD_RAISE_TIMER_FACTOR);
 }
 
+#define QUIC_ACK_FREQ_MAX_THRESHOLD	10
+
+/* draft-ietf-quic-ack-frequency#section-10:
+ *
+ * Ask the peer to acknowledge about four times per RTT: the Ack-Eliciting Threshold is a
+ * quarter of the congestion window in packets, and Request Max Ack Delay a quarter of the
+ * smoothed RTT.  Both are re-evaluated on every ACK received, and
+ * a new ACK_FREQUENCY frame is sent at most once per RTT when they change.
+ */
+static void quic_outq_update_ack_freq(struct sock *sk)
+{
+	struct quic_outqueue *outq = quic_outq(sk);
+	struct quic_cong *cong = quic_cong(sk);
+	u32 threshold, delay;
+	u64 now;
+
+	if (!outq->min_ack_delay || !quic_is_established(sk) || !cong->mss)
+		return;
+
+	threshold = cong->window / cong->mss / 4;
+	threshold = clamp_t(u32, threshold, 1, QUIC_ACK_FREQ_MAX_THRESHOLD);
+	/* Round to milliseconds so that RTT jitter alone does not produce new frames.  Keep
+	 * it within max_ack_delay, which the PTO calculation already accounts for.
+	 */
+	delay = min_t(u32, roundup(cong->smoothed_rtt / 4, USEC_PER_MSEC), outq->max_ack_delay);
+	delay = max_t(u32, delay, outq->min_ack_delay);
+	if (threshold == outq->ack_freq_threshold && delay == outq->ack_freq_delay)
+		return;
+
+	now = quic_ktime_get_us();
+	if (outq->ack_freq_threshold && now < outq->ack_freq_time + cong->smoothed_rtt)
+		return;
+
+	outq->ack_freq_threshold = threshold;
+	outq->ack_freq_delay = delay;
+	/* A gap smaller than the packet threshold never declares a packet lost, so there is
+	 * no point in the peer reporting it immediately.
+	 */
+	outq->ack_freq_reorder = QUIC_KPACKET_THRESHOLD;
+	if (quic_outq_transmit_frame(sk, QUIC_FRAME_ACK_FREQUENCY, outq, 0, true)) {
+		outq->ack_freq_threshold = 0; /* Try again on the next ACK. */
+		return;
+	}
+	outq->ack_freq_seqno++;
+	outq->ack_freq_time = now;
+}
+
+/* A packet declared lost that the peer acknowledges afterwards was only delayed or reordered,
+ * and its retransmission was spurious (rfc9002#section-6.2.1 for the loss detection side).
+ * Only the last QUIC_OUTQ_LOST_HISTORY losses are remembered, which is enough to see when the
+ * reordering or time thresholds are too tight for a path.
+ */
+static void quic_outq_lost_sack(struct sock *sk, s64 largest, s64 smallest)
+{
+	struct quic_outqueue *outq = quic_outq(sk);
+	int i;
+
+	for (i = 0; i < QUIC_OUTQ_LOST_HISTORY; i++) {
+		if (outq->lost[i] < smallest || outq->lost[i] > largest)
+			continue;
+		QUIC_INC_STATS(sock_net(sk), QUIC_MIB_PKT_SPURIOUSLOSS);
+		outq->lost[i] = -1;
+	}
+}
+
 /* rfc9002#section-a.7: OnAckReceived()
  *
  * Process ACK reception for transmitted packets: This function identifies newly acknowledged
@@ -676,11 +814,20 @@ void quic_outq_transmitted_sack(struct sock *sk, u8 level, s64 largest, s64 smal
 	struct quic_outqueue *outq = quic_outq(sk);
 	struct quic_cong *cong = quic_cong(sk);
 	struct quic_packet_sent *sent, *next;
-	u32 acked = 0;
+	u32 acked = 0, window, ssthresh;
+	u8 state;
+
+	/* Saved to trace changes of the congestion state made by this ACK. */
+	window = cong->window;
+	ssthresh = cong->ssthresh;
+	state = cong->state;
 
 	quic_outq_path_confirm(sk, level, largest, smallest);
 	pr_debug("%s: largest: %llu, smallest: %llu\n", __func__, largest, smallest);
 
+	if (level == QUIC_CRYPTO_APP)
+		quic_outq_lost_sack(sk, largest, smallest);
+
 	/* Iterate backwards over sent packets to efficiently process newly ACKed packets. */
 	list_for_each_entry_safe_reverse(sent, next, &outq->packet_sent_list, list) {
 		if (level != sent->level)
@@ -698,7 +845,7 @@ void quic_outq_transmitted_sack(struct sock *sk, u8 level, s64 largest, s64 smal
 		 * eventually deemed lost, indicating that ECN validation has failed.
 		 */
 		if (sent->ecn)
-			quic_set_sk_ecn(sk, INET_ECN_ECT_0);
+			quic_set_sk_ecn(sk, sent->ecn);
 
 		outq->inflight -= sent->frame_len;
 		space->inflight -= sent->frame_len;
@@ -709,6 +856,7 @@ void quic_outq_transmitted_sack(struct sock *sk, u8 level, s64 largest, s64 smal
 			/* Update the RTT if the largest acknowledged is newly acked. */
 			quic_pnspace_set_max_pn_acked_seen(space, sent->number);
 			quic_cong_rtt_update(cong, sent->sent_time, ack_delay);
+			trace_quic_rtt_update(sk, cong, ack_delay);
 
 			/* These two members are calculated based on cong.pto. */
 			space->max_time_limit = cong->pto * 2;
@@ -725,6 +873,11 @@ void quic_outq_transmitted_sack(struct sock *sk, u8 level, s64 largest, s64 smal
 
 	/* Call cong.on_ack_recv() where it does pacing rate update. */
 	quic_cong_on_ack_recv(cong, acked, READ_ONCE(sk->sk_max_pacing_rate));
+	if (window != cong->window || ssthresh != cong->ssthresh || state != cong->state)
+		trace_quic_cong_update(sk, cong);
+
+	if (level == QUIC_CRYPTO_APP && acked)
+		quic_outq_update_ack_freq(sk);
 }
 
 /* rfc9002#section-a.8: GetLossTimeAndSpace()
@@ -852,22 +1005,36 @@ out:
 	quic_timer_reset(sk, QUIC_TIMER_LOSS, t);
 }
 
+#define QUIC_OUTQ_SNDBUF_FACTOR	2
+
 /* Syncs the congestion window with the socket send buffer size.  Called after congestion
  * control updates the window.
  */
 void quic_outq_sync_window(struct sock *sk, u32 window)
 {
 	struct quic_outqueue *outq = quic_outq(sk);
+	int sndbuf;
 
 	if (outq->window == window)
 		return;
 	outq->window = window;
 
+	/* Size sk_sndbuf from the largest window seen instead of the current one, so that a
+	 * loss does not take buffer space away from the application right when it is needed
+	 * to refill the pipe, similar to tcp_sndbuf_expand().
+	 */
+	if (window <= outq->max_window)
+		return;
+	outq->max_window = window;
+
 	if (sk->sk_userlocks & SOCK_SNDBUF_LOCK)
 		return;
 
-	/* Dynamically adjust sk_sndbuf based on the congestion window. */
-	sk->sk_sndbuf = (int)window * 2;
+	sndbuf = (int)min_t(u64, (u64)window * QUIC_OUTQ_SNDBUF_FACTOR,
+			    READ_ONCE(sysctl_quic_wmem[2]));
+	if (sndbuf <= sk->sk_sndbuf)
+		return;
+	WRITE_ONCE(sk->sk_sndbuf, sndbuf);
 	if (sk_stream_wspace(sk) > 0)
 		sk->sk_write_space(sk); /* Wake up processes blocked on sending. */
 }
@@ -881,7 +1048,8 @@ static void quic_outq_retransmit_frame(struct sock *sk, struct quic_frame *frame
 
 	head = &outq->control_list;
 	if (quic_frame_stream(frame->type)) {
-		head = &outq->stream_list;
+		head = &frame->stream->send.frame_list;
+		quic_outq_stream_queue(sk, frame->stream);
 
 		outq->stream_list_len += frame->len;
 	}
@@ -915,6 +1083,7 @@ number:
 		}
 	}
 	list_add_tail(&frame->list, head);
+	trace_quic_frame_retransmit(sk, frame);
 	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_FRM_RETRANS);
 }
 
@@ -961,6 +1130,14 @@ void quic_outq_retransmit_mark(struct sock *sk, u8 level, bool immediate)
 	struct quic_outqueue *outq = quic_outq(sk);
 	struct quic_cong *cong = quic_cong(sk);
 	struct quic_packet_sent *sent, *next;
+	struct net *net = sock_net(sk);
+	u32 window, ssthresh;
+	u8 state;
+
+	/* Saved to trace changes of the congestion state made by the losses. */
+	window = cong->window;
+	ssthresh = cong->ssthresh;
+	state = cong->state;
 
 	space->loss_time = 0;
 	cong->time = quic_ktime_get_us();
@@ -993,6 +1170,19 @@ void quic_outq_retransmit_mark(struct sock *sk, u8 level, bool immediate)
 
 		outq->inflight -= sent->frame_len;
 		space->inflight -= sent->frame_len;
+		trace_quic_packet_lost(sk, level, sent->number, sent->frame_len,
+				       (u32)(cong->time - sent->sent_time));
+		/* Packets dropped with their keys (immediate) are not losses on the wire. */
+		if (!immediate) {
+			if (sent->number + QUIC_KPACKET_THRESHOLD <= space->max_pn_acked_seen)
+				QUIC_INC_STATS(net, QUIC_MIB_PKT_LOSTTHRESHS);
+			else
+				QUIC_INC_STATS(net, QUIC_MIB_PKT_LOSTTIMES);
+			if (level == QUIC_CRYPTO_APP) {
+				outq->lost[outq->lost_next++] = sent->number;
+				outq->lost_next %= QUIC_OUTQ_LOST_HISTORY;
+			}
+		}
 		/* Move frames from the lost packet back to the send queue. */
 		quic_outq_psent_retransmit_frames(sk, sent);
 
@@ -1004,6 +1194,8 @@ void quic_outq_retransmit_mark(struct sock *sk, u8 level, bool immediate)
 		list_del(&sent->list);
 		kfree(sent);
 	}
+	if (window != cong->window || ssthresh != cong->ssthresh || state != cong->state)
+		trace_quic_cong_update(sk, cong);
 }
 
 /* Removes each frame from the list and queues it for retransmission.  Called when packet
@@ -1051,6 +1243,16 @@ void quic_outq_transmit_pto(struct sock *sk)
 
 	/* No loss detected, get PTO time and associated packet number space. */
 	quic_outq_get_pto_time(sk, &level);
+	trace_quic_pto_fire(sk, level, outq->pto_count, quic_cong(sk)->pto);
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_CONN_PTOS);
+
+	/* draft-ietf-quic-ack-frequency#section-9:
+	 *
+	 * A sender might use IMMEDIATE_ACK with a PTO probe, so that the peer does not delay
+	 * the acknowledgment it elicits.
+	 */
+	if (level == QUIC_CRYPTO_APP && outq->min_ack_delay && quic_is_established(sk))
+		quic_outq_transmit_frame(sk, QUIC_FRAME_IMMEDIATE_ACK, NULL, 0, true);
 
 	/* Attempt to send one ACK-eliciting probe packets for PTO. */
 	if (quic_outq_transmit_single(sk, level))
@@ -1208,6 +1410,7 @@ void quic_outq_set_param(struct sock *sk, struct quic_transport_param *p)
 	outq->grease_quic_bit = p->grease_quic_bit;
 	outq->stateless_reset = p->stateless_reset;
 	outq->max_ack_delay = p->max_ack_delay;
+	outq->min_ack_delay = p->min_ack_delay;
 	outq->max_data = p->max_data;
 
 	outq->max_bytes = outq->max_data;
@@ -1237,18 +1440,22 @@ void quic_outq_get_param(struct sock *sk, struct quic_transport_param *p)
 	p->grease_quic_bit = outq->grease_quic_bit;
 	p->stateless_reset = outq->stateless_reset;
 	p->max_ack_delay = outq->max_ack_delay;
+	p->min_ack_delay = outq->min_ack_delay;
 	p->max_data = outq->max_data;
 }
 
 void quic_outq_init(struct sock *sk)
 {
 	struct quic_outqueue *outq = quic_outq(sk);
+	u8 urgency;
 
-	INIT_LIST_HEAD(&outq->stream_list);
+	for (urgency = 0; urgency < QUIC_STREAM_URGENCY_LEVELS; urgency++)
+		INIT_LIST_HEAD(&outq->stream_list[urgency]);
 	INIT_LIST_HEAD(&outq->control_list);
 	INIT_LIST_HEAD(&outq->datagram_list);
 	INIT_LIST_HEAD(&outq->transmitted_list);
 	INIT_LIST_HEAD(&outq->packet_sent_list);
+	memset(outq->lost, 0xff, sizeof(outq->lost));
 }
 
 static void quic_outq_psent_list_purge(struct sock *sk, struct list_head *head)
@@ -1273,9 +1480,6 @@ void quic_outq_list_purge(struct sock *sk, struct list_head *head, struct quic_s
 		if (stream && frame->stream != stream)
 			continue;
 
-		if (head == &outq->stream_list)
-			outq->stream_list_len -= frame->len;
-
 		bytes += frame->bytes;
 		list_del_init(&frame->list);
 		quic_frame_put(frame);
@@ -1283,15 +1487,32 @@ void quic_outq_list_purge(struct sock *sk, struct list_head *head, struct quic_s
 	quic_outq_wfree(bytes, sk);
 }
 
+/* Purge the STREAM frames queued on a stream and take it off the send schedule. */
+void quic_outq_stream_purge(struct sock *sk, struct quic_stream *stream)
+{
+	struct quic_outqueue *outq = quic_outq(sk);
+	struct quic_frame *frame;
+
+	list_for_each_entry(frame, &stream->send.frame_list, list)
+		outq->stream_list_len -= frame->len;
+	quic_outq_list_purge(sk, &stream->send.frame_list, NULL);
+	list_del_init(&stream->list);
+}
+
 void quic_outq_free(struct sock *sk)
 {
 	struct quic_outqueue *outq = quic_outq(sk);
+	struct quic_stream *stream, *next;
+	u8 urgency;
 
 	quic_outq_psent_list_purge(sk, &outq->packet_sent_list);
 	quic_outq_list_purge(sk, &outq->transmitted_list, NULL);
 	quic_outq_list_purge(sk, &outq->datagram_list, NULL);
 	quic_outq_list_purge(sk, &outq->control_list, NULL);
-	quic_outq_list_purge(sk, &outq->stream_list, NULL);
+	for (urgency = 0; urgency < QUIC_STREAM_URGENCY_LEVELS; urgency++) {
+		list_for_each_entry_safe(stream, next, &outq->stream_list[urgency], list)
+			quic_outq_stream_purge(sk, stream);
+	}
 	__skb_queue_purge(&sk->sk_write_queue);
 	kfree(outq->close_phrase);
 }
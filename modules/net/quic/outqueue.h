@@ -13,10 +13,11 @@ struct quic_outqueue {
 	struct list_head transmitted_list;	/* Frames needing retransmission if lost */
 	struct list_head datagram_list;		/* DATAGRAM frames waiting to be sent */
 	struct list_head control_list;		/* ACK, PING, CONNECTION_CLOSE, etc. */
-	struct list_head stream_list;		/* STREAM frames queued for transmission */
+	/* Streams with STREAM frames queued for transmission, one list per urgency */
+	struct list_head stream_list[QUIC_STREAM_URGENCY_LEVELS];
 
 	/* Flow Control */
-	u64 last_max_bytes;		/* Maximum send bytes advertised by peer at last update */
+	u64 last_max_bytes;		/* Max send bytes advertised by peer at last update */
 	u64 max_bytes;			/* Current maximum bytes we are allowed to send to */
 	u64 bytes;			/* Bytes already sent to peer */
 
@@ -25,7 +26,7 @@ struct quic_outqueue {
 	 * when the corresponding crypto is ready for send.
 	 */
 	u8 data_level;
-	u8 pto_count;			/* PTO (Probe Timeout) count since last packet received */
+	u8 pto_count;			/* PTO count since last packet received */
 
 	u8 token_pending:1;		/* NEW_TOKEN sent, awaiting ACK */
 	u8 data_blocked:1;		/* Blocked by flow control (needs MAX_DATA) */
@@ -44,14 +45,32 @@ struct quic_outqueue {
 	u16 max_udp_payload_size;	/* Transport parameter in rfc9000#section-18.2 */
 	u32 max_idle_timeout;		/* Transport parameter in rfc9000#section-18.2 */
 	u32 max_ack_delay;		/* Transport parameter in rfc9000#section-18.2 */
+	/* Transport parameter in draft-ietf-quic-ack-frequency#section-3 */
+	u32 min_ack_delay;
 	u64 max_data;			/* Transport parameter in rfc9000#section-18.2 */
 
-	u32 stream_list_len;		/* Combined payload length in stream_list */
+	/* ACK Frequency requested from peer, in draft-ietf-quic-ack-frequency#section-4 */
+	u64 ack_freq_seqno;		/* Sequence Number of the next ACK_FREQUENCY frame */
+	u64 ack_freq_time;		/* Time the last ACK_FREQUENCY frame was sent (us) */
+	u32 ack_freq_threshold;		/* Ack-Eliciting Threshold, 0 if none sent yet */
+	u32 ack_freq_delay;		/* Request Max Ack Delay (us) */
+	u32 ack_freq_reorder;		/* Reordering Threshold */
+
+	u32 stream_list_len;		/* Combined payload length of queued STREAM frames */
 	u32 unsent_bytes;		/* Bytes queued but never transmitted */
 	u32 inflight;			/* Bytes from ack-eliciting frames in flight */
 	u32 window;			/* Congestion-controlled send window size */
+	u32 max_window;			/* Largest window seen, used to size sk_sndbuf */
+	u32 notsent_lowat;		/* Limit of unsent_bytes for writability, 0 if unset */
 	u16 count;			/* Packets sent in current transmit round */
 
+	/* Numbers of the last 1-RTT packets declared lost, to count the ones acknowledged later
+	 * as spurious losses; -1 marks a free slot.
+	 */
+#define QUIC_OUTQ_LOST_HISTORY	16
+	s64 lost[QUIC_OUTQ_LOST_HISTORY];
+	u8 lost_next;			/* Slot to record the next lost packet number */
+
 	/* Kernel consumers: nofity userspace handshake */
 	u8 receive_session_ticket;	/* Notify userspace to expect session ticket */
 	u8 certificate_request;		/* Notify userspace to request certificate */
@@ -89,6 +108,9 @@ void quic_outq_retransmit_list(struct sock *sk, struct list_head *head);
 void quic_outq_update_loss_timer(struct sock *sk);
 
 void quic_outq_list_purge(struct sock *sk, struct list_head *head, struct quic_stream *stream);
+void quic_outq_stream_purge(struct sock *sk, struct quic_stream *stream);
+void quic_outq_stream_prioritize(struct sock *sk, struct quic_stream *stream, u8 urgency,
+				 u8 incremental, u16 weight);
 void quic_outq_transmit_close(struct sock *sk, u8 frame, u32 errcode, u8 level);
 void quic_outq_transmit_app_close(struct sock *sk);
 void quic_outq_transmit_probe(struct sock *sk);
@@ -101,3 +123,4 @@ void quic_outq_free(struct sock *sk);
 
 int quic_outq_flow_control(struct sock *sk, struct quic_stream *stream, u16 bytes, bool sndblock);
 u64 quic_outq_wspace(struct sock *sk, struct quic_stream *stream);
+bool quic_outq_notsent_ok(struct sock *sk);
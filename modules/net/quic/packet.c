@@ -10,8 +10,12 @@
  *    Xin Long <lucien.xin@gmail.com>
  */
 
+#include <net/busy_poll.h>
+
 #include "socket.h"
 
+#include <trace/events/quic.h>
+
 #define QUIC_HLEN		1
 
 #define QUIC_LONG_HLEN(dcid, scid) \
@@ -521,6 +525,20 @@ static struct sock *quic_packet_get_listen_sock(struct sk_buff *skb)
 	return sk;
 }
 
+/* Return the DCID length self-described in the first octet of a QUIC-LB routable ID in a
+ * short header packet, or 0 if it is unroutable, the default length, or exceeds the packet.
+ */
+static u32 quic_packet_lb_conn_id_len(struct sk_buff *skb)
+{
+	u8 octet = *(skb->data + QUIC_HLEN);
+	u32 len = (octet & 0x1f) + 1;
+
+	if ((octet >> 5) > QUIC_CONN_ID_LB_CONFIG_MAX || len == QUIC_CONN_ID_DEF_LEN ||
+	    len > QUIC_CONN_ID_MAX_LEN || skb->len < QUIC_HLEN + len)
+		return 0;
+	return len;
+}
+
 /* Determine the QUIC socket associated with an incoming packet. */
 static struct sock *quic_packet_get_sock(struct sk_buff *skb)
 {
@@ -530,6 +548,7 @@ static struct sock *quic_packet_get_sock(struct sk_buff *skb)
 	union quic_addr daddr, saddr;
 	struct quic_data alpns = {};
 	struct sock *sk = NULL;
+	u32 len;
 	int err;
 
 	if (skb->len < QUIC_HLEN)
@@ -538,11 +557,16 @@ static struct sock *quic_packet_get_sock(struct sk_buff *skb)
 	if (!quic_hdr(skb)->form) { /* Short header path. */
 		if (skb->len < QUIC_HLEN + QUIC_CONN_ID_DEF_LEN)
 			return ERR_PTR(-EINVAL);
-		/* Fast path: look up QUIC connection by fixed-length DCID
-		 * (Currently, only source CIDs of size QUIC_CONN_ID_DEF_LEN are used).
+		/* Fast path: look up QUIC connection by DCID of the default length, or of
+		 * the length self-described in the first octet for QUIC-LB routable IDs.
 		 */
 		conn_id = quic_conn_id_lookup(net, skb->data + QUIC_HLEN,
 					      QUIC_CONN_ID_DEF_LEN);
+		if (!conn_id) {
+			len = quic_packet_lb_conn_id_len(skb);
+			if (len)
+				conn_id = quic_conn_id_lookup(net, skb->data + QUIC_HLEN, len);
+		}
 		if (conn_id) {
 			cb->seqno = quic_conn_id_number(conn_id);
 			return quic_conn_id_sk(conn_id); /* Return associated socket. */
@@ -594,6 +618,77 @@ static struct sock *quic_packet_get_sock(struct sk_buff *skb)
 	return sk;
 }
 
+#define QUIC_PACKET_STEER_MAX		1024
+
+/* Per-CPU queue of packets steered to the CPU that owns their connection. */
+struct quic_steer_queue {
+	struct sk_buff_head list;
+	struct work_struct work;	/* Work scheduled on the owning CPU to drain list */
+};
+
+static DEFINE_PER_CPU(struct quic_steer_queue, quic_steer_queues);
+
+static void quic_packet_steer_work(struct work_struct *work)
+{
+	struct quic_steer_queue *q = container_of(work, struct quic_steer_queue, work);
+	struct sk_buff *skb;
+
+	/* Run the receive path as if the packet had arrived on this CPU in softirq. */
+	local_bh_disable();
+	while ((skb = skb_dequeue(&q->list)) != NULL)
+		quic_packet_rcv(skb->sk, skb, false);
+	local_bh_enable();
+}
+
+/* RFS-like steering: redirect a 1-RTT packet to the CPU encoded in its CPU-affine DCID before
+ * the socket lookup, so that it is processed where the application runs, rather than
+ * contending on the socket lock with it.  Return true if the packet was queued.
+ */
+static bool quic_packet_steer(struct sk_buff *skb)
+{
+	struct quic_steer_queue *q;
+	int cpu;
+
+	if (quic_hdr(skb)->form)
+		return false;
+	cpu = quic_conn_id_cpu(skb->data + QUIC_HLEN, skb->len - QUIC_HLEN);
+	if (cpu < 0 || cpu == smp_processor_id() || cpu >= nr_cpu_ids || !cpu_online(cpu))
+		return false;
+
+	q = per_cpu_ptr(&quic_steer_queues, cpu);
+	spin_lock(&q->list.lock);
+	if (q->list.qlen >= QUIC_PACKET_STEER_MAX) { /* Process locally rather than drop. */
+		spin_unlock(&q->list.lock);
+		return false;
+	}
+	__skb_queue_tail(&q->list, skb);
+	spin_unlock(&q->list.lock);
+
+	queue_work_on(cpu, quic_wq, &q->work);
+	QUIC_INC_STATS(sock_net(skb->sk), QUIC_MIB_PKT_RCVSTEERED);
+	return true;
+}
+
+void quic_packet_steer_init(void)
+{
+	struct quic_steer_queue *q;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		q = per_cpu_ptr(&quic_steer_queues, cpu);
+		skb_queue_head_init(&q->list);
+		INIT_WORK(&q->work, quic_packet_steer_work);
+	}
+}
+
+void quic_packet_steer_exit(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		skb_queue_purge(&per_cpu_ptr(&quic_steer_queues, cpu)->list);
+}
+
 /* Entry point for processing received QUIC packets. */
 int quic_packet_rcv(struct sock *sk, struct sk_buff *skb, bool icmp)
 {
@@ -608,6 +703,8 @@ int quic_packet_rcv(struct sock *sk, struct sk_buff *skb, bool icmp)
 		err = -EINVAL;
 		goto err;
 	}
+	if (skb->len > QUIC_HLEN && quic_packet_steer(skb))
+		return 0;
 
 	/* Look up socket from socket or connection IDs hash tables. */
 	sk = quic_packet_get_sock(skb);
@@ -689,7 +786,8 @@ static int quic_packet_retry_create_and_xmit(struct sock *sk)
 	if (err)
 		return err;
 
-	quic_conn_id_generate(&conn_id); /* Generate new SCID for the Retry packet. */
+	/* Generate new SCID for the Retry packet. */
+	quic_conn_id_source_generate(quic_source(sk), &conn_id);
 	/* Compute total packet length: header + token + integrity tag. */
 	len = QUIC_LONG_HLEN(&packet->scid, &conn_id) + tlen + QUIC_TAG_LEN;
 	hlen = quic_encap_len(da) + MAX_HEADER;
@@ -726,6 +824,7 @@ static int quic_packet_retry_create_and_xmit(struct sock *sk)
 	quic_put_data(p, tag, QUIC_TAG_LEN);
 
 	/* Transmit the Retry packet. */
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_PKT_OUTRETRYS);
 	quic_lower_xmit(sk, skb, da, &fl);
 	return 0;
 }
@@ -798,6 +897,7 @@ static int quic_packet_version_create_and_xmit(struct sock *sk)
 		p = quic_put_int(p, quic_versions[i][0], QUIC_VERSION_LEN);
 
 	/* Transmit the Version Negotiation packet. */
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_PKT_OUTVERSIONS);
 	quic_lower_xmit(sk, skb, da, &fl);
 	return 0;
 }
@@ -863,6 +963,7 @@ static int quic_packet_stateless_reset_create_and_xmit(struct sock *sk)
 	quic_put_data(p, token, QUIC_CONN_ID_TOKEN_LEN);
 
 	/* Transmit the Stateless Reset packet. */
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_PKT_OUTRESETS);
 	quic_lower_xmit(sk, skb, da, &fl);
 	return 0;
 }
@@ -921,16 +1022,16 @@ static int quic_packet_listen_process(struct sock *sk, struct sk_buff *skb)
 		 * An endpoint MAY send a Stateless Reset in response to receiving a packet
 		 * that it cannot associate with an active connection.
 		 */
-		if (len < QUIC_HLEN + QUIC_CONN_ID_DEF_LEN) {
+		if (len < QUIC_HLEN + quic_conn_id_source_len(quic_source(sk))) {
 			QUIC_INC_STATS(net, QUIC_MIB_PKT_INVHDRDROP);
 			kfree_skb(skb);
 			return -EINVAL;
 		}
 		/* Read Destination address (packet->saddr) and Source address (packet->daddr). */
 		quic_get_msg_addrs(skb, &packet->saddr, &packet->daddr);
-		/* We currently only issue Connection ID with size QUIC_CONN_ID_DEF_LEN. */
+		/* Connection IDs are issued with the length configured on the listen socket. */
 		quic_conn_id_update(&packet->dcid, (u8 *)quic_hdr(skb) + QUIC_HLEN,
-				    QUIC_CONN_ID_DEF_LEN);
+				    quic_conn_id_source_len(quic_source(sk)));
 		/* Send a Stateless Reset for this 1-RTT packet. */
 		err = quic_packet_stateless_reset_create_and_xmit(sk);
 		consume_skb(skb);
@@ -1416,6 +1517,10 @@ static int quic_packet_handshake_process(struct sock *sk, struct sk_buff *skb)
 
 		pr_debug("%s: recvd, num: %llu, level: %d, len: %d\n",
 			 __func__, cb->number, packet->level, skb->len);
+		trace_quic_packet_recv(sk, packet->level, cb->number,
+				       cb->number_offset + cb->length, cb->path);
+		QUIC_INC_STATS(net, QUIC_MIB_PKT_INAPPS + packet->level);
+		QUIC_ADD_STATS(net, QUIC_MIB_PKT_INBYTES, cb->number_offset + cb->length);
 
 		/* Use packet arrival time as current time (may have been queued in backlog). */
 		space->time = cb->time;
@@ -1668,12 +1773,13 @@ static int quic_packet_app_process_done(struct sock *sk, struct sk_buff *skb)
 	if (!packet->ack_requested) /* If no ACK-eliciting frame, skip ACK generation. */
 		goto out;
 
-	if (!packet->ack_immediate) {
+	if (!packet->ack_immediate && !quic_inq_ack_immediate(sk)) {
 		/* Start ack delay timer to generate ACK frames on 1-RTT level then transmit all
-		 * pending ACKs.
+		 * pending ACKs.  The delay is max_ack_delay unless the peer requested another
+		 * one with an ACK_FREQUENCY frame.
 		 */
 		if (inq->sack_flag == QUIC_SACK_FLAG_NONE)
-			quic_timer_reset(sk, QUIC_TIMER_SACK, inq->max_ack_delay);
+			quic_timer_reset(sk, QUIC_TIMER_SACK, inq->ack_delay);
 		inq->sack_flag = QUIC_SACK_FLAG_APP;
 		goto out;
 	}
@@ -1713,6 +1819,7 @@ static int quic_packet_app_process(struct sock *sk, struct sk_buff *skb)
 	int err = -EINVAL;
 
 	sock_rps_save_rxhash(sk, skb);
+	sk_mark_napi_id(sk, skb); /* Record the NAPI ID for busy polling (SO_BUSY_POLL, epoll). */
 
 	quic_packet_reset(packet);  /* Reset packet state to prepare for new packet parsing. */
 	if (!quic_hdr(skb)->fixed && !quic_inq(sk)->grease_quic_bit) {
@@ -1745,7 +1852,7 @@ static int quic_packet_app_process(struct sock *sk, struct sk_buff *skb)
 		return 0;
 	}
 	/* Calculate Payload Length. */
-	cb->number_offset = QUIC_CONN_ID_DEF_LEN + QUIC_HLEN;
+	cb->number_offset = quic_conn_id_source_len(quic_source(sk)) + QUIC_HLEN;
 	cb->length = (u16)(skb->len - cb->number_offset);
 
 	/* Set highest received packet number for packet number decode during decryption. */
@@ -1782,6 +1889,8 @@ static int quic_packet_app_process(struct sock *sk, struct sk_buff *skb)
 			 * decryption failed, as the new key has been installed.
 			 */
 			key_phase = cb->key_phase;
+			trace_quic_key_update(sk, key_phase, 0);
+			QUIC_INC_STATS(net, QUIC_MIB_CONN_KEYUPDATES);
 			quic_inq_event_recv(sk, QUIC_EVENT_KEY_UPDATE, &key_phase,
 					    sizeof(key_phase));
 			goto err;
@@ -1792,6 +1901,8 @@ static int quic_packet_app_process(struct sock *sk, struct sk_buff *skb)
 	}
 	if (cb->key_update) { /* Notify application of the key update with new key phase. */
 		key_phase = cb->key_phase;
+		trace_quic_key_update(sk, key_phase, 0);
+		QUIC_INC_STATS(net, QUIC_MIB_CONN_KEYUPDATES);
 		quic_inq_event_recv(sk, QUIC_EVENT_KEY_UPDATE, &key_phase, sizeof(key_phase));
 	}
 	if (!cb->resume) /* No decryption (e.g., via disable_1rtt_encryption or async complete). */
@@ -1809,6 +1920,10 @@ static int quic_packet_app_process(struct sock *sk, struct sk_buff *skb)
 	}
 
 	pr_debug("%s: recvd, num: %llu, len: %d\n", __func__, cb->number, skb->len);
+	trace_quic_packet_recv(sk, QUIC_CRYPTO_APP, cb->number, cb->number_offset + cb->length,
+			       cb->path);
+	QUIC_INC_STATS(net, QUIC_MIB_PKT_INAPPS);
+	QUIC_ADD_STATS(net, QUIC_MIB_PKT_INBYTES, cb->number_offset + cb->length);
 
 	/* Use packet arrival time as current time (may have been queued in backlog). */
 	space->time = cb->time;
@@ -1943,6 +2058,15 @@ static u8 *quic_packet_pack_frames(struct sock *sk, struct sk_buff *skb,
 			p = quic_put_data(p, frag->data, frag->size);
 		pr_debug("%s: num: %llu, type: %u, packet_len: %u, frame_len: %u, level: %u\n",
 			 __func__, number, frame->type, skb->len, frame->len, packet->level);
+		if (quic_frame_sack(frame->type)) {
+			/* Count ACKs and clear the pending ACK state here, where they go on the
+			 * wire, not where they are built, so an ACK that is never sent still
+			 * leaves the packets it covers to be acknowledged.
+			 */
+			QUIC_INC_STATS(sock_net(sk), QUIC_MIB_FRM_OUTACKS);
+			if (packet->level == QUIC_CRYPTO_APP)
+				quic_inq_ack_sent(sk);
+		}
 		if (!frame->ack_eliciting || quic_frame_ping(frame->type)) {
 			/* Skip non-ACK-eliciting or ping frames for tracking. */
 			quic_frame_put(frame);
@@ -1957,6 +2081,10 @@ static u8 *quic_packet_pack_frames(struct sock *sk, struct sk_buff *skb,
 		/* Hold frame in sent packet record. */
 		sent->frame_array[i++] = quic_frame_get(frame);
 	}
+	trace_quic_packet_sent(sk, packet->level, number, skb->len + quic_packet_taglen(packet),
+			       packet->path);
+	QUIC_INC_STATS(sock_net(sk), QUIC_MIB_PKT_OUTAPPS + packet->level);
+	QUIC_ADD_STATS(sock_net(sk), QUIC_MIB_PKT_OUTBYTES, skb->len + quic_packet_taglen(packet));
 
 	/* Track bytes sent before address validation to respect amplification limits for server. */
 	if (quic_is_serv(sk) && !paths->validated)
@@ -1985,11 +2113,13 @@ static u8 *quic_packet_pack_frames(struct sock *sk, struct sk_buff *skb,
 	 *
 	 * The endpoint sets an ECT(0) codepoint in the IP header of early outgoing packets sent
 	 * on a new path to the peer.
+	 *
+	 * An L4S congestion controller probes with ECT(1) instead, see rfc9331#section-4.1.
 	 */
 	if (!packet->level && paths->ecn_probes < QUIC_MAX_ECN_PROBES) {
 		paths->ecn_probes++;
-		cb->ecn = INET_ECN_ECT_0;
-		sent->ecn = INET_ECN_ECT_0;
+		cb->ecn = quic_cong_ecn(quic_cong(sk));
+		sent->ecn = cb->ecn;
 	}
 	/* Fill metadata for this sent packet.
 	 * Convert CRYPTO level to PN space level since 0-RTT and 1-RTT share PN space.
@@ -138,4 +138,6 @@ u32 *quic_packet_compatible_versions(u32 version);
 
 int quic_packet_rcv(struct sock *sk, struct sk_buff *skb, bool icmp);
 void quic_packet_backlog_work(struct work_struct *work);
+void quic_packet_steer_init(void);
+void quic_packet_steer_exit(void);
 void quic_packet_rcv_err_pmtu(struct sock *sk);
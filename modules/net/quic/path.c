@@ -16,17 +16,25 @@
 
 #include "common.h"
 #include "family.h"
+#include "cong.h"
 #include "path.h"
+#include "protocol.h"
 
 extern int quic_packet_rcv(struct sock *sk, struct sk_buff *skb, bool icmp);
 
 static int quic_udp_rcv(struct sock *sk, struct sk_buff *skb)
 {
+	struct quic_udp_rsock *rs = rcu_dereference_sk_user_data(sk);
+
 	memset(skb->cb, 0, sizeof(skb->cb));
 	QUIC_SKB_CB(skb)->seqno = -1;
 	QUIC_SKB_CB(skb)->time = quic_ktime_get_us();
 
 	skb_pull(skb, sizeof(struct udphdr));
+	if (rs) {
+		this_cpu_inc(rs->stats->packets);
+		this_cpu_add(rs->stats->bytes, skb->len);
+	}
 	skb_dst_force(skb);
 	quic_packet_rcv(sk, skb, false);
 	return 0; /* .encap_rcv must return 0 if skb was either consumed or dropped. */
@@ -37,11 +45,21 @@ static int quic_udp_err(struct sock *sk, struct sk_buff *skb)
 	return quic_packet_rcv(sk, skb, true);
 }
 
+static void quic_udp_sock_free(struct quic_udp_sock *us)
+{
+	u8 i;
+
+	for (i = 0; i < us->count; i++)
+		free_percpu(us->socks[i].stats);
+	kfree(us);
+}
+
 static void quic_udp_sock_put_work(struct work_struct *work)
 {
 	struct quic_udp_sock *us = container_of(work, struct quic_udp_sock, work);
 	struct quic_uhash_head *head;
 	struct sock *sk = us->sk;
+	u8 i;
 
 	/* Hold the sock to safely access it in quic_udp_sock_lookup() even after
 	 * udp_tunnel_sock_release(). The release must occur before __hlist_del()
@@ -52,7 +70,8 @@ static void quic_udp_sock_put_work(struct work_struct *work)
 	 * some lockdep warnings.
 	 */
 	sock_hold(sk);
-	udp_tunnel_sock_release(sk->sk_socket);
+	for (i = 0; i < us->count; i++)
+		udp_tunnel_sock_release(us->socks[i].sk->sk_socket);
 
 	head = quic_udp_sock_head(sock_net(sk), ntohs(us->addr.v4.sin_port));
 	mutex_lock(&head->lock);
@@ -60,38 +79,105 @@ static void quic_udp_sock_put_work(struct work_struct *work)
 	mutex_unlock(&head->lock);
 
 	sock_put(sk);
-	kfree(us);
+	quic_udp_sock_free(us);
+}
+
+/* Create a UDP socket as udp_sock_create() does, but with SO_REUSEPORT set before binding, so
+ * that more UDP tunnel sockets can be bound to the same address and port.
+ */
+static int quic_udp_sock_create_reuseport(struct net *net, struct udp_port_cfg *conf,
+					  struct socket **sockp)
+{
+	union quic_addr a = {};
+	struct socket *sock;
+	int err, len;
+
+	err = sock_create_kern(net, conf->family, SOCK_DGRAM, 0, &sock);
+	if (err)
+		return err;
+
+	sock->sk->sk_reuseport = 1;
+	if (conf->family == AF_INET6) {
+		if (conf->ipv6_v6only)
+			ip6_sock_set_v6only(sock->sk);
+		udp_set_no_check6_tx(sock->sk, !conf->use_udp6_tx_checksums);
+		udp_set_no_check6_rx(sock->sk, !conf->use_udp6_rx_checksums);
+		a.v6.sin6_family = AF_INET6;
+		a.v6.sin6_addr = conf->local_ip6;
+		a.v6.sin6_port = conf->local_udp_port;
+		len = sizeof(a.v6);
+	} else {
+		sock->sk->sk_no_check_tx = !conf->use_udp_checksums;
+		a.v4.sin_family = AF_INET;
+		a.v4.sin_addr = conf->local_ip;
+		a.v4.sin_port = conf->local_udp_port;
+		len = sizeof(a.v4);
+	}
+
+	if (conf->bind_ifindex) {
+		err = sock_bindtoindex(sock->sk, conf->bind_ifindex, true);
+		if (err)
+			goto err;
+	}
+
+	/* kernel_bind() takes struct sockaddr_unsized * on newer kernels. */
+	err = kernel_bind(sock, (void *)&a, len);
+	if (err)
+		goto err;
+
+	*sockp = sock;
+	return 0;
+err:
+	kernel_sock_shutdown(sock, SHUT_RDWR);
+	sock_release(sock);
+	return err;
 }
 
 static struct quic_udp_sock *quic_udp_sock_create(struct sock *sk, union quic_addr *a)
 {
+	u8 i, count = (u8)clamp(READ_ONCE(sysctl_quic_udp_socks), 1, QUIC_UDP_SOCK_MAX);
 	struct udp_tunnel_sock_cfg tuncfg = {};
 	struct udp_port_cfg udp_conf = {};
 	struct net *net = sock_net(sk);
 	struct quic_uhash_head *head;
+	struct quic_udp_rsock *rs;
 	struct quic_udp_sock *us;
 	struct socket *sock;
 	int err;
 
-	us = kzalloc(sizeof(*us), GFP_KERNEL);
+	us = kzalloc(struct_size(us, socks, count), GFP_KERNEL);
 	if (!us)
 		return ERR_PTR(-ENOMEM);
 
 	quic_udp_conf_init(sk, &udp_conf, a);
-	err = udp_sock_create(net, &udp_conf, &sock);
-	if (err) {
-		pr_debug("%s: failed to create udp sock\n", __func__);
-		kfree(us);
-		return ERR_PTR(err);
-	}
-
 	tuncfg.encap_type = 1;
 	tuncfg.encap_rcv = quic_udp_rcv;
 	tuncfg.encap_err_lookup = quic_udp_err;
-	setup_udp_tunnel_sock(net, sock, &tuncfg);
+	for (i = 0; i < count; i++) {
+		rs = &us->socks[i];
+		rs->stats = alloc_percpu(struct quic_udp_stats);
+		if (!rs->stats) {
+			err = -ENOMEM;
+			goto err;
+		}
+		if (count > 1)
+			err = quic_udp_sock_create_reuseport(net, &udp_conf, &sock);
+		else
+			err = udp_sock_create(net, &udp_conf, &sock);
+		if (err) {
+			pr_debug("%s: failed to create udp sock %u\n", __func__, i);
+			free_percpu(rs->stats);
+			goto err;
+		}
+
+		tuncfg.sk_user_data = rs;
+		setup_udp_tunnel_sock(net, sock, &tuncfg);
+		rs->sk = sock->sk;
+		us->count++;
+	}
 
 	refcount_set(&us->refcnt, 1);
-	us->sk = sock->sk;
+	us->sk = us->socks[0].sk;
 	memcpy(&us->addr, a, sizeof(*a));
 	us->bind_ifindex = sk->sk_bound_dev_if;
 
@@ -100,6 +186,11 @@ static struct quic_udp_sock *quic_udp_sock_create(struct sock *sk, union quic_ad
 	INIT_WORK(&us->work, quic_udp_sock_put_work);
 
 	return us;
+err:
+	for (i = 0; i < us->count; i++)
+		udp_tunnel_sock_release(us->socks[i].sk->sk_socket);
+	quic_udp_sock_free(us);
+	return ERR_PTR(err);
 }
 
 static bool quic_udp_sock_get(struct quic_udp_sock *us)
@@ -235,30 +326,73 @@ int quic_path_bind(struct sock *sk, struct quic_path_group *paths, u8 path)
 	return -EADDRINUSE;
 }
 
+/* Sets up the RTT and congestion state of a newly promoted active path (path[0]).
+ *
+ * rfc9000#section-9.4: On confirming a peer's ownership of its new address, an endpoint MUST
+ * immediately reset the congestion controller and round-trip time estimator for the new path
+ * to initial values unless the only change in the peer's address is its port number.
+ *
+ * A port-only change is most likely a NAT rebinding onto the same network path, so the state
+ * of the old path is carried over.  If the connection returns to the peer address that the
+ * new path's retained state was measured against, that state is restored instead of starting
+ * from scratch.
+ */
+static void quic_path_cong_update(struct sock *sk, struct quic_path_group *paths)
+{
+	struct quic_path *new = &paths->path[0], *old = &paths->path[1];
+	union quic_addr a, b;
+
+	if (new->cong.ops && quic_cmp_sk_addr(sk, &new->cong_daddr, &new->daddr)) {
+		quic_cong_restore(&new->cong, &old->cong);
+		return;
+	}
+
+	new->cong = old->cong;
+	new->cong_daddr = new->daddr;
+
+	a = new->daddr;
+	b = old->daddr;
+	a.v4.sin_port = 0;
+	b.v4.sin_port = 0;
+	if (quic_cmp_sk_addr(sk, &a, &b))
+		return;
+	quic_cong_reset(&new->cong);
+}
+
 /* Swaps the active and alternate QUIC paths.
  *
  * Promotes the alternate path (path[1]) to become the new active path (path[0]).  If the
  * alternate path has a valid UDP socket, the entire path is swapped.  Otherwise, only the
- * destination address is exchanged, assuming the source address is the same and no rebind is
- * needed.
+ * destination address is exchanged, along with the RTT and congestion state that belongs to
+ * it, assuming the source address is the same and no rebind is needed.
  *
  * This is typically used during path migration or alternate path promotion.
  */
-void quic_path_swap(struct quic_path_group *paths)
+void quic_path_swap(struct sock *sk, struct quic_path_group *paths)
 {
-	struct quic_path path = paths->path[0];
+	struct quic_path path;
 
 	paths->alt_probes = 0;
 	paths->alt_state = QUIC_PATH_ALT_SWAPPED;
 
+	/* The state of the current active path was measured against its current peer. */
+	paths->path[0].cong_daddr = paths->path[0].daddr;
+	path = paths->path[0];
+
 	if (paths->path[1].udp_sk) {
 		paths->path[0] = paths->path[1];
 		paths->path[1] = path;
-		return;
+		goto out;
 	}
 
 	paths->path[0].daddr = paths->path[1].daddr;
+	paths->path[0].cong = paths->path[1].cong;
+	paths->path[0].cong_daddr = paths->path[1].cong_daddr;
 	paths->path[1].daddr = path.daddr;
+	paths->path[1].cong = path.cong;
+	paths->path[1].cong_daddr = path.cong_daddr;
+out:
+	quic_path_cong_update(sk, paths);
 }
 
 /* Frees resources associated with a QUIC path.
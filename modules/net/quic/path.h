@@ -43,13 +43,32 @@ enum {
 	QUIC_PATH_ALT_SWAPPED,	/* Alternate path is now active; roles swapped */
 };
 
+#define QUIC_UDP_SOCK_MAX	64
+
+struct quic_udp_stats {
+	u64 packets;
+	u64 bytes;
+};
+
+/* One of the UDP tunnel sockets sharing the address of a quic_udp_sock, set as its user data. */
+struct quic_udp_rsock {
+	struct sock *sk;
+	struct quic_udp_stats __percpu *stats;	/* Packets received on this UDP socket */
+};
+
 struct quic_udp_sock {
 	struct work_struct work;	/* Workqueue to destroy UDP tunnel socket */
 	struct hlist_node node;		/* Entry in address-based UDP socket hash table */
 	union quic_addr addr;		/* Source address of underlying UDP tunnel socket */
 	int bind_ifindex;
 	refcount_t refcnt;
-	struct sock *sk;		/* Underlying UDP tunnel socket */
+	struct sock *sk;		/* Underlying UDP tunnel socket, used for transmit */
+	/* With sysctl quic_udp_socks > 1, 'count' UDP tunnel sockets are bound to 'addr' in one
+	 * reuseport group, and the UDP stack selects one for each received packet by flow hash,
+	 * so that RX processing is spread over them.  'sk' is the first of them.
+	 */
+	u8 count;
+	struct quic_udp_rsock socks[];
 };
 
 struct quic_path {
@@ -60,6 +79,12 @@ struct quic_path {
 	/* Cached UDP tunnel socket and its source address for RCU-protected lookup/access */
 	union quic_addr uaddr;
 	struct sock *usk;
+
+	/* RTT and congestion state, and the peer address it was measured against.  It is kept
+	 * after the path is abandoned in case the connection migrates back to that address.
+	 */
+	struct quic_cong cong;
+	union quic_addr cong_daddr;
 };
 
 struct quic_path_group {
@@ -135,6 +160,19 @@ static inline struct sock *quic_path_usock(struct quic_path_group *paths, u8 pat
 	return paths->path[path].usk;
 }
 
+/* Check if a packet received on UDP tunnel socket 'usk' belongs to the path, i.e. 'usk' is the
+ * path's UDP tunnel socket or another one in its reuseport group.
+ */
+static inline bool quic_path_usock_match(struct quic_path_group *paths, u8 path, struct sock *usk)
+{
+	struct sock *sk = paths->path[path].usk;
+
+	if (sk == usk)
+		return true;
+	return sk && sk->sk_reuseport && rcu_access_pointer(sk->sk_reuseport_cb) &&
+	       rcu_access_pointer(sk->sk_reuseport_cb) == rcu_access_pointer(usk->sk_reuseport_cb);
+}
+
 static inline bool quic_path_alt_state(struct quic_path_group *paths, u8 state)
 {
 	return paths->alt_state == state;
@@ -158,7 +196,7 @@ bool quic_path_detect_alt(struct quic_path_group *paths, union quic_addr *sa,
 			  union quic_addr *da, struct sock *sk);
 int quic_path_bind(struct sock *sk, struct quic_path_group *paths, u8 path);
 void quic_path_unbind(struct sock *sk, struct quic_path_group *paths, u8 path);
-void quic_path_swap(struct quic_path_group *paths);
+void quic_path_swap(struct sock *sk, struct quic_path_group *paths);
 
 u32 quic_path_pl_recv(struct quic_path_group *paths, bool *raise_timer, bool *complete);
 u32 quic_path_pl_toobig(struct quic_path_group *paths, u32 pmtu, bool *reset_timer);
@@ -22,6 +22,9 @@
 
 #include "socket.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/quic.h>
+
 static unsigned int quic_net_id __read_mostly;
 
 struct quic_transport_param quic_default_param __read_mostly;
@@ -34,6 +37,9 @@ DEFINE_STATIC_KEY_FALSE(quic_alpn_demux_key);
 long sysctl_quic_mem[3];
 int sysctl_quic_rmem[3];
 int sysctl_quic_wmem[3];
+int sysctl_quic_udp_socks __read_mostly = 1;
+
+static int quic_udp_socks_max = QUIC_UDP_SOCK_MAX;
 
 #ifdef TLS_MIN_RECORD_SIZE_LIM
 static int quic_inet_connect(struct socket *sock, struct sockaddr_unsized *addr, int addr_len,
@@ -92,7 +98,7 @@ static int quic_inet_listen(struct socket *sock, int backlog)
 	err = quic_conn_id_add(dest, &conn_id, 0, NULL);
 	if (err)
 		goto free;
-	quic_conn_id_generate(&conn_id);
+	quic_conn_id_source_generate(source, &conn_id);
 	err = quic_conn_id_add(source, &conn_id, 0, sk);
 	if (err)
 		goto free;
@@ -159,14 +165,16 @@ static __poll_t quic_inet_poll(struct file *file, struct socket *sock, poll_tabl
 		return mask;
 	}
 
-	if (sk_stream_wspace(sk) > 0 && quic_outq_wspace(sk, NULL) > 0) { /* Writable check. */
+	if (sk_stream_wspace(sk) > 0 && quic_outq_wspace(sk, NULL) > 0 &&
+	    quic_outq_notsent_ok(sk)) { /* Writable check. */
 		mask |= EPOLLOUT | EPOLLWRNORM;
 	} else {
 		sk_set_bit(SOCKWQ_ASYNC_NOSPACE, sk);
 		/* Do writeable check again after the bit is set to avoid a lost I/O signal,
 		 * similar to sctp_poll().
 		 */
-		if (sk_stream_wspace(sk) > 0 && quic_outq_wspace(sk, NULL) > 0)
+		if (sk_stream_wspace(sk) > 0 && quic_outq_wspace(sk, NULL) > 0 &&
+		    quic_outq_notsent_ok(sk))
 			mask |= EPOLLOUT | EPOLLWRNORM;
 	}
 	return mask;
@@ -194,6 +202,15 @@ static struct ctl_table quic_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec,
 	},
+	{
+		.procname	= "quic_udp_socks",
+		.data		= &sysctl_quic_udp_socks,
+		.maxlen		= sizeof(sysctl_quic_udp_socks),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ONE,
+		.extra2		= &quic_udp_socks_max,
+	},
 #ifndef register_sysctl
 	{ /* sentinel */ }
 #endif
@@ -332,6 +349,73 @@ static void quic_eps_seq_stop(struct seq_file *seq, void *v)
 {
 }
 
+static int quic_udps_seq_show(struct seq_file *seq, void *v)
+{
+	struct net *net = seq_file_net(seq);
+	u32 hash = (u32)(*(loff_t *)v);
+	struct quic_uhash_head *head;
+	struct quic_udp_stats *stats;
+	struct quic_udp_sock *us;
+	u64 packets, bytes;
+	int cpu;
+	u8 i;
+
+	if (hash >= quic_udp_sock_hash_size())
+		return -EINVAL;
+
+	/* The mutex keeps 'us' and its stats from being freed, and its sk is held until it is
+	 * unhashed.  The UDP tunnel sockets in us->socks may already be released; only their
+	 * counters are read here.
+	 */
+	head = quic_udp_sock_head_at(hash);
+	mutex_lock(&head->lock);
+	hlist_for_each_entry(us, &head->head, node) {
+		if (net != sock_net(us->sk))
+			continue;
+
+		for (i = 0; i < us->count; i++) {
+			packets = 0;
+			bytes = 0;
+			for_each_possible_cpu(cpu) {
+				stats = per_cpu_ptr(us->socks[i].stats, cpu);
+				packets += READ_ONCE(stats->packets);
+				bytes += READ_ONCE(stats->bytes);
+			}
+			quic_seq_dump_addr(seq, &us->addr);
+			seq_printf(seq, "%d\t%d\t%u\t%llu\t%llu\n", us->bind_ifindex,
+				   refcount_read(&us->refcnt), i, packets, bytes);
+		}
+	}
+	mutex_unlock(&head->lock);
+	return 0;
+}
+
+static void *quic_udps_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	if (*pos >= quic_udp_sock_hash_size())
+		return NULL;
+
+	if (*pos < 0)
+		*pos = 0;
+
+	if (*pos == 0)
+		seq_printf(seq, "UDP_ADDRESS\tIFINDEX\tREFCNT\tINDEX\tRX_PACKETS\tRX_BYTES\n");
+
+	return (void *)pos;
+}
+
+static void *quic_udps_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	if (++*pos >= quic_udp_sock_hash_size())
+		return NULL;
+
+	return pos;
+}
+
+static void quic_udps_seq_stop(struct seq_file *seq, void *v)
+{
+}
+
 static const struct snmp_mib quic_snmp_list[] = {
 	SNMP_MIB_ITEM("QuicConnCurrentEstabs", QUIC_MIB_CONN_CURRENTESTABS),
 	SNMP_MIB_ITEM("QuicConnPassiveEstabs", QUIC_MIB_CONN_PASSIVEESTABS),
@@ -342,6 +426,7 @@ static const struct snmp_mib quic_snmp_list[] = {
 	SNMP_MIB_ITEM("QuicPktRcvBacklogs", QUIC_MIB_PKT_RCVBACKLOGS),
 	SNMP_MIB_ITEM("QuicPktDecBacklogs", QUIC_MIB_PKT_DECBACKLOGS),
 	SNMP_MIB_ITEM("QuicPktEncBacklogs", QUIC_MIB_PKT_ENCBACKLOGS),
+	SNMP_MIB_ITEM("QuicPktRcvSteered", QUIC_MIB_PKT_RCVSTEERED),
 	SNMP_MIB_ITEM("QuicPktInvHdrDrop", QUIC_MIB_PKT_INVHDRDROP),
 	SNMP_MIB_ITEM("QuicPktInvNumDrop", QUIC_MIB_PKT_INVNUMDROP),
 	SNMP_MIB_ITEM("QuicPktInvFrmDrop", QUIC_MIB_PKT_INVFRMDROP),
@@ -352,6 +437,32 @@ static const struct snmp_mib quic_snmp_list[] = {
 	SNMP_MIB_ITEM("QuicFrmRetrans", QUIC_MIB_FRM_RETRANS),
 	SNMP_MIB_ITEM("QuicFrmOutCloses", QUIC_MIB_FRM_OUTCLOSES),
 	SNMP_MIB_ITEM("QuicFrmInCloses", QUIC_MIB_FRM_INCLOSES),
+	SNMP_MIB_ITEM("QuicFrmOutAcks", QUIC_MIB_FRM_OUTACKS),
+	SNMP_MIB_ITEM("QuicFrmInAcks", QUIC_MIB_FRM_INACKS),
+	SNMP_MIB_ITEM("QuicFrmOutDataBlocks", QUIC_MIB_FRM_OUTDATABLOCKS),
+	SNMP_MIB_ITEM("QuicFrmInDataBlocks", QUIC_MIB_FRM_INDATABLOCKS),
+	SNMP_MIB_ITEM("QuicFrmOutStreamBlocks", QUIC_MIB_FRM_OUTSTREAMBLOCKS),
+	SNMP_MIB_ITEM("QuicFrmInStreamBlocks", QUIC_MIB_FRM_INSTREAMBLOCKS),
+	SNMP_MIB_ITEM("QuicPktOutApps", QUIC_MIB_PKT_OUTAPPS),
+	SNMP_MIB_ITEM("QuicPktOutInitials", QUIC_MIB_PKT_OUTINITIALS),
+	SNMP_MIB_ITEM("QuicPktOutHandshakes", QUIC_MIB_PKT_OUTHANDSHAKES),
+	SNMP_MIB_ITEM("QuicPktOutEarlys", QUIC_MIB_PKT_OUTEARLYS),
+	SNMP_MIB_ITEM("QuicPktInApps", QUIC_MIB_PKT_INAPPS),
+	SNMP_MIB_ITEM("QuicPktInInitials", QUIC_MIB_PKT_ININITIALS),
+	SNMP_MIB_ITEM("QuicPktInHandshakes", QUIC_MIB_PKT_INHANDSHAKES),
+	SNMP_MIB_ITEM("QuicPktInEarlys", QUIC_MIB_PKT_INEARLYS),
+	SNMP_MIB_ITEM("QuicPktOutBytes", QUIC_MIB_PKT_OUTBYTES),
+	SNMP_MIB_ITEM("QuicPktInBytes", QUIC_MIB_PKT_INBYTES),
+	SNMP_MIB_ITEM("QuicPktLostThreshs", QUIC_MIB_PKT_LOSTTHRESHS),
+	SNMP_MIB_ITEM("QuicPktLostTimes", QUIC_MIB_PKT_LOSTTIMES),
+	SNMP_MIB_ITEM("QuicPktSpuriousLoss", QUIC_MIB_PKT_SPURIOUSLOSS),
+	SNMP_MIB_ITEM("QuicPktOutRetrys", QUIC_MIB_PKT_OUTRETRYS),
+	SNMP_MIB_ITEM("QuicPktOutVersions", QUIC_MIB_PKT_OUTVERSIONS),
+	SNMP_MIB_ITEM("QuicPktOutResets", QUIC_MIB_PKT_OUTRESETS),
+	SNMP_MIB_ITEM("QuicConnPtos", QUIC_MIB_CONN_PTOS),
+	SNMP_MIB_ITEM("QuicConnKeyUpdates", QUIC_MIB_CONN_KEYUPDATES),
+	SNMP_MIB_ITEM("QuicConnMigrations", QUIC_MIB_CONN_MIGRATIONS),
+	SNMP_MIB_ITEM("QuicConnPlpmtuds", QUIC_MIB_CONN_PLPMTUDS),
 #ifndef snmp_get_cpu_field_batch_cnt
 	SNMP_MIB_SENTINEL
 #endif
@@ -398,6 +509,13 @@ static const struct seq_operations quic_eps_seq_ops = {
 	.stop		= quic_eps_seq_stop,
 };
 
+static const struct seq_operations quic_udps_seq_ops = {
+	.show		= quic_udps_seq_show,
+	.start		= quic_udps_seq_start,
+	.next		= quic_udps_seq_next,
+	.stop		= quic_udps_seq_stop,
+};
+
 static int quic_net_proc_init(struct net *net)
 {
 	quic_net(net)->proc_net = proc_net_mkdir(net, "quic", net->proc_net);
@@ -413,6 +531,9 @@ static int quic_net_proc_init(struct net *net)
 	if (!proc_create_net("eps", 0444, quic_net(net)->proc_net,
 			     &quic_eps_seq_ops, sizeof(struct seq_net_private)))
 		goto free;
+	if (!proc_create_net("udps", 0444, quic_net(net)->proc_net,
+			     &quic_udps_seq_ops, sizeof(struct seq_net_private)))
+		goto free;
 	return 0;
 free:
 	remove_proc_subtree("quic", net->proc_net);
@@ -662,6 +783,7 @@ static __init int quic_init(void)
 		err = -ENOMEM;
 		goto err_wq;
 	}
+	quic_packet_steer_init();
 
 	err = register_pernet_subsys(&quic_net_ops);
 	if (err)
@@ -700,6 +822,7 @@ static __exit void quic_exit(void)
 	unregister_pernet_subsys(&quic_net_ops);
 	flush_workqueue(quic_wq);
 	destroy_workqueue(quic_wq);
+	quic_packet_steer_exit();
 	quic_hash_tables_destroy();
 	percpu_counter_destroy(&quic_sockets_allocated);
 	kmem_cache_destroy(quic_frame_cachep);
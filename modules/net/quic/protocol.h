@@ -18,6 +18,7 @@ DECLARE_STATIC_KEY_FALSE(quic_alpn_demux_key);
 extern long sysctl_quic_mem[3];
 extern int sysctl_quic_rmem[3];
 extern int sysctl_quic_wmem[3];
+extern int sysctl_quic_udp_socks;
 
 enum {
 	QUIC_MIB_NUM = 0,
@@ -30,6 +31,7 @@ enum {
 	QUIC_MIB_PKT_RCVBACKLOGS,	/* Packets received via backlog processing */
 	QUIC_MIB_PKT_DECBACKLOGS,	/* Packets decrypted in backlog handler */
 	QUIC_MIB_PKT_ENCBACKLOGS,	/* Packets encrypted in backlog handler */
+	QUIC_MIB_PKT_RCVSTEERED,	/* Packets steered to the CPU owning their connection */
 	QUIC_MIB_PKT_INVHDRDROP,	/* Packets dropped due to invalid headers */
 	QUIC_MIB_PKT_INVNUMDROP,	/* Packets dropped due to invalid packet numbers */
 	QUIC_MIB_PKT_INVFRMDROP,	/* Packets dropped due to invalid frames */
@@ -40,6 +42,33 @@ enum {
 	QUIC_MIB_FRM_RETRANS,		/* Frames retransmitted */
 	QUIC_MIB_FRM_OUTCLOSES,		/* Frames of CONNECTION_CLOSE sent */
 	QUIC_MIB_FRM_INCLOSES,		/* Frames of CONNECTION_CLOSE received */
+	QUIC_MIB_FRM_OUTACKS,		/* Frames of ACK sent */
+	QUIC_MIB_FRM_INACKS,		/* Frames of ACK received */
+	QUIC_MIB_FRM_OUTDATABLOCKS,	/* Frames of DATA_BLOCKED sent */
+	QUIC_MIB_FRM_INDATABLOCKS,	/* Frames of DATA_BLOCKED received */
+	QUIC_MIB_FRM_OUTSTREAMBLOCKS,	/* Frames of STREAM_DATA_BLOCKED sent */
+	QUIC_MIB_FRM_INSTREAMBLOCKS,	/* Frames of STREAM_DATA_BLOCKED received */
+	/* Packets sent and received per crypto level, indexed by QUIC_MIB_PKT_OUTAPPS + level */
+	QUIC_MIB_PKT_OUTAPPS,		/* 1-RTT packets sent */
+	QUIC_MIB_PKT_OUTINITIALS,	/* Initial packets sent */
+	QUIC_MIB_PKT_OUTHANDSHAKES,	/* Handshake packets sent */
+	QUIC_MIB_PKT_OUTEARLYS,		/* 0-RTT packets sent */
+	QUIC_MIB_PKT_INAPPS,		/* 1-RTT packets received */
+	QUIC_MIB_PKT_ININITIALS,	/* Initial packets received */
+	QUIC_MIB_PKT_INHANDSHAKES,	/* Handshake packets received */
+	QUIC_MIB_PKT_INEARLYS,		/* 0-RTT packets received */
+	QUIC_MIB_PKT_OUTBYTES,		/* Bytes of QUIC packets sent */
+	QUIC_MIB_PKT_INBYTES,		/* Bytes of QUIC packets received */
+	QUIC_MIB_PKT_LOSTTHRESHS,	/* Packets declared lost by the packet threshold */
+	QUIC_MIB_PKT_LOSTTIMES,		/* Packets declared lost by the time threshold */
+	QUIC_MIB_PKT_SPURIOUSLOSS,	/* Packets declared lost but later acknowledged */
+	QUIC_MIB_PKT_OUTRETRYS,		/* Retry packets sent */
+	QUIC_MIB_PKT_OUTVERSIONS,	/* Version Negotiation packets sent */
+	QUIC_MIB_PKT_OUTRESETS,		/* Stateless Reset packets sent */
+	QUIC_MIB_CONN_PTOS,		/* Probe Timeouts fired */
+	QUIC_MIB_CONN_KEYUPDATES,	/* Key updates, initiated locally or by the peer */
+	QUIC_MIB_CONN_MIGRATIONS,	/* Connection migrations to a new path */
+	QUIC_MIB_CONN_PLPMTUDS,		/* PLPMTUD probes acknowledged by the peer */
 	QUIC_MIB_MAX
 };
 
@@ -63,3 +92,4 @@ struct quic_net *quic_net(struct net *net);
 
 #define QUIC_INC_STATS(net, field)	SNMP_INC_STATS(quic_net(net)->stat, field)
 #define QUIC_DEC_STATS(net, field)	SNMP_DEC_STATS(quic_net(net)->stat, field)
+#define QUIC_ADD_STATS(net, field, val)	SNMP_ADD_STATS(quic_net(net)->stat, field, val)
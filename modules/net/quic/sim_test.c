@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/* QUIC kernel implementation
+ * (C) Copyright Red Hat Corp. 2023
+ *
+ * This file is kernel test of the QUIC kernel implementation
+ *
+ * Loss recovery and congestion control simulator.  A sender is run against a virtual
+ * bottleneck link (bandwidth, round-trip delay, drop-tail buffer, random and burst loss) on
+ * a fake clock, driving quic_cong_on_packet_sent/acked/lost(), quic_cong_on_ack_recv() and
+ * quic_cong_rtt_update() the way outqueue.c does, with the loss detection of rfc9002#section-6.
+ * Runs are deterministic, so algorithms and changes to them can be compared without netem:
+ *
+ *   # insmod quic.ko && insmod quic_sim_test.ko
+ *   # dmesg | grep quic_sim:
+ *
+ * Every link in quic_sim_links is run with each congestion control algorithm, printing the
+ * throughput, queueing delay and losses of each tenth of the run, and then a summary.
+ *
+ * Written or modified by:
+ *    Xin Long <lucien.xin@gmail.com>
+ */
+
+#include <linux/prandom.h>
+#include <linux/vmalloc.h>
+#include <linux/module.h>
+#include <linux/quic.h>
+#include <kunit/test.h>
+
+#include "common.h"
+#include "cong.h"
+
+#define QUIC_SIM_MSS		1200
+#define QUIC_SIM_RING		8192		/* Packets tracked by the sender */
+#define QUIC_SIM_REPORTS	10		/* Reports printed over a run */
+/* Fake clock origin, as 0 is "unset" in cong.c */
+#define QUIC_SIM_START		USEC_PER_SEC
+#define QUIC_SIM_SEED		0x5155494355ULL
+#define QUIC_SIM_MAX_PTO_COUNT	8
+
+struct quic_sim_link {
+	const char *name;
+	u64 rate;		/* Bottleneck bandwidth, in bytes/sec */
+	u32 rtt;		/* Round-trip propagation delay, in usec */
+	u32 buffer;		/* Drop-tail queue at the bottleneck, in bytes */
+	u32 loss;		/* Random loss after the bottleneck, in packets per million */
+	u32 burst;		/* Packets dropped in a row by each random loss */
+	u32 duration;		/* Simulated time, in usec */
+};
+
+static const struct quic_sim_link quic_sim_links[] = {
+	{ "10mbit_40ms_bdp",	  1250000,  40000,   50000,     0, 0, 10 * USEC_PER_SEC },
+	{ "10mbit_40ms_loss1",	  1250000,  40000,   50000, 10000, 1, 10 * USEC_PER_SEC },
+	{ "20mbit_100ms_burst",	  2500000, 100000,  250000,  1000, 4, 10 * USEC_PER_SEC },
+	{ "50mbit_10ms_shallow",  6250000,  10000,   15625,     0, 0,  5 * USEC_PER_SEC },
+	{ "100mbit_20ms_deep",	 12500000,  20000, 1000000,     0, 0,  5 * USEC_PER_SEC },
+};
+
+static const char * const quic_sim_algos[QUIC_CONG_ALG_MAX] = {
+	[QUIC_CONG_ALG_RENO]	= "reno",
+	[QUIC_CONG_ALG_CUBIC]	= "cubic",
+	[QUIC_CONG_ALG_PRAGUE]	= "prague",
+};
+
+enum {
+	QUIC_SIM_PKT_SENT,
+	QUIC_SIM_PKT_ACKED,
+	QUIC_SIM_PKT_LOST,
+};
+
+struct quic_sim_pkt {
+	u64 sent_time;		/* Time it was sent */
+	u64 ack_time;		/* Time its ACK reaches the sender, 0 if dropped on the link */
+	u8 state;
+};
+
+struct quic_sim_stats {
+	u64 acked;		/* Bytes acknowledged */
+	u64 qdelay;		/* Queueing delay summed over the packets queued, in nsec */
+	u32 queued;		/* Packets accepted by the bottleneck queue */
+	u32 drops;		/* Packets dropped by the link: buffer overflow or random loss */
+	u32 lost;		/* Packets declared lost by the sender */
+	u32 spurious;		/* Packets declared lost whose ACK arrived afterwards */
+};
+
+struct quic_sim {
+	const struct quic_sim_link *link;
+	struct quic_sim_pkt *pkts;	/* Indexed by packet number modulo QUIC_SIM_RING */
+	struct quic_cong cong;
+	struct rnd_state rnd;
+
+	u64 now;		/* Fake clock, in usec */
+	u64 link_free;		/* Time the bottleneck drains its queue, in nsec */
+	u64 pace_time;		/* Earliest time pacing allows the next packet */
+	u64 loss_time;		/* rfc9002#section-6.1.2 time threshold timer, 0 if unset */
+	u64 last_sent;		/* Base of the PTO timer */
+	u64 largest_acked_time;
+	s64 largest_acked;
+	s64 next_pn;		/* Packet number of the next packet to send */
+	s64 next_ack;		/* Packet whose ACK arrives next */
+	s64 first;		/* Oldest packet neither acknowledged nor declared lost */
+	u32 inflight;
+	u32 burst_left;		/* Packets left to drop in the current loss burst */
+	u8 pto_count;
+
+	struct quic_sim_stats intv;	/* Current report interval */
+	struct quic_sim_stats total;	/* Whole run */
+};
+
+static struct quic_sim_pkt *quic_sim_pkt(struct quic_sim *sim, s64 number)
+{
+	return &sim->pkts[number % QUIC_SIM_RING];
+}
+
+static bool quic_sim_can_send(struct quic_sim *sim)
+{
+	/* Records are reused once neither loss detection nor ACK arrival needs them. */
+	if (sim->next_pn - min(sim->first, sim->next_ack) >= QUIC_SIM_RING)
+		return false;
+	return sim->inflight + QUIC_SIM_MSS <= sim->cong.window;
+}
+
+/* Send one packet through the bottleneck: queue it behind the bytes still being serialized,
+ * or drop it if the buffer is full, then apply the random loss of the link.
+ */
+static void quic_sim_send(struct quic_sim *sim)
+{
+	struct quic_sim_pkt *pkt = quic_sim_pkt(sim, sim->next_pn);
+	const struct quic_sim_link *link = sim->link;
+	u64 now = sim->now * NSEC_PER_USEC, start;
+	struct quic_cong *cong = &sim->cong;
+
+	pkt->sent_time = sim->now;
+	pkt->ack_time = 0;
+	pkt->state = QUIC_SIM_PKT_SENT;
+	sim->inflight += QUIC_SIM_MSS;
+	sim->last_sent = sim->now;
+
+	cong->time = sim->now;
+	quic_cong_on_packet_sent(cong, sim->now, QUIC_SIM_MSS, sim->next_pn++);
+	sim->pace_time = sim->now;
+	if (cong->pacing_rate)
+		sim->pace_time += div64_u64((u64)QUIC_SIM_MSS * USEC_PER_SEC, cong->pacing_rate);
+
+	start = max(now, sim->link_free);
+	if (div64_u64((start - now) * link->rate, NSEC_PER_SEC) + QUIC_SIM_MSS > link->buffer) {
+		sim->intv.drops++;
+		return;
+	}
+	sim->link_free = start + div64_u64((u64)QUIC_SIM_MSS * NSEC_PER_SEC, link->rate);
+	sim->intv.qdelay += start - now;
+	sim->intv.queued++;
+
+	if (sim->burst_left) {
+		sim->burst_left--;
+		sim->intv.drops++;
+		return;
+	}
+	if (link->loss && prandom_u32_state(&sim->rnd) % 1000000 < link->loss) {
+		sim->burst_left = link->burst ? link->burst - 1 : 0;
+		sim->intv.drops++;
+		return;
+	}
+	pkt->ack_time = div_u64(sim->link_free, NSEC_PER_USEC) + link->rtt;
+}
+
+/* rfc9002#section-a.10: DetectAndRemoveLostPackets(), as in quic_outq_retransmit_mark(). */
+static void quic_sim_detect_loss(struct quic_sim *sim)
+{
+	struct quic_cong *cong = &sim->cong;
+	struct quic_sim_pkt *pkt;
+	s64 number;
+
+	cong->time = sim->now;
+	sim->loss_time = 0;
+	for (number = sim->first; number < sim->largest_acked; number++) {
+		pkt = quic_sim_pkt(sim, number);
+		if (pkt->state != QUIC_SIM_PKT_SENT)
+			continue;
+		if (pkt->sent_time + cong->loss_delay > sim->now &&
+		    number + QUIC_KPACKET_THRESHOLD > sim->largest_acked) {
+			sim->loss_time = pkt->sent_time + cong->loss_delay;
+			break;
+		}
+		pkt->state = QUIC_SIM_PKT_LOST;
+		sim->inflight -= QUIC_SIM_MSS;
+		sim->intv.lost++;
+		quic_cong_on_packet_lost(cong, sim->largest_acked_time, QUIC_SIM_MSS, number);
+	}
+	while (sim->first < sim->next_pn &&
+	       quic_sim_pkt(sim, sim->first)->state != QUIC_SIM_PKT_SENT)
+		sim->first++;
+}
+
+/* One ACK per packet delivered, with no ACK delay and no loss on the return path, processed
+ * like quic_outq_transmitted_sack() followed by loss detection.
+ */
+static void quic_sim_ack(struct quic_sim *sim, s64 number)
+{
+	struct quic_sim_pkt *pkt = quic_sim_pkt(sim, number);
+	struct quic_cong *cong = &sim->cong;
+
+	sim->pto_count = 0;
+	if (pkt->state != QUIC_SIM_PKT_SENT) {
+		sim->intv.spurious++;
+		return;
+	}
+	pkt->state = QUIC_SIM_PKT_ACKED;
+	sim->inflight -= QUIC_SIM_MSS;
+	sim->intv.acked += QUIC_SIM_MSS;
+
+	cong->time = sim->now;
+	if (number > sim->largest_acked) {
+		sim->largest_acked = number;
+		sim->largest_acked_time = sim->now;
+		quic_cong_rtt_update(cong, pkt->sent_time, 0);
+	}
+	quic_cong_on_packet_acked(cong, pkt->sent_time, QUIC_SIM_MSS, number);
+	quic_cong_on_ack_recv(cong, QUIC_SIM_MSS, ~0ULL);
+
+	quic_sim_detect_loss(sim);
+}
+
+static void quic_sim_add(struct quic_sim_stats *to, struct quic_sim_stats *from)
+{
+	to->acked += from->acked;
+	to->qdelay += from->qdelay;
+	to->queued += from->queued;
+	to->drops += from->drops;
+	to->lost += from->lost;
+	to->spurious += from->spurious;
+}
+
+static void quic_sim_print(struct kunit *test, struct quic_sim *sim, const char *when,
+			   struct quic_sim_stats *s, u32 interval)
+{
+	u64 thr = div_u64(s->acked * 800, interval); /* Mbit/s in hundredths */
+	u64 qdelay = s->queued ? div64_u64(s->qdelay, (u64)s->queued * NSEC_PER_USEC) : 0;
+
+	kunit_info(test, "quic_sim: %-20s %-6s %-7s thr=%4llu.%02llu Mbit/s qdelay=%6llu us "
+		   "drops=%5u lost=%5u spurious=%4u cwnd=%8u srtt=%7u\n",
+		   sim->link->name, quic_sim_algos[sim->cong.algo], when, thr / 100, thr % 100,
+		   qdelay, s->drops, s->lost, s->spurious, sim->cong.window,
+		   sim->cong.smoothed_rtt);
+}
+
+static void quic_sim_report(struct kunit *test, struct quic_sim *sim, u32 interval)
+{
+	char when[16];
+
+	snprintf(when, sizeof(when), "%llums", div_u64(sim->now - QUIC_SIM_START, USEC_PER_MSEC));
+	quic_sim_print(test, sim, when, &sim->intv, interval);
+	quic_sim_add(&sim->total, &sim->intv);
+	memset(&sim->intv, 0, sizeof(sim->intv));
+}
+
+static void quic_sim_init(struct quic_sim *sim, const struct quic_sim_link *link, u8 algo)
+{
+	struct quic_sim_pkt *pkts = sim->pkts;
+
+	memset(sim, 0, sizeof(*sim));
+	memset(pkts, 0, sizeof(*pkts) * QUIC_SIM_RING);
+	sim->pkts = pkts;
+	sim->link = link;
+	prandom_seed_state(&sim->rnd, QUIC_SIM_SEED);
+
+	/* Same setup as a new connection: quic_init_sock() and then the path MSS. */
+	quic_cong_init(&sim->cong);
+	quic_cong_set_algo(&sim->cong, algo);
+	quic_cong_set_mss(&sim->cong, QUIC_SIM_MSS);
+
+	sim->now = QUIC_SIM_START;
+	sim->pace_time = sim->now;
+	sim->largest_acked = -1;
+}
+
+/* Advance the fake clock from event to event: ACK arrivals, the loss detection timer (time
+ * threshold or PTO), pacing releases while the window is open, and the periodic reports.
+ */
+static void quic_sim_run(struct kunit *test, struct quic_sim *sim)
+{
+	u32 interval = sim->link->duration / QUIC_SIM_REPORTS;
+	u64 end = QUIC_SIM_START + sim->link->duration;
+	u64 next, report = QUIC_SIM_START + interval;
+	struct quic_cong *cong = &sim->cong;
+	u64 ack_time, pto_time;
+
+	while (report <= end) {
+		while (sim->next_ack < sim->next_pn && !quic_sim_pkt(sim, sim->next_ack)->ack_time)
+			sim->next_ack++;
+		ack_time = 0;
+		if (sim->next_ack < sim->next_pn)
+			ack_time = quic_sim_pkt(sim, sim->next_ack)->ack_time;
+		pto_time = 0;
+		if (!sim->loss_time && sim->inflight)
+			pto_time = sim->last_sent + ((u64)cong->pto << sim->pto_count);
+
+		next = report;
+		if (ack_time)
+			next = min(next, ack_time);
+		if (sim->loss_time)
+			next = min(next, sim->loss_time);
+		if (pto_time)
+			next = min(next, pto_time);
+		if (quic_sim_can_send(sim))
+			next = min(next, sim->pace_time);
+		sim->now = max(sim->now, next);
+
+		if (ack_time && ack_time <= sim->now) {
+			quic_sim_ack(sim, sim->next_ack++);
+		} else if (sim->loss_time && sim->loss_time <= sim->now) {
+			quic_sim_detect_loss(sim);
+		} else if (pto_time && pto_time <= sim->now) {
+			/* rfc9002#section-6.2.4: send a probe regardless of the window. */
+			if (sim->pto_count < QUIC_SIM_MAX_PTO_COUNT)
+				sim->pto_count++;
+			if (sim->next_pn - min(sim->first, sim->next_ack) < QUIC_SIM_RING)
+				quic_sim_send(sim);
+			else
+				sim->last_sent = sim->now;
+		} else if (quic_sim_can_send(sim) && sim->pace_time <= sim->now) {
+			quic_sim_send(sim);
+		} else if (report <= sim->now) {
+			quic_sim_report(test, sim, interval);
+			report += interval;
+		}
+	}
+}
+
+static void quic_sim_link_desc(const struct quic_sim_link *link, char *desc)
+{
+	strscpy(desc, link->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(quic_sim_link, quic_sim_links, quic_sim_link_desc);
+
+static void quic_sim_test(struct kunit *test)
+{
+	const struct quic_sim_link *link = test->param_value;
+	u64 capacity = div_u64(link->rate * link->duration, USEC_PER_SEC);
+	struct quic_sim *sim;
+	u8 algo;
+
+	sim = kunit_kzalloc(test, sizeof(*sim), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, sim);
+	sim->pkts = vzalloc(sizeof(*sim->pkts) * QUIC_SIM_RING);
+	KUNIT_ASSERT_NOT_NULL(test, sim->pkts);
+
+	for (algo = 0; algo < QUIC_CONG_ALG_MAX; algo++) {
+		quic_sim_init(sim, link, algo);
+		quic_sim_run(test, sim);
+		quic_sim_print(test, sim, "total", &sim->total, link->duration);
+
+		/* Loose bounds only: catch a controller that stalls or collapses its window. */
+		KUNIT_EXPECT_GT(test, sim->total.acked * 10, capacity);
+		KUNIT_EXPECT_GE(test, sim->cong.window, sim->cong.min_window);
+	}
+
+	vfree(sim->pkts);
+}
+
+static struct kunit_case quic_sim_cases[] = {
+	KUNIT_CASE_PARAM(quic_sim_test, quic_sim_link_gen_params),
+	{}
+};
+
+static struct kunit_suite quic_sim_suite = {
+	.name = "quic_sim",
+	.test_cases = quic_sim_cases,
+};
+
+kunit_test_suite(quic_sim_suite);
+
+MODULE_DESCRIPTION("Simulate QUIC loss recovery and congestion control");
+MODULE_LICENSE("GPL");
@@ -14,9 +14,12 @@
 #include <linux/version.h>
 #include <asm/ioctls.h>
 #include <net/tls.h>
+#include <net/busy_poll.h>
 
 #include "socket.h"
 
+#include <trace/events/quic.h>
+
 static DEFINE_PER_CPU(int, quic_memory_per_cpu_fw_alloc);
 static unsigned long quic_memory_pressure;
 static atomic_long_t quic_memory_allocated;
@@ -64,12 +67,14 @@ struct quic_request_sock *quic_request_sock_create(struct sock *sk, struct quic_
 	req->dcid = packet->dcid;
 	req->orig_dcid = *odcid;
 	req->retry = retry;
+	req->time = quic_ktime_get_us();
 
 	skb_queue_head_init(&req->backlog_list);
 
 	/* Enqueue request into the listen socket’s pending list for accept(). */
 	list_add_tail(&req->list, quic_reqs(sk));
 	sk_acceptq_added(sk);
+	trace_quic_conn_request(sk, req);
 	return req;
 }
 
@@ -174,7 +179,7 @@ begin:
 		paths = quic_paths(tmp);
 		if (quic_cmp_sk_addr(tmp, quic_path_saddr(paths, 0), sa) &&
 		    quic_cmp_sk_addr(tmp, quic_path_daddr(paths, 0), da) &&
-		    quic_path_usock(paths, 0) == usk &&
+		    quic_path_usock_match(paths, 0, usk) &&
 		    (!dcid || !quic_conn_id_cmp(quic_path_orig_dcid(paths), dcid))) {
 			sk = tmp;
 			break;
@@ -197,7 +202,8 @@ begin:
  * This function searches the QUIC socket table for a listening socket that matches the dest
  * address and port, and the ALPN(s) if presented in the ClientHello.  If multiple listening
  * sockets are bound to the same address, port, and ALPN(s) (e.g., via SO_REUSEPORT), this
- * function selects a socket from the reuseport group.
+ * function selects a socket from the reuseport group, by the attached BPF program if any,
+ * or else by the peer address hash.
  *
  * Return: A pointer to the matching listening socket, or NULL if no match is found.
  */
@@ -226,7 +232,7 @@ begin:
 			 */
 			a = quic_path_saddr(quic_paths(tmp), 0);
 			if (net == sock_net(tmp) && quic_cmp_sk_addr(tmp, a, sa) &&
-			    quic_path_usock(quic_paths(tmp), 0) == skb->sk &&
+			    quic_path_usock_match(quic_paths(tmp), 0, skb->sk) &&
 			    (!alpns->data || !quic_alpn(tmp)->len)) {
 				sk = tmp;
 				if (!quic_is_any_addr(a)) /* Prefer specific address match. */
@@ -243,7 +249,7 @@ begin:
 		sk_nulls_for_each_rcu(tmp, node, &head->head) {
 			a = quic_path_saddr(quic_paths(tmp), 0);
 			if (net == sock_net(tmp) && quic_cmp_sk_addr(tmp, a, sa) &&
-			    quic_path_usock(quic_paths(tmp), 0) == skb->sk &&
+			    quic_path_usock_match(quic_paths(tmp), 0, skb->sk) &&
 			    quic_data_has(quic_alpn(tmp), &alpn)) {
 				sk = tmp;
 				if (!quic_is_any_addr(a))
@@ -260,8 +266,14 @@ out:
 	if (!sk && get_nulls_value(node) != hash)
 		goto begin;
 
+	/* skb->data points to the QUIC header (the UDP header is already pulled), so pass a
+	 * zero hdr_len to let SO_ATTACH_REUSEPORT_CBPF/EBPF programs read it from offset 0:
+	 * header form, version, DCID length and DCID.  The ALPN is not visible there, as it
+	 * is in the encrypted ClientHello; instead, it already selected this reuseport group,
+	 * as only listeners with the same ALPNs are grouped, each with its own program.
+	 */
 	if (sk && sk->sk_reuseport)
-		sk = reuseport_select_sock(sk, quic_addr_hash(net, da), skb, 1);
+		sk = reuseport_select_sock(sk, quic_addr_hash(net, da), skb, 0);
 
 	if (sk && unlikely(!refcount_inc_not_zero(&sk->sk_refcnt)))
 		sk = NULL;
@@ -418,6 +430,7 @@ static void quic_destroy_sock(struct sock *sk)
 
 	quic_conn_id_set_free(quic_source(sk));
 	quic_conn_id_set_free(quic_dest(sk));
+	quic_conn_id_lb_free(quic_source(sk));
 
 	quic_stream_free(quic_streams(sk));
 
@@ -460,6 +473,18 @@ out:
 	return err;
 }
 
+/* Pick the CPU encoded into CPU-affine source connection IDs: the one set via
+ * SO_INCOMING_CPU, or else the one running connect() or accept().
+ */
+static void quic_sock_set_conn_id_cpu(struct sock *sk)
+{
+	struct quic_conn_id_set *source = quic_source(sk);
+	int cpu = READ_ONCE(sk->sk_incoming_cpu);
+
+	if (source->cpu_affine)
+		source->cpu = cpu >= 0 ? cpu : raw_smp_processor_id();
+}
+
 #ifdef TLS_MIN_RECORD_SIZE_LIM
 static int quic_connect(struct sock *sk, struct sockaddr_unsized *addr, int addr_len)
 #else
@@ -501,7 +526,8 @@ static int quic_connect(struct sock *sk, struct sockaddr *addr, int addr_len)
 		goto out;
 	/* Save original DCID for validating server's transport parameters. */
 	paths->orig_dcid = conn_id;
-	quic_conn_id_generate(&conn_id);
+	quic_sock_set_conn_id_cpu(sk);
+	quic_conn_id_source_generate(source, &conn_id);
 	err = quic_conn_id_add(source, &conn_id, 0, sk);
 	if (err)
 		goto free;
@@ -870,7 +896,8 @@ static bool quic_sock_stream_writable(struct sock *sk, struct quic_stream *strea
 	/* Check socket send buffer space and memory scheduling capacity. */
 	if (sk_stream_wspace(sk) < len || !sk_wmem_schedule(sk, len))
 		return false;
-	return true;
+	/* Check unsent data against the limit set by QUIC_SOCKOPT_NOTSENT_LOWAT. */
+	return quic_outq_notsent_ok(sk);
 }
 
 /* Wait until a QUIC stream is writable for sending data. */
@@ -1051,7 +1078,10 @@ static int quic_sendmsg(struct sock *sk, struct msghdr *msg, size_t msg_len)
 
 	do {
 		if (!quic_sock_stream_writable(sk, stream, flags, len)) {
-			if (delay) {
+			/* Push data corked by MSG_MORE in this or an earlier call, as the wait
+			 * may be for it to be sent below the notsent lowat.
+			 */
+			if (outq->force_delay) {
 				outq->force_delay = 0;
 				quic_outq_transmit(sk);
 			}
@@ -1104,6 +1134,31 @@ err:
 	return err;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* Ends the busy loop once data is on recv_list or the busy poll time is up. */
+static bool quic_busy_loop_end(void *p, unsigned long start_time)
+{
+	struct sock *sk = p;
+
+	return !list_empty(&quic_inq(sk)->recv_list) || sk_busy_loop_timeout(sk, start_time);
+}
+#endif
+
+/* Same as sk_busy_loop(), but ends once data is queued on recv_list, as QUIC does not use
+ * sk_receive_queue that sk_busy_loop_end() checks.
+ */
+static void quic_busy_loop(struct sock *sk, int nonblock)
+{
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int napi_id = READ_ONCE(sk->sk_napi_id);
+
+	if (napi_id >= MIN_NAPI_ID)
+		napi_busy_loop(napi_id, nonblock ? NULL : quic_busy_loop_end, sk,
+			       READ_ONCE(sk->sk_prefer_busy_poll),
+			       READ_ONCE(sk->sk_busy_poll_budget) ?: BUSY_POLL_BUDGET);
+#endif
+}
+
 /* Wait for an incoming QUIC packet. */
 static int quic_wait_for_packet(struct sock *sk, struct list_head *head, u32 flags)
 {
@@ -1111,6 +1166,15 @@ static int quic_wait_for_packet(struct sock *sk, struct list_head *head, u32 fla
 	DEFINE_WAIT(wait);
 	int err = 0;
 
+	if (list_empty(head) && sk_can_busy_loop(sk) && !quic_is_closed(sk)) {
+		/* Busy poll with the socket released, so that packets polled from the device
+		 * are processed directly into recv_list instead of being left on the backlog.
+		 */
+		release_sock(sk);
+		quic_busy_loop(sk, !timeo);
+		lock_sock(sk);
+	}
+
 	for (;;) {
 		if (!list_empty(head))
 			break;
@@ -1221,6 +1285,7 @@ static int quic_recvmsg(struct sock *sk, struct msghdr *msg, size_t msg_len, int
 			 * state, which is a terminal state.
 			 */
 			stream->recv.state = QUIC_STREAM_RECV_STATE_READ;
+			trace_quic_stream_update(sk, stream, 0);
 			sinfo.stream_flags |= MSG_QUIC_STREAM_FIN;
 			break;
 		}
@@ -1300,6 +1365,7 @@ static void quic_sock_fetch_config(struct sock *sk, struct quic_config *config)
 {
 	struct quic_path_group *paths = quic_paths(sk);
 	struct quic_outqueue *outq = quic_outq(sk);
+	struct quic_inqueue *inq = quic_inq(sk);
 	struct quic_cong *cong = quic_cong(sk);
 
 	config->receive_session_ticket = outq->receive_session_ticket;
@@ -1309,6 +1375,9 @@ static void quic_sock_fetch_config(struct sock *sk, struct quic_config *config)
 	config->payload_cipher_type = outq->payload_cipher_type;
 	config->version = outq->version;
 
+	config->ack_eliciting_threshold = inq->ack_eliciting_threshold;
+	config->ack_reordering_threshold = inq->ack_reordering_threshold;
+
 	config->initial_smoothed_rtt = cong->initial_srtt;
 	config->congestion_control_algo = cong->algo;
 
@@ -1320,6 +1389,7 @@ static int quic_sock_apply_config(struct sock *sk, struct quic_config *config)
 {
 	struct quic_path_group *paths = quic_paths(sk);
 	struct quic_outqueue *outq = quic_outq(sk);
+	struct quic_inqueue *inq = quic_inq(sk);
 	struct quic_cong *cong = quic_cong(sk);
 
 	if (config->receive_session_ticket)
@@ -1341,6 +1411,16 @@ static int quic_sock_apply_config(struct sock *sk, struct quic_config *config)
 	if (config->version)
 		outq->version = config->version;
 
+	/* Local ACK policy, until the peer asks for another one with ACK_FREQUENCY. */
+	if (config->ack_eliciting_threshold) {
+		inq->ack_eliciting_threshold = config->ack_eliciting_threshold;
+		inq->ack_threshold = inq->ack_eliciting_threshold;
+	}
+	if (config->ack_reordering_threshold) {
+		inq->ack_reordering_threshold = config->ack_reordering_threshold;
+		inq->ack_reorder = inq->ack_reordering_threshold;
+	}
+
 	if (config->initial_smoothed_rtt) {
 		if (config->initial_smoothed_rtt < QUIC_RTT_MIN ||
 		    config->initial_smoothed_rtt > QUIC_RTT_MAX)
@@ -1396,6 +1476,11 @@ static int quic_accept_sock_init(struct sock *nsk, struct sock *sk)
 		inet_sk(nsk)->pinet6 = &((struct quic6_sock *)nsk)->inet6;
 
 	quic_inq(nsk)->events = quic_inq(sk)->events;
+	quic_outq(nsk)->notsent_lowat = quic_outq(sk)->notsent_lowat;
+	/* Issue routable source connection IDs with the same QUIC-LB config. */
+	if (quic_conn_id_lb_dup(quic_source(nsk), quic_source(sk)))
+		return -ENOMEM;
+	quic_source(nsk)->cpu_affine = quic_source(sk)->cpu_affine;
 
 	/* Copy the QUIC settings and transport parameters to accept socket. */
 	quic_sock_fetch_config(sk, &config);
@@ -1432,7 +1517,8 @@ static int quic_accept_sock_setup(struct sock *sk, struct quic_request_sock *req
 	quic_set_sk_addr(sk, &req->daddr, false);
 
 	/* Generate and add destination and source connection IDs. */
-	quic_conn_id_generate(&conn_id);
+	quic_sock_set_conn_id_cpu(sk);
+	quic_conn_id_source_generate(quic_source(sk), &conn_id);
 	err = quic_conn_id_add(quic_source(sk), &conn_id, 0, sk);
 	if (err)
 		goto out;
@@ -1488,6 +1574,7 @@ static struct sock *quic_accept(struct sock *sk, int flags, int *errp, bool kern
 #endif
 	struct quic_request_sock *req;
 	struct sock *nsk = NULL;
+	u64 start, init, now;
 	int err = -EINVAL;
 
 	lock_sock(sk);
@@ -1507,10 +1594,12 @@ static struct sock *quic_accept(struct sock *sk, int flags, int *errp, bool kern
 
 	req = list_first_entry(quic_reqs(sk), struct quic_request_sock, list);
 
+	start = quic_ktime_get_us();
 	err = quic_accept_sock_init(nsk, sk);
 	if (err)
 		goto free;
 
+	init = quic_ktime_get_us();
 	err = quic_accept_sock_setup(nsk, req);
 	if (err)
 		goto free;
@@ -1519,7 +1608,9 @@ static struct sock *quic_accept(struct sock *sk, int flags, int *errp, bool kern
 	 * quic_accept_sock_exists() to determine if a packet from sk_backlog of
 	 * listen socket predates this socket.
 	 */
-	quic_pnspace(sk, QUIC_CRYPTO_INITIAL)->time = quic_ktime_get_us();
+	now = quic_ktime_get_us();
+	quic_pnspace(sk, QUIC_CRYPTO_INITIAL)->time = now;
+	trace_quic_accept(sk, nsk, start - req->time, init - start, now - init);
 	quic_request_sock_free(sk, req);
 out:
 	release_sock(sk);
@@ -1590,8 +1681,9 @@ static int quic_sock_stream_reset(struct sock *sk, struct quic_errinfo *info, u3
 		return PTR_ERR(frame);
 
 	stream->send.state = QUIC_STREAM_SEND_STATE_RESET_SENT;
+	trace_quic_stream_update(sk, stream, 1);
 	quic_outq_list_purge(sk, &outq->transmitted_list, stream);
-	quic_outq_list_purge(sk, &outq->stream_list, stream);
+	quic_outq_stream_purge(sk, stream);
 	quic_outq_ctrl_tail(sk, frame, false);
 	return 0;
 }
@@ -1793,6 +1885,10 @@ static int quic_param_check_and_copy(struct quic_transport_param *p,
 			return -EINVAL;
 		param->max_ack_delay = p->max_ack_delay;
 	}
+	if (p->min_ack_delay)
+		param->min_ack_delay = p->min_ack_delay;
+	if (param->min_ack_delay > param->max_ack_delay)
+		return -EINVAL;
 	if (p->active_connection_id_limit) {
 		if (p->active_connection_id_limit < QUIC_CONN_ID_LEAST ||
 		    p->active_connection_id_limit > QUIC_CONN_ID_LIMIT)
@@ -1896,6 +1992,70 @@ static int quic_sock_set_config(struct sock *sk, struct quic_config *config, u32
 	return quic_sock_apply_config(sk, config);
 }
 
+static int quic_sock_set_notsent_lowat(struct sock *sk, u32 *lowat, u32 len)
+{
+	if (len < sizeof(*lowat))
+		return -EINVAL;
+
+	quic_outq(sk)->notsent_lowat = *lowat;
+	sk->sk_write_space(sk); /* The socket may have become writable with a larger limit. */
+	return 0;
+}
+
+static int quic_sock_set_stream_priority(struct sock *sk, struct quic_stream_priority *prio,
+					 u32 len)
+{
+	struct quic_stream_table *streams = quic_streams(sk);
+	struct quic_stream *stream;
+
+	if (len != sizeof(*prio))
+		return -EINVAL;
+	if (prio->urgency >= QUIC_STREAM_URGENCY_LEVELS || prio->incremental > 1 ||
+	    prio->weight > QUIC_STREAM_MAX_WEIGHT)
+		return -EINVAL;
+
+	stream = quic_stream_get(streams, prio->stream_id, 0, quic_is_serv(sk), true);
+	if (IS_ERR(stream))
+		return PTR_ERR(stream);
+
+	/* rfc9218#section-4: The priority only affects how queued stream data is scheduled
+	 * locally and may be changed at any time.
+	 */
+	quic_outq_stream_prioritize(sk, stream, prio->urgency, prio->incremental, prio->weight);
+	return 0;
+}
+
+static int quic_sock_set_load_balancer(struct sock *sk, struct quic_load_balancer *lb, u32 len)
+{
+	int err;
+
+	/* Source connection IDs are issued at connect() or listen(), and all IDs of a
+	 * connection must share the same config and length, so it is fixed from then on.
+	 */
+	if (len != sizeof(*lb) || !quic_is_closed(sk))
+		return -EINVAL;
+
+	err = quic_conn_id_set_lb(quic_source(sk), lb);
+	memzero_explicit(lb->key, sizeof(lb->key));
+	return err;
+}
+
+static int quic_sock_set_cpu_affinity(struct sock *sk, u32 *affine, u32 len)
+{
+	struct quic_conn_id_set *source = quic_source(sk);
+
+	/* Like QUIC_SOCKOPT_LOAD_BALANCER, this decides the format of the source connection
+	 * IDs, which cannot change once issued.
+	 */
+	if (len < sizeof(*affine) || *affine > 1 || !quic_is_closed(sk))
+		return -EINVAL;
+	if (*affine && source->lb)
+		return -EINVAL;
+
+	source->cpu_affine = (u8)*affine;
+	return 0;
+}
+
 static int quic_sock_set_alpn(struct sock *sk, u8 *data, u32 len)
 {
 	struct quic_data tmp, *alpns = quic_alpn(sk);
@@ -2101,6 +2261,7 @@ out:
 	if (err)
 		goto err;
 	/* Enter established state, and start PLPMTUD timer and Path Challenge timer. */
+	trace_quic_handshake_done(sk);
 	quic_set_state(sk, QUIC_SS_ESTABLISHED);
 	quic_timer_start(sk, QUIC_TIMER_PMTU, paths->plpmtud_interval);
 	quic_timer_reset_path(sk);
@@ -2156,6 +2317,10 @@ int quic_do_setsockopt(struct sock *sk, int optname, sockptr_t optval, unsigned
 		break;
 	case QUIC_SOCKOPT_KEY_UPDATE:
 		retval = quic_crypto_key_update(quic_crypto(sk, QUIC_CRYPTO_APP));
+		if (retval)
+			break;
+		trace_quic_key_update(sk, quic_crypto(sk, QUIC_CRYPTO_APP)->key_phase, 1);
+		QUIC_INC_STATS(sock_net(sk), QUIC_MIB_CONN_KEYUPDATES);
 		break;
 	case QUIC_SOCKOPT_TRANSPORT_PARAM:
 		retval = quic_sock_set_transport_param(sk, kopt, optlen);
@@ -2178,6 +2343,18 @@ int quic_do_setsockopt(struct sock *sk, int optname, sockptr_t optval, unsigned
 	case QUIC_SOCKOPT_CRYPTO_SECRET:
 		retval = quic_sock_set_crypto_secret(sk, kopt, optlen);
 		break;
+	case QUIC_SOCKOPT_NOTSENT_LOWAT:
+		retval = quic_sock_set_notsent_lowat(sk, kopt, optlen);
+		break;
+	case QUIC_SOCKOPT_STREAM_PRIORITY:
+		retval = quic_sock_set_stream_priority(sk, kopt, optlen);
+		break;
+	case QUIC_SOCKOPT_LOAD_BALANCER:
+		retval = quic_sock_set_load_balancer(sk, kopt, optlen);
+		break;
+	case QUIC_SOCKOPT_CPU_AFFINITY:
+		retval = quic_sock_set_cpu_affinity(sk, kopt, optlen);
+		break;
 	default:
 		retval = -ENOPROTOOPT;
 		break;
@@ -2335,6 +2512,76 @@ static int quic_sock_get_config(struct sock *sk, u32 len, sockptr_t optval, sock
 	return 0;
 }
 
+static int quic_sock_get_notsent_lowat(struct sock *sk, u32 len, sockptr_t optval,
+				       sockptr_t optlen)
+{
+	u32 lowat = quic_outq(sk)->notsent_lowat;
+
+	if (len < sizeof(lowat))
+		return -EINVAL;
+	len = sizeof(lowat);
+
+	if (copy_to_sockptr(optlen, &len, sizeof(len)) || copy_to_sockptr(optval, &lowat, len))
+		return -EFAULT;
+	return 0;
+}
+
+static int quic_sock_get_stream_priority(struct sock *sk, u32 len, sockptr_t optval,
+					 sockptr_t optlen)
+{
+	struct quic_stream_table *streams = quic_streams(sk);
+	struct quic_stream_priority prio;
+	struct quic_stream *stream;
+
+	if (len < sizeof(prio))
+		return -EINVAL;
+	len = sizeof(prio);
+	if (copy_from_sockptr(&prio, optval, len))
+		return -EFAULT;
+
+	stream = quic_stream_get(streams, prio.stream_id, 0, quic_is_serv(sk), true);
+	if (IS_ERR(stream))
+		return PTR_ERR(stream);
+
+	prio.urgency = stream->send.urgency;
+	prio.incremental = stream->send.incremental;
+	prio.weight = stream->send.weight;
+
+	if (copy_to_sockptr(optlen, &len, sizeof(len)) || copy_to_sockptr(optval, &prio, len))
+		return -EFAULT;
+	return 0;
+}
+
+static int quic_sock_get_load_balancer(struct sock *sk, u32 len, sockptr_t optval,
+				       sockptr_t optlen)
+{
+	struct quic_load_balancer lb;
+
+	if (len < sizeof(lb))
+		return -EINVAL;
+	len = sizeof(lb);
+
+	quic_conn_id_get_lb(quic_source(sk), &lb);
+
+	if (copy_to_sockptr(optlen, &len, sizeof(len)) || copy_to_sockptr(optval, &lb, len))
+		return -EFAULT;
+	return 0;
+}
+
+static int quic_sock_get_cpu_affinity(struct sock *sk, u32 len, sockptr_t optval,
+				      sockptr_t optlen)
+{
+	u32 affine = quic_source(sk)->cpu_affine;
+
+	if (len < sizeof(affine))
+		return -EINVAL;
+	len = sizeof(affine);
+
+	if (copy_to_sockptr(optlen, &len, sizeof(len)) || copy_to_sockptr(optval, &affine, len))
+		return -EFAULT;
+	return 0;
+}
+
 static int quic_sock_get_alpn(struct sock *sk, u32 len, sockptr_t optval, sockptr_t optlen)
 {
 	struct quic_data *alpns = quic_alpn(sk);
@@ -2519,6 +2766,18 @@ int quic_do_getsockopt(struct sock *sk, int optname, sockptr_t optval, sockptr_t
 	case QUIC_SOCKOPT_CRYPTO_SECRET:
 		retval = quic_sock_get_crypto_secret(sk, len, optval, optlen);
 		break;
+	case QUIC_SOCKOPT_NOTSENT_LOWAT:
+		retval = quic_sock_get_notsent_lowat(sk, len, optval, optlen);
+		break;
+	case QUIC_SOCKOPT_STREAM_PRIORITY:
+		retval = quic_sock_get_stream_priority(sk, len, optval, optlen);
+		break;
+	case QUIC_SOCKOPT_LOAD_BALANCER:
+		retval = quic_sock_get_load_balancer(sk, len, optval, optlen);
+		break;
+	case QUIC_SOCKOPT_CPU_AFFINITY:
+		retval = quic_sock_get_cpu_affinity(sk, len, optval, optlen);
+		break;
 	default:
 		retval = -ENOPROTOOPT;
 		break;
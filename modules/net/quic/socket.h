@@ -17,8 +17,8 @@
 #include "stream.h"
 #include "connid.h"
 #include "crypto.h"
-#include "path.h"
 #include "cong.h"
+#include "path.h"
 
 #include "frame.h"
 #include "packet.h"
@@ -80,6 +80,7 @@ struct quic_request_sock {
 	struct quic_conn_id	orig_dcid;
 	u32			version;
 	u8			retry;
+	u64			time;	/* creation time in us, for the accept queue wait */
 
 	struct sk_buff_head	backlog_list;
 	u32			blen;
@@ -97,7 +98,6 @@ struct quic_sock {
 	struct quic_conn_id_set		source;
 	struct quic_conn_id_set		dest;
 	struct quic_path_group		paths;
-	struct quic_cong		cong;
 	struct quic_pnspace		space[QUIC_PNSPACE_MAX];
 	struct quic_crypto		crypto[QUIC_CRYPTO_MAX];
 
@@ -162,9 +162,10 @@ static inline bool quic_is_serv(const struct sock *sk)
 	return !!sk->sk_max_ack_backlog;
 }
 
+/* RTT and congestion state of the active path. */
 static inline struct quic_cong *quic_cong(const struct sock *sk)
 {
-	return &quic_sk(sk)->cong;
+	return &quic_sk(sk)->paths.path[0].cong;
 }
 
 static inline struct quic_pnspace *quic_pnspace(const struct sock *sk, u8 level)
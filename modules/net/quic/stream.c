@@ -104,6 +104,10 @@ static struct quic_stream *quic_stream_create(struct quic_stream_table *streams,
 			goto free;
 
 		stream->id = stream_id;
+		stream->send.urgency = QUIC_STREAM_DEF_URGENCY;
+		stream->send.weight = QUIC_STREAM_DEF_WEIGHT;
+		INIT_LIST_HEAD(&stream->send.frame_list);
+		INIT_LIST_HEAD(&stream->list);
 		if (quic_stream_id_uni(stream_id)) {
 			if (send) {
 				stream->send.max_bytes = limits->max_stream_data_uni;
@@ -11,6 +11,17 @@
 #define QUIC_DEF_STREAMS	100
 #define QUIC_MAX_STREAMS	4096ULL
 
+/* rfc9218#section-4.1: urgency ranges from 0 (highest priority) to 7, defaulting to 3. */
+#define QUIC_STREAM_URGENCY_LEVELS	8
+#define QUIC_STREAM_DEF_URGENCY		3
+
+/* Incremental streams of the same urgency share the bandwidth by deficit round robin, each
+ * earning weight * QUIC_STREAM_WEIGHT_QUANTUM bytes of credit per round.
+ */
+#define QUIC_STREAM_DEF_WEIGHT		16
+#define QUIC_STREAM_MAX_WEIGHT		256
+#define QUIC_STREAM_WEIGHT_QUANTUM	256
+
 /*
  * rfc9000#section-2.1:
  *
@@ -31,8 +42,11 @@
 
 struct quic_stream {
 	struct hlist_node node;
+	struct list_head list;		/* In outq->stream_list[urgency] while queued */
 	s64 id;				/* Stream ID as defined in RFC 9000 Section 2.1 */
 	struct {
+		struct list_head frame_list;	/* STREAM frames queued for transmission */
+
 		/* Sending-side stream level flow control */
 		u64 last_max_bytes;	/* Maximum send offset advertised by peer at last update */
 		u64 max_bytes;		/* Current maximum offset we are allowed to send to */
@@ -44,6 +58,11 @@ struct quic_stream {
 
 		u8 data_blocked;	/* True if flow control blocks sending more data */
 		u8 done;		/* True if application indicated end of stream (FIN sent) */
+
+		u32 deficit;		/* Bytes left to send in the current DRR round */
+		u16 weight;		/* Share of bandwidth among incremental streams */
+		u8 urgency;		/* Priority urgency, per rfc9218#section-4.1 */
+		u8 incremental;		/* Incremental flag, rfc9218#section-4.2 */
 	} send;
 	struct {
 		/* Receiving-side stream level flow control */
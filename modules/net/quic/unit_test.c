@@ -14,6 +14,7 @@
 #include <linux/delay.h>
 #include <linux/quic.h>
 #include <kunit/test.h>
+#include <net/inet_ecn.h>
 #include <net/sock.h>
 #include <net/tls.h>
 
@@ -1049,6 +1050,117 @@ static void quic_cong_test3(struct kunit *test)
 	KUNIT_EXPECT_EQ(test, cong.window, 37802);
 }
 
+static void quic_cong_test4(struct kunit *test)
+{
+	struct quic_cong cong = {};
+	u32 time, bytes;
+
+	cong.max_ack_delay = 25000;
+	cong.max_window = 262144;
+	quic_cong_set_mss(&cong, 1400);
+
+	quic_cong_set_algo(&cong, QUIC_CONG_ALG_PRAGUE);
+	quic_cong_set_srtt(&cong, QUIC_RTT_INIT);
+	cong.is_rtt_set = 1;
+
+	KUNIT_EXPECT_EQ(test, cong.window, 14000);
+	KUNIT_EXPECT_EQ(test, cong.state, QUIC_CONG_SLOW_START);
+	KUNIT_EXPECT_EQ(test, quic_cong_ecn(&cong), INET_ECN_ECT_1);
+
+	cong.time = 1000000;
+	time = cong.time - 300000;
+	bytes = 100000;
+	quic_cong_on_packet_acked(&cong, time, bytes, 0);
+	KUNIT_EXPECT_EQ(test, cong.window, 114000);
+
+	/* slow_start -> recovery: alpha starts at 1, so the first CE halves cwnd */
+	quic_cong_on_ecn_count(&cong, 10, 10);
+	quic_cong_on_process_ecn(&cong);
+	KUNIT_EXPECT_EQ(test, cong.state, QUIC_CONG_RECOVERY_PERIOD);
+	KUNIT_EXPECT_EQ(test, cong.ssthresh, 57000);
+	KUNIT_EXPECT_EQ(test, cong.window, 57000);
+
+	/* recovery: no update after ECN */
+	quic_cong_on_process_ecn(&cong);
+	KUNIT_EXPECT_EQ(test, cong.window, 57000);
+
+	/* recovery -> cong_avoid: go to cong_avoid after SACK if recovery_time < time */
+	time = cong.time + 20;
+	cong.time = time;
+	bytes = 1400;
+	quic_cong_on_packet_acked(&cong, time, bytes, 0);
+	KUNIT_EXPECT_EQ(test, cong.state, QUIC_CONG_CONGESTION_AVOIDANCE);
+
+	/* alpha: 1024 -> 966 with 10% marked, then -> 906 with none marked */
+	cong.time += QUIC_RTT_INIT;
+	quic_cong_on_ecn_count(&cong, 100, 10);
+	cong.time += QUIC_RTT_INIT;
+	quic_cong_on_ecn_count(&cong, 100, 0);
+	/* Marks within the same round are not folded into alpha yet. */
+	quic_cong_on_ecn_count(&cong, 100, 100);
+
+	/* cong_avoid -> recovery: cwnd is reduced by alpha / 2 only */
+	quic_cong_on_process_ecn(&cong);
+	KUNIT_EXPECT_EQ(test, cong.state, QUIC_CONG_RECOVERY_PERIOD);
+	KUNIT_EXPECT_EQ(test, cong.ssthresh, 31785);
+	KUNIT_EXPECT_EQ(test, cong.window, 31785);
+
+	/* cong_avoid -> recovery: loss still halves cwnd as in Reno */
+	time = cong.time + 20;
+	cong.time = time;
+	quic_cong_on_packet_acked(&cong, time, bytes, 0);
+	KUNIT_EXPECT_EQ(test, cong.state, QUIC_CONG_CONGESTION_AVOIDANCE);
+	time = cong.time - 300000;
+	quic_cong_on_packet_lost(&cong, time, bytes, 0);
+	KUNIT_EXPECT_EQ(test, cong.state, QUIC_CONG_RECOVERY_PERIOD);
+	KUNIT_EXPECT_EQ(test, cong.window, 15892);
+}
+
+static void quic_cong_test5(struct kunit *test)
+{
+	struct quic_cong cong = {}, old;
+	u32 time, bytes;
+
+	cong.max_ack_delay = 25000;
+	cong.max_window = 262144;
+	quic_cong_set_mss(&cong, 1400);
+
+	quic_cong_set_algo(&cong, QUIC_CONG_ALG_RENO);
+	quic_cong_set_srtt(&cong, QUIC_RTT_INIT);
+
+	cong.time = jiffies_to_usecs(jiffies);
+	time = cong.time - 30000;
+	bytes = 28000;
+	quic_cong_rtt_update(&cong, time, 0);
+	quic_cong_on_packet_acked(&cong, time, bytes, 0);
+	quic_cong_on_packet_lost(&cong, time, 1400, 0);
+	KUNIT_EXPECT_EQ(test, cong.smoothed_rtt, 30000);
+	KUNIT_EXPECT_EQ(test, cong.state, QUIC_CONG_RECOVERY_PERIOD);
+	KUNIT_EXPECT_EQ(test, cong.window, 21000);
+	old = cong;
+
+	/* new path: back to the initial window and RTT, keeping algo, limits and mss */
+	quic_cong_reset(&cong);
+	KUNIT_EXPECT_EQ(test, cong.state, QUIC_CONG_SLOW_START);
+	KUNIT_EXPECT_EQ(test, cong.ssthresh, U32_MAX);
+	KUNIT_EXPECT_EQ(test, cong.window, 14000);
+	KUNIT_EXPECT_EQ(test, cong.smoothed_rtt, QUIC_RTT_INIT);
+	KUNIT_EXPECT_EQ(test, cong.is_rtt_set, 0);
+	KUNIT_EXPECT_EQ(test, cong.min_rtt_valid, 0);
+	KUNIT_EXPECT_EQ(test, cong.max_window, 262144);
+	KUNIT_EXPECT_EQ(test, cong.mss, 1400);
+	KUNIT_EXPECT_EQ(test, cong.algo, QUIC_CONG_ALG_RENO);
+
+	/* back to the old path: its window and RTT are kept, the settings follow the new one */
+	cong.max_window = 131072;
+	quic_cong_set_algo(&cong, QUIC_CONG_ALG_CUBIC);
+	quic_cong_restore(&old, &cong);
+	KUNIT_EXPECT_EQ(test, old.window, 21000);
+	KUNIT_EXPECT_EQ(test, old.smoothed_rtt, 30000);
+	KUNIT_EXPECT_EQ(test, old.max_window, 131072);
+	KUNIT_EXPECT_EQ(test, old.algo, QUIC_CONG_ALG_CUBIC);
+}
+
 static struct kunit_case quic_test_cases[] = {
 	KUNIT_CASE(quic_pnspace_test1),
 	KUNIT_CASE(quic_pnspace_test2),
@@ -1057,6 +1169,8 @@ static struct kunit_case quic_test_cases[] = {
 	KUNIT_CASE(quic_cong_test1),
 	KUNIT_CASE(quic_cong_test2),
 	KUNIT_CASE(quic_cong_test3),
+	KUNIT_CASE(quic_cong_test4),
+	KUNIT_CASE(quic_cong_test5),
 	{}
 };
 
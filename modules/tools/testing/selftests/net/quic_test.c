@@ -2,6 +2,7 @@
 
 #include <linux/genetlink.h>
 #include <linux/handshake.h>
+#include <linux/filter.h>
 #include <sys/socket.h>
 
 #include <linux/quic.h>
@@ -10,6 +11,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <errno.h>
 
@@ -745,6 +747,68 @@ static int create_listen_socket(char *alpn)
 	return listenfd;
 }
 
+/* Create a reuseport listen socket that issues QUIC-LB connection IDs with a 1-byte server ID
+ * and an 8-byte nonce, and always sends Retry for address validation.
+ */
+static int create_reuseport_listen_socket(uint8_t server_id)
+{
+	struct quic_load_balancer lb = {};
+	struct quic_config config = {};
+	struct sockaddr_storage sa;
+	int listenfd, one = 1;
+
+	listenfd = create_socket(&sa, dev[1]);
+	if (listenfd < 0)
+		return -1;
+	if (setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))) {
+		printf("setsockopt: SO_REUSEPORT errno=%d\n", errno);
+		return -1;
+	}
+	lb.server_id_len = 1;
+	lb.nonce_len = 8;
+	lb.server_id[0] = server_id;
+	if (setopt_pass(listenfd, QUIC_SOCKOPT_LOAD_BALANCER, &lb, sizeof(lb)))
+		return -1;
+	config.validate_peer_address = 1;
+	if (setopt_pass(listenfd, QUIC_SOCKOPT_CONFIG, &config, sizeof(config)))
+		return -1;
+	if (bind(listenfd, (struct sockaddr *)&sa, sizeof(sa))) {
+		printf("bind: errno=%d\n", errno);
+		return -1;
+	}
+	if (listen(listenfd, 1)) {
+		printf("listen: errno=%d\n", errno);
+		return -1;
+	}
+	return listenfd;
+}
+
+/* Select a listener by the server ID in a QUIC-LB DCID of a long header packet, which is
+ * the Retry SCID in the client's second Initial.  Other packets go to listener 1.
+ */
+static int attach_reuseport_cid_prefix_filter(int listenfd)
+{
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),			/* header form */
+		BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x80, 0, 4),
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 5),			/* DCID length */
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 10, 0, 2),
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 7),			/* server ID */
+		BPF_STMT(BPF_RET | BPF_A, 0),
+		BPF_STMT(BPF_RET | BPF_K, 1),
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(code) / sizeof(code[0]),
+		.filter = code,
+	};
+
+	if (setsockopt(listenfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog))) {
+		printf("setsockopt: SO_ATTACH_REUSEPORT_CBPF errno=%d\n", errno);
+		return -1;
+	}
+	return 0;
+}
+
 static int create_connect_socket(void)
 {
 	struct sockaddr_storage sa;
@@ -947,6 +1011,38 @@ static int test_handshake(int *connectfd_p, int *acceptfd_p)
 	close_sockets(connectfd, acceptfd);
 	printf("[] Handshake with Preferred Address\n");
 
+	/* Listener i issues server ID 1 - i, so the Retry from listener 1, which gets the first
+	 * Initial, pins the connection to listener 0, unlike any peer address based selection.
+	 */
+	sockfd[0] = create_reuseport_listen_socket(1);
+	if (sockfd[0] < 0)
+		return -1;
+	sockfd[1] = create_reuseport_listen_socket(0);
+	if (sockfd[1] < 0)
+		return -1;
+	if (attach_reuseport_cid_prefix_filter(sockfd[0]))
+		return -1;
+	connectfd = create_connect_socket();
+	if (connectfd < 0)
+		return -1;
+	if (send_fake_handshake(connectfd, QUIC_CRYPTO_INITIAL, 0))
+		return -1;
+	acceptfd = accept(sockfd[0], NULL, NULL);
+	if (acceptfd < 0) {
+		printf("accept: errno=%d\n", errno);
+		return -1;
+	}
+	if (fcntl(sockfd[1], F_SETFL, O_NONBLOCK) || accept(sockfd[1], NULL, NULL) != -1 ||
+	    errno != EAGAIN) {
+		printf("accept: unexpected connection on listener 1\n");
+		return -1;
+	}
+	close_sockets(sockfd[0], sockfd[1]);
+	if (do_handshake(connectfd, acceptfd))
+		return -1;
+	close_sockets(connectfd, acceptfd);
+	printf("[] Handshake with Reuseport BPF selection by CID prefix\n");
+
 	sockfd[0] = create_listen_socket("quic");
 	if (sockfd[0] < 0)
 		return -1;
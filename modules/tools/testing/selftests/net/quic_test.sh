@@ -2,6 +2,7 @@
 # SPDX-License-Identifier: GPL-2.0
 
 td_id=10
+tracefs=/sys/kernel/tracing
 
 simple_if_init()
 {
@@ -91,6 +92,8 @@ cleanup()
 	pkill -f "quic_test "
 	pkill -f "quic_sample_test"
 	[ -d /sys/module/quic_sample_test ] && rmmod quic_sample_test
+	[ -d /sys/module/quic ] && sysctl -wq net.quic.quic_udp_socks=1
+	[ -d $tracefs/events/quic ] && echo 0 > $tracefs/events/quic/enable
 	[ "$unload" = "1" -a -d /sys/module/quic ] && rmmod quic
 	ip link set $cveth mtu 1500
 	ip link set $sveth mtu 1500
@@ -130,6 +133,23 @@ do_test()
 	done
 	ip link set $cveth mtu 1500
 	ip link set $sveth mtu 1500
+	echo "=> Reuseport UDP sockets = 4 (Message size = 16384)"
+	sysctl -wq net.quic.quic_udp_socks=4 || return $?
+	server_run ./quic_test perf server 16384 $addr $port $sveth || return $?
+	[ "$(grep -c ":$port" /proc/net/quic/udps)" = "4" ] || return 1
+	client_run ./quic_test perf client 16384 $addr $port $cveth || return $?
+	sysctl -wq net.quic.quic_udp_socks=1
+	if [ -d $tracefs/events/quic ]; then
+		echo "=> Tracepoints (Message size = 16384)"
+		echo > $tracefs/trace
+		echo 1 > $tracefs/events/quic/enable
+		server_run ./quic_test perf server 16384 $addr $port $sveth || return $?
+		client_run ./quic_test perf client 16384 $addr $port $cveth || return $?
+		echo 0 > $tracefs/events/quic/enable
+		for event in quic_packet_sent quic_packet_recv quic_frame_ack quic_rtt_update; do
+			grep -q " $event: sk=" $tracefs/trace || return 1
+		done
+	fi
 	echo ""
 
 	echo "3. Sample Test:"
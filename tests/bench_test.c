@@ -0,0 +1,625 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include <sys/syscall.h>
+#include <netinet/quic.h>
+#include <sys/syslog.h>
+#include <linux/perf_event.h>
+
+#define SND_MSG_LEN	65536
+#define RCV_MSG_LEN	65536
+#define ALPN		"sample"
+
+#define SECONDS		1000000
+#define MAX_THREADS	256
+#define MAX_CONNS	64
+#define MAX_STREAMS	64
+#define MAX_WORKERS	1024
+
+/* The client keeps sending this long after its window, so that the server's window, which
+ * starts at its first received byte, is fully loaded as well.
+ */
+#define TAIL_SECS	1
+
+struct options {
+	char *pkey;
+	char *cert;
+	char *addr;
+	char *port;
+	uint8_t is_serv;
+	uint8_t cong;
+	int cpu;
+	uint32_t threads;
+	uint32_t conns;
+	uint32_t streams;
+	uint32_t msg_len;
+	uint32_t warmup;
+	uint32_t duration;
+};
+
+/* Per-thread counters, one cache line each; MAX_WORKERS slots are shared round-robin by the
+ * server's connection threads.
+ */
+struct counter {
+	uint64_t bytes;
+	uint64_t msgs;
+} __attribute__((aligned(64)));
+
+struct sample {
+	uint64_t time;		/* CLOCK_MONOTONIC in ns */
+	uint64_t bytes;
+	uint64_t msgs;
+	uint64_t cpu_busy;	/* Non-idle jiffies of all CPUs in /proc/stat */
+	uint64_t cycles;	/* CPU cycles of this process, user and kernel */
+};
+
+static const char *cong_names[] = { "reno", "cubic", "prague" };
+
+static struct counter counters[MAX_WORKERS];
+static struct options opts;
+static char snd_msg[SND_MSG_LEN];
+static int perf_fd = -1;
+
+static volatile int started, stopped;
+static uint32_t ready, active, accepted;
+
+static struct option long_options[] = {
+	{"addr",	required_argument,	0,	'a'},
+	{"port",	required_argument,	0,	'p'},
+	{"pkey",	required_argument,	0,	'k'},
+	{"cert",	required_argument,	0,	'c'},
+	{"threads",	required_argument,	0,	'T'},
+	{"conns",	required_argument,	0,	'C'},
+	{"streams",	required_argument,	0,	'n'},
+	{"msg_len",	required_argument,	0,	'm'},
+	{"cpu",		required_argument,	0,	'P'},
+	{"warmup",	required_argument,	0,	'w'},
+	{"duration",	required_argument,	0,	'd'},
+	{"cong",	required_argument,	0,	'g'},
+	{"listen",	no_argument,		0,	'l'},
+	{"help",	no_argument,		0,	'h'},
+	{0,		0,			0,	 0 }
+};
+
+static void print_usage(char *cmd)
+{
+	printf("%s:\n\n", cmd);
+	printf("    --listen/-l:            work as a server\n");
+	printf("    --addr/-a <a>:          server IP address\n");
+	printf("    --port/-p <p>:          server port\n");
+	printf("    --pkey/-k <k>:          private key file\n");
+	printf("    --cert/-c <c>:          certificate file\n");
+	printf("    --help/-h <h>:          show help\n");
+	printf("    --threads/-T <T>:       client threads\n");
+	printf("    --conns/-C <C>:         connections per client thread\n");
+	printf("    --streams/-n <n>:       streams per connection\n");
+	printf("    --msg_len/-m <m>:       msg_len to send\n");
+	printf("    --cpu/-P <P>:           pin threads to CPUs from P on, round-robin\n");
+	printf("    --warmup/-w <w>:        seconds to run before measuring\n");
+	printf("    --duration/-d <d>:      seconds to measure\n");
+	printf("    --cong/-g <g>:          congestion control: reno, cubic or prague\n\n");
+}
+
+static int parse_options(int argc, char *argv[], struct options *opts)
+{
+	int c, option_index = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, "la:p:k:c:T:C:n:m:P:w:d:g:h", long_options,
+				&option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'l':
+			opts->is_serv = 1;
+			break;
+		case 'a':
+			opts->addr = optarg;
+			break;
+		case 'p':
+			opts->port = optarg;
+			break;
+		case 'k':
+			opts->pkey = optarg;
+			break;
+		case 'c':
+			opts->cert = optarg;
+			break;
+		case 'T':
+			opts->threads = atoi(optarg);
+			if (!opts->threads || opts->threads > MAX_THREADS)
+				return -1;
+			break;
+		case 'C':
+			opts->conns = atoi(optarg);
+			if (!opts->conns || opts->conns > MAX_CONNS)
+				return -1;
+			break;
+		case 'n':
+			opts->streams = atoi(optarg);
+			if (!opts->streams || opts->streams > MAX_STREAMS)
+				return -1;
+			break;
+		case 'm':
+			opts->msg_len = atoi(optarg);
+			if (!opts->msg_len || opts->msg_len > SND_MSG_LEN)
+				return -1;
+			break;
+		case 'P':
+			opts->cpu = atoi(optarg);
+			break;
+		case 'w':
+			opts->warmup = atoi(optarg);
+			break;
+		case 'd':
+			opts->duration = atoi(optarg);
+			if (!opts->duration)
+				return -1;
+			break;
+		case 'g':
+			for (c = 0; c < QUIC_CONG_ALG_MAX; c++)
+				if (!strcmp(optarg, cong_names[c]))
+					break;
+			if (c == QUIC_CONG_ALG_MAX)
+				return -1;
+			opts->cong = c;
+			break;
+		case 'h':
+			print_usage(argv[0]);
+			return 1;
+		default:
+			return -1;
+		}
+	}
+
+	if (opts->is_serv && (!opts->cert || !opts->pkey))
+		return -1;
+	return 0;
+}
+
+static uint64_t get_now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void pin_cpu(uint32_t id)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t set;
+
+	if (opts.cpu < 0 || ncpus <= 0)
+		return;
+
+	CPU_ZERO(&set);
+	CPU_SET((opts.cpu + id) % ncpus, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+		printf("pin thread %u failed\n", id);
+}
+
+/* Counts the cycles of this process and all threads it creates later, in user and kernel
+ * mode.  It is not available in many VMs, and then only /proc/stat is used.
+ */
+static void perf_open(void)
+{
+	struct perf_event_attr attr = {};
+
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.inherit = 1;
+	attr.exclude_hv = 1;
+	perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void take_sample(struct sample *s)
+{
+	uint64_t val[10] = {}, total = 0;
+	FILE *fp;
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	for (i = 0; i < MAX_WORKERS; i++) {
+		s->bytes += __atomic_load_n(&counters[i].bytes, __ATOMIC_RELAXED);
+		s->msgs += __atomic_load_n(&counters[i].msgs, __ATOMIC_RELAXED);
+	}
+
+	fp = fopen("/proc/stat", "r");
+	if (fp) {
+		if (fscanf(fp, "cpu %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+			   " %" SCNu64 " %" SCNu64 " %" SCNu64, &val[0], &val[1], &val[2],
+			   &val[3], &val[4], &val[5], &val[6], &val[7]) == 8) {
+			for (i = 0; i < 8; i++)
+				total += val[i];
+			s->cpu_busy = total - val[3] - val[4]; /* Not idle or iowait. */
+		}
+		fclose(fp);
+	}
+
+	if (perf_fd < 0 || read(perf_fd, &s->cycles, sizeof(s->cycles)) != sizeof(s->cycles))
+		s->cycles = 0;
+	s->time = get_now_ns();
+}
+
+/* One line of JSON per run, for regression tracking.  cpu_ns_per_byte is from /proc/stat,
+ * so it covers all CPUs of the host, including softirq work and, over loopback, the peer.
+ */
+static void print_result(const char *side, struct sample *a, struct sample *b)
+{
+	double bytes = (double)(b->bytes - a->bytes), ns = (double)(b->time - a->time);
+	double jiffy_ns = 1e9 / sysconf(_SC_CLK_TCK);
+
+	if (!bytes)
+		bytes = 1;
+	printf("{\"side\": \"%s\", \"cong\": \"%s\", \"threads\": %u, \"conns\": %u, "
+	       "\"streams\": %u, \"msg_len\": %u, \"duration\": %.3f, \"gbps\": %.3f, "
+	       "\"msgs_per_sec\": %.0f, ", side, cong_names[opts.cong], opts.threads, opts.conns,
+	       opts.streams, opts.msg_len, ns / 1e9,
+	       bytes * 8 / ns, (double)(b->msgs - a->msgs) * 1e9 / ns);
+	if (perf_fd >= 0)
+		printf("\"cycles_per_byte\": %.3f, ", (double)(b->cycles - a->cycles) / bytes);
+	else
+		printf("\"cycles_per_byte\": null, ");
+	printf("\"cpu_ns_per_byte\": %.3f}\n", (b->cpu_busy - a->cpu_busy) * jiffy_ns / bytes);
+	fflush(stdout);
+}
+
+/* The congestion control of a connection is set on the client socket before connecting, and
+ * inherited from the listen socket on the server side.
+ */
+static int set_cong(int sockfd)
+{
+	struct quic_config config = {};
+
+	config.congestion_control_algo = opts.cong;
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CONFIG, &config, sizeof(config))) {
+		printf("socket setsockopt config failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+struct server_conn {
+	int sockfd;
+	uint32_t id;
+};
+
+static void *server_worker(void *arg)
+{
+	struct server_conn *conn = arg;
+	struct counter *cnt = &counters[conn->id % MAX_WORKERS];
+	int ret, sockfd = conn->sockfd;
+	uint32_t flags;
+	int64_t sid;
+	char *buf;
+
+	pin_cpu(conn->id);
+	free(conn);
+	buf = malloc(RCV_MSG_LEN);
+	if (!buf)
+		goto out;
+	if (quic_server_handshake(sockfd, opts.pkey, opts.cert, ALPN))
+		goto out;
+
+	while (1) {
+		flags = 0;
+		ret = quic_recvmsg(sockfd, buf, RCV_MSG_LEN, &sid, &flags);
+		if (ret == -1)
+			break; /* Closed by the client. */
+		__atomic_fetch_add(&cnt->bytes, ret, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&cnt->msgs, 1, __ATOMIC_RELAXED);
+	}
+out:
+	free(buf);
+	close(sockfd);
+	__atomic_fetch_sub(&active, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/* The server measures one window per run: it starts 'warmup' seconds after data begins to
+ * arrive, and the next run is waited for once all connections are closed.
+ */
+static void *server_reporter(void *arg)
+{
+	struct sample a, b;
+
+	while (1) {
+		take_sample(&a);
+		while (1) {
+			usleep(10000);
+			take_sample(&b);
+			if (b.bytes != a.bytes)
+				break;
+		}
+		sleep(opts.warmup);
+		take_sample(&a);
+		sleep(opts.duration);
+		take_sample(&b);
+		print_result("server", &a, &b);
+
+		while (__atomic_load_n(&active, __ATOMIC_RELAXED))
+			usleep(100000);
+	}
+	return NULL;
+}
+
+static int do_server(void)
+{
+	struct sockaddr_storage ra = {};
+	struct server_conn *conn;
+	int sockfd, listenfd;
+	struct addrinfo *rp;
+	pthread_t thread;
+	socklen_t addrlen;
+
+	if (getaddrinfo(opts.addr, opts.port, NULL, &rp)) {
+		printf("getaddrinfo error\n");
+		return -1;
+	}
+
+	listenfd = socket(rp->ai_family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (listenfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	if (bind(listenfd, rp->ai_addr, rp->ai_addrlen)) {
+		printf("socket bind failed\n");
+		return -1;
+	}
+	if (setsockopt(listenfd, SOL_QUIC, QUIC_SOCKOPT_ALPN, ALPN, strlen(ALPN))) {
+		printf("socket setsockopt alpn failed\n");
+		return -1;
+	}
+	if (set_cong(listenfd))
+		return -1;
+	if (listen(listenfd, MAX_WORKERS)) {
+		printf("socket listen failed\n");
+		return -1;
+	}
+
+	perf_open();
+	if (pthread_create(&thread, NULL, server_reporter, NULL)) {
+		printf("pthread create failed\n");
+		return -1;
+	}
+
+	while (1) {
+		addrlen = sizeof(ra);
+		sockfd = accept(listenfd, (struct sockaddr *)&ra, &addrlen);
+		if (sockfd < 0) {
+			printf("socket accept failed %d %d\n", errno, sockfd);
+			return -1;
+		}
+		conn = malloc(sizeof(*conn));
+		if (!conn)
+			return -1;
+		conn->sockfd = sockfd;
+		conn->id = accepted++;
+		__atomic_fetch_add(&active, 1, __ATOMIC_RELAXED);
+		if (pthread_create(&thread, NULL, server_worker, conn)) {
+			printf("pthread create failed\n");
+			return -1;
+		}
+		pthread_detach(thread);
+	}
+	return 0;
+}
+
+static int client_connect(struct addrinfo *rp)
+{
+	struct quic_transport_param param = {};
+	struct quic_stream_info sinfo = {};
+	uint32_t i, optlen;
+	int sockfd;
+
+	sockfd = socket(rp->ai_family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (sockfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	param.max_idle_timeout = 120 * SECONDS;
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_TRANSPORT_PARAM, &param, sizeof(param))) {
+		printf("socket setsockopt transport param failed\n");
+		goto err;
+	}
+	if (set_cong(sockfd))
+		goto err;
+	if (connect(sockfd, rp->ai_addr, rp->ai_addrlen)) {
+		printf("socket connect failed\n");
+		goto err;
+	}
+	if (quic_client_handshake(sockfd, NULL, NULL, ALPN))
+		goto err;
+
+	for (i = 0; i < opts.streams; i++) {
+		optlen = sizeof(sinfo);
+		sinfo.stream_id = i * 4;
+		sinfo.stream_flags = 0;
+		if (getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_OPEN, &sinfo, &optlen)) {
+			printf("socket getsockopt stream open failed\n");
+			goto err;
+		}
+	}
+	return sockfd;
+err:
+	close(sockfd);
+	return -1;
+}
+
+struct client {
+	pthread_t thread;
+	uint32_t id;
+	struct addrinfo *rp;
+	int fds[MAX_CONNS];
+	int ret;
+};
+
+/* Sends msg_len messages round-robin over the streams of all connections of the thread.
+ * MSG_DONTWAIT keeps one connection or stream that is blocked by its send buffer (EAGAIN)
+ * or flow control (ENOSPC) from holding the others.
+ */
+static void *client_worker(void *arg)
+{
+	struct pollfd pfds[MAX_CONNS] = {};
+	struct client *c = arg;
+	struct counter *cnt = &counters[c->id];
+	uint32_t i, next[MAX_CONNS] = {};
+	int ret, progress, full;
+	int64_t sid;
+
+	pin_cpu(c->id);
+	for (i = 0; i < opts.conns; i++)
+		c->fds[i] = -1;
+	for (i = 0; i < opts.conns; i++) {
+		c->fds[i] = client_connect(c->rp);
+		if (c->fds[i] < 0) {
+			c->ret = -1;
+			goto out;
+		}
+		pfds[i].fd = c->fds[i];
+		pfds[i].events = POLLOUT;
+	}
+	__atomic_fetch_add(&ready, 1, __ATOMIC_RELAXED);
+	while (!started)
+		usleep(1000);
+
+	while (!stopped) {
+		progress = 0;
+		full = 0;
+		for (i = 0; i < opts.conns; i++) {
+			sid = next[i] * 4;
+			next[i] = (next[i] + 1) % opts.streams;
+			ret = quic_sendmsg(c->fds[i], snd_msg, opts.msg_len, sid, MSG_DONTWAIT);
+			if (ret == -1) {
+				if (errno == EAGAIN) {
+					full = 1;
+					continue;
+				}
+				if (errno == ENOSPC)
+					continue;
+				printf("send %d %d\n", ret, errno);
+				c->ret = -1;
+				goto out;
+			}
+			__atomic_fetch_add(&cnt->bytes, ret, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&cnt->msgs, 1, __ATOMIC_RELAXED);
+			progress = 1;
+		}
+		if (progress)
+			continue;
+		if (!full) { /* Wait for MAX_STREAM_DATA from the peer. */
+			usleep(20);
+			continue;
+		}
+		poll(pfds, opts.conns, 1);
+	}
+out:
+	for (i = 0; i < opts.conns; i++)
+		if (c->fds[i] >= 0)
+			close(c->fds[i]);
+	if (c->ret)
+		__atomic_fetch_add(&ready, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static int do_client(void)
+{
+	struct client *clients;
+	struct sample a = {}, b = {};
+	struct addrinfo *rp;
+	uint32_t i;
+	int ret = 0;
+
+	if (getaddrinfo(opts.addr, opts.port, NULL, &rp)) {
+		printf("getaddrinfo error\n");
+		return -1;
+	}
+
+	clients = calloc(opts.threads, sizeof(*clients));
+	if (!clients)
+		return -1;
+
+	perf_open();
+	for (i = 0; i < opts.threads; i++) {
+		clients[i].id = i;
+		clients[i].rp = rp;
+		if (pthread_create(&clients[i].thread, NULL, client_worker, &clients[i])) {
+			printf("pthread create failed\n");
+			return -1;
+		}
+	}
+	while (__atomic_load_n(&ready, __ATOMIC_RELAXED) < opts.threads)
+		usleep(1000);
+	for (i = 0; i < opts.threads; i++) {
+		if (clients[i].ret) {
+			stopped = 1;
+			ret = -1;
+		}
+	}
+	printf("HANDSHAKE DONE: %u threads x %u conns x %u streams.\n", opts.threads,
+	       opts.conns, opts.streams);
+	started = 1;
+
+	if (!ret) {
+		sleep(opts.warmup);
+		take_sample(&a);
+		sleep(opts.duration);
+		take_sample(&b);
+		sleep(TAIL_SECS);
+		stopped = 1;
+	}
+
+	for (i = 0; i < opts.threads; i++) {
+		pthread_join(clients[i].thread, NULL);
+		if (clients[i].ret)
+			ret = -1;
+	}
+	if (!ret)
+		print_result("client", &a, &b);
+
+	free(clients);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	opts.threads = 1;
+	opts.conns = 1;
+	opts.streams = 1;
+	opts.msg_len = 16384;
+	opts.cpu = -1;
+	opts.warmup = 2;
+	opts.duration = 10;
+	opts.addr = "::";
+	opts.port = "1234";
+
+	ret = parse_options(argc, argv, &opts);
+	if (ret) {
+		if (ret < 0)
+			printf("parse options error\n");
+		return -1;
+	}
+
+	quic_set_log_level(LOG_NOTICE);
+
+	if (!opts.is_serv)
+		return do_client();
+
+	return do_server();
+}
@@ -0,0 +1,467 @@
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <gnutls/crypto.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sched.h>
+#include <netinet/quic.h>
+#include <sys/syslog.h>
+
+/* QUIC-LB config of the listener: 17-byte IDs with a 4-byte server ID and a 12-byte nonce,
+ * encrypted with Single-Pass Encryption in draft-ietf-quic-load-balancers#section-5.4.1.
+ */
+#define LB_CONFIG_ID		1
+#define LB_SERVER_ID_LEN	4
+#define LB_NONCE_LEN		12
+#define LB_CONN_ID_LEN		(1 + LB_SERVER_ID_LEN + LB_NONCE_LEN)
+
+/* CPU-affine connection IDs: the client's IDs name CLIENT_CPU, while the server only runs on
+ * SERVER_CPU, where the packets it sends over loopback are received.
+ */
+#define SERVER_CPU		0
+#define CLIENT_CPU		1
+
+static const uint8_t lb_server_id[LB_SERVER_ID_LEN] = {0x0a, 0x0b, 0x0c, 0x0d};
+static const uint8_t lb_key[16] = {
+	0x8f, 0x95, 0xf0, 0x92, 0x45, 0x76, 0x5f, 0x80,
+	0x25, 0x69, 0x34, 0xe5, 0x0c, 0x66, 0x20, 0x7f
+};
+
+static const char *parse_address(
+	char const *address, char const *port, struct sockaddr_storage *sas)
+{
+	struct addrinfo hints = {0};
+	struct addrinfo *res;
+	int rc;
+
+	hints.ai_flags = AI_NUMERICHOST|AI_NUMERICSERV;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	rc = getaddrinfo(address, port, &hints, &res);
+	if (rc != 0)
+		return gai_strerror(rc);
+	memcpy(sas, res->ai_addr, res->ai_addrlen);
+	freeaddrinfo(res);
+	return NULL;
+}
+
+/* A counter of all QUIC sockets in this netns, from /proc/net/quic/snmp. */
+static unsigned long long get_mib_stat(const char *stat)
+{
+	unsigned long long val;
+	char name[64];
+	FILE *fp;
+
+	fp = fopen("/proc/net/quic/snmp", "r");
+	if (!fp)
+		return 0;
+	while (fscanf(fp, "%63s %llu", name, &val) == 2) {
+		if (!strcmp(name, stat)) {
+			fclose(fp);
+			return val;
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+static int get_var(const uint8_t **p, const uint8_t *end, uint64_t *val)
+{
+	int i, len = 1 << (**p >> 6);
+
+	if (*p + len > end)
+		return -1;
+	*val = **p & 0x3f;
+	for (i = 1; i < len; i++)
+		*val = (*val << 8) | (*p)[i];
+	*p += len;
+	return 0;
+}
+
+/* Pull a socket's first source connection ID out of its encoded transport parameters
+ * (initial_source_connection_id in rfc9000#section-18.2), while still establishing.
+ */
+static int get_initial_source_conn_id(int sockfd, uint8_t *id, unsigned int *id_len)
+{
+	const uint8_t *p, *end;
+	uint64_t type, len;
+	uint8_t buf[512];
+	unsigned int optlen;
+
+	optlen = sizeof(buf);
+	if (getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_TRANSPORT_PARAM_EXT, buf, &optlen)) {
+		printf("socket getsockopt transport_param_ext error %d\n", errno);
+		return -1;
+	}
+	p = buf;
+	end = buf + optlen;
+	while (p < end) {
+		if (get_var(&p, end, &type) || get_var(&p, end, &len) || p + len > end)
+			break;
+		if (type == 0x0f && len <= 20) {
+			memcpy(id, p, len);
+			*id_len = len;
+			return 0;
+		}
+		p += len;
+	}
+	printf("no initial_source_connection_id in transport params\n");
+	return -1;
+}
+
+/* Recover server ID and nonce from an encrypted ID.  Single-pass encryption is one AES-128-ECB
+ * block, and decrypting one block in CBC mode with a zero IV gives the same result.
+ */
+static int lb_decrypt(const uint8_t *in, uint8_t *out)
+{
+	gnutls_datum_t key = { (void *)lb_key, sizeof(lb_key) };
+	gnutls_cipher_hd_t cipher;
+	uint8_t zero[16] = {};
+	gnutls_datum_t iv;
+	int ret;
+
+	iv.data = zero;
+	iv.size = sizeof(zero);
+	if (gnutls_cipher_init(&cipher, GNUTLS_CIPHER_AES_128_CBC, &key, &iv))
+		return -1;
+	ret = gnutls_cipher_decrypt2(cipher, in, 16, out, 16);
+	gnutls_cipher_deinit(cipher);
+	return ret;
+}
+
+static int check_lb_conn_id(int sockfd)
+{
+	uint8_t id[20], plain[16] = {};
+	unsigned int i, id_len;
+
+	if (get_initial_source_conn_id(sockfd, id, &id_len))
+		return -1;
+	printf("CONNECTION ID:");
+	for (i = 0; i < id_len; i++)
+		printf(" %02x", id[i]);
+	printf("\n");
+
+	/* First octet: config rotation in the top 3 bits, then the length of the rest. */
+	if (id_len != LB_CONN_ID_LEN || id[0] != ((LB_CONFIG_ID << 5) | (LB_CONN_ID_LEN - 1))) {
+		printf("test1: FAIL connection id len %u, first octet %02x\n", id_len, id[0]);
+		return -1;
+	}
+	if (lb_decrypt(id + 1, plain) || memcmp(plain, lb_server_id, LB_SERVER_ID_LEN)) {
+		printf("test1: FAIL server id %02x%02x%02x%02x\n", plain[0], plain[1], plain[2],
+		       plain[3]);
+		return -1;
+	}
+	printf("test1: PASS (connection id carries the encrypted server id)\n");
+	return 0;
+}
+
+static int check_lb_config(int sockfd)
+{
+	struct quic_load_balancer lb = {};
+	uint8_t zero[16] = {};
+	unsigned int optlen;
+
+	optlen = sizeof(lb);
+	if (getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_LOAD_BALANCER, &lb, &optlen)) {
+		printf("socket getsockopt load balancer error %d\n", errno);
+		return -1;
+	}
+	if (lb.config_id != LB_CONFIG_ID || lb.server_id_len != LB_SERVER_ID_LEN ||
+	    lb.nonce_len != LB_NONCE_LEN || !lb.encrypt ||
+	    memcmp(lb.server_id, lb_server_id, LB_SERVER_ID_LEN) ||
+	    memcmp(lb.key, zero, sizeof(zero))) {
+		printf("test0: FAIL config_id %u, server_id_len %u, nonce_len %u\n",
+		       lb.config_id, lb.server_id_len, lb.nonce_len);
+		return -1;
+	}
+	printf("test0: PASS (accept socket inherits the load balancer config, but not the key)\n");
+	return 0;
+}
+
+static int do_echo(int sockfd, const char *str)
+{
+	char msg[64] = {};
+	int ret;
+
+	ret = send(sockfd, str, strlen(str), MSG_SYN | MSG_FIN);
+	if (ret == -1) {
+		printf("send error %d\n", errno);
+		return -1;
+	}
+	ret = recv(sockfd, msg, sizeof(msg) - 1, 0);
+	if (ret == -1) {
+		printf("recv error %d\n", errno);
+		return -1;
+	}
+	return strcmp(msg, str) ? -1 : 0;
+}
+
+static int do_client_lb(int sockfd)
+{
+	struct quic_connection_id_info info = {};
+	unsigned int optlen;
+	uint32_t active;
+
+	if (do_echo(sockfd, "quic-lb test2")) {
+		printf("test2: FAIL\n");
+		return -1;
+	}
+	printf("test2: PASS (packets to the initial connection id reach the server)\n");
+
+	/* Move to a connection ID from NEW_CONNECTION_ID, issued with the same config. */
+	optlen = sizeof(info);
+	info.dest = 1;
+	if (getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CONNECTION_ID, &info, &optlen)) {
+		printf("socket getsockopt connection id error %d\n", errno);
+		return -1;
+	}
+	active = info.active + 1;
+	info.prior_to = active;
+	info.active = active;
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CONNECTION_ID, &info, optlen)) {
+		printf("socket setsockopt connection id error %d\n", errno);
+		return -1;
+	}
+	sleep(1);
+	if (do_echo(sockfd, "quic-lb test3")) {
+		printf("test3: FAIL\n");
+		return -1;
+	}
+	info.dest = 1;
+	if (getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CONNECTION_ID, &info, &optlen) ||
+	    info.active != active) {
+		printf("test3: FAIL active %u, expected %u\n", info.active, active);
+		return -1;
+	}
+	printf("test3: PASS (packets to a new connection id reach the server)\n");
+	return 0;
+}
+
+static int do_client_affinity(struct sockaddr_storage *ra)
+{
+	struct quic_load_balancer lb = {};
+	unsigned int optlen, id_len;
+	unsigned long long steered;
+	int sockfd, cpu = CLIENT_CPU;
+	uint32_t affine = 1;
+	uint8_t id[20];
+
+	sockfd = socket(ra->ss_family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (sockfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	if (setsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu))) {
+		printf("socket setsockopt incoming cpu error %d\n", errno);
+		return -1;
+	}
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CPU_AFFINITY, &affine, sizeof(affine))) {
+		printf("socket setsockopt cpu affinity error %d\n", errno);
+		return -1;
+	}
+	lb.server_id_len = LB_SERVER_ID_LEN;
+	lb.nonce_len = LB_NONCE_LEN;
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_LOAD_BALANCER, &lb, sizeof(lb)) != -1 ||
+	    errno != EINVAL) {
+		printf("test4: FAIL load balancer config is set on a cpu-affine socket\n");
+		return -1;
+	}
+	printf("test4: PASS (not allowed to combine load balancer config with cpu affinity)\n");
+
+	if (connect(sockfd, (struct sockaddr *)ra, sizeof(*ra))) {
+		printf("socket connect failed\n");
+		return -1;
+	}
+	affine = 0;
+	optlen = sizeof(affine);
+	if (getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CPU_AFFINITY, &affine, &optlen) ||
+	    affine != 1) {
+		printf("test5: FAIL affine %u\n", affine);
+		return -1;
+	}
+	if (get_initial_source_conn_id(sockfd, id, &id_len))
+		return -1;
+	if (id_len != 8 || (id[0] & 0xe0) != 0xe0 || ((id[1] << 8) | id[2]) != cpu) {
+		printf("test5: FAIL connection id len %u, %02x %02x %02x\n", id_len, id[0], id[1],
+		       id[2]);
+		return -1;
+	}
+	printf("test5: PASS (connection id carries the cpu set by SO_INCOMING_CPU)\n");
+
+	steered = get_mib_stat("QuicPktRcvSteered");
+	if (quic_client_handshake(sockfd, NULL, NULL, NULL))
+		return -1;
+	if (do_echo(sockfd, "cpu affinity test6") || do_echo(sockfd, "cpu affinity test6")) {
+		printf("test6: FAIL\n");
+		return -1;
+	}
+	if (get_mib_stat("QuicPktRcvSteered") <= steered) {
+		printf("test6: FAIL no packets steered\n");
+		return -1;
+	}
+	printf("test6: PASS (packets received on another cpu are steered to the owning cpu)\n");
+	close(sockfd);
+	return 0;
+}
+
+static int do_client(int argc, char *argv[])
+{
+	struct sockaddr_storage ra = {};
+	const char *rc;
+	int sockfd;
+
+	if (argc < 4) {
+		printf("%s client <PEER ADDR> <PEER PORT>\n", argv[0]);
+		return 0;
+	}
+
+	rc = parse_address(argv[2], argv[3], &ra);
+	if (rc != NULL) {
+		printf("parse address failed: %s\n", rc);
+		return -1;
+	}
+
+	sockfd = socket(ra.ss_family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (sockfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	if (connect(sockfd, (struct sockaddr *)&ra, sizeof(ra))) {
+		printf("socket connect failed\n");
+		return -1;
+	}
+	if (quic_client_handshake(sockfd, NULL, NULL, NULL))
+		return -1;
+	if (do_client_lb(sockfd))
+		return -1;
+	close(sockfd);
+
+	if (sysconf(_SC_NPROCESSORS_ONLN) <= CLIENT_CPU) {
+		printf("test4: SKIP (cpu affinity needs %d cpus)\n", CLIENT_CPU + 1);
+		return 0;
+	}
+	return do_client_affinity(&ra);
+}
+
+static int do_server_echo(int sockfd)
+{
+	char msg[64];
+	int i, ret;
+
+	for (i = 0; i < 2; i++) {
+		memset(msg, 0, sizeof(msg));
+		ret = recv(sockfd, msg, sizeof(msg) - 1, 0);
+		if (ret == -1) {
+			printf("recv error %d\n", errno);
+			return -1;
+		}
+		ret = send(sockfd, msg, strlen(msg), MSG_SYN | MSG_FIN);
+		if (ret == -1) {
+			printf("send error %d\n", errno);
+			return -1;
+		}
+	}
+	recv(sockfd, msg, sizeof(msg), 0); /* Wait for the client to close. */
+	return 0;
+}
+
+static int do_server(int argc, char *argv[])
+{
+	struct sockaddr_storage la = {}, ra = {};
+	struct quic_load_balancer lb = {};
+	int listenfd, sockfd;
+	unsigned int addrlen;
+	const char *rc;
+	cpu_set_t cpus;
+
+	if (argc < 6) {
+		printf("%s server <LOCAL ADDR> <LOCAL PORT> <PRIVATE_KEY_FILE> "
+		       "<CERTIFICATE_FILE>\n", argv[0]);
+		return 0;
+	}
+
+	rc = parse_address(argv[2], argv[3], &la);
+	if (rc != NULL) {
+		printf("parse address failed: %s\n", rc);
+		return -1;
+	}
+	listenfd = socket(la.ss_family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (listenfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	if (bind(listenfd, (struct sockaddr *)&la, sizeof(la))) {
+		printf("socket bind failed\n");
+		return -1;
+	}
+
+	lb.config_id = LB_CONFIG_ID;
+	lb.server_id_len = LB_SERVER_ID_LEN;
+	lb.nonce_len = LB_NONCE_LEN - 1; /* Single-pass encryption needs exactly 16 bytes. */
+	lb.encrypt = 1;
+	memcpy(lb.server_id, lb_server_id, LB_SERVER_ID_LEN);
+	memcpy(lb.key, lb_key, sizeof(lb_key));
+	if (setsockopt(listenfd, SOL_QUIC, QUIC_SOCKOPT_LOAD_BALANCER, &lb, sizeof(lb)) != -1 ||
+	    errno != EINVAL) {
+		printf("socket setsockopt load balancer with a bad nonce_len succeeded\n");
+		return -1;
+	}
+	lb.nonce_len = LB_NONCE_LEN;
+	if (setsockopt(listenfd, SOL_QUIC, QUIC_SOCKOPT_LOAD_BALANCER, &lb, sizeof(lb))) {
+		printf("socket setsockopt load balancer failed\n");
+		return -1;
+	}
+	if (listen(listenfd, 1)) {
+		printf("socket listen failed\n");
+		return -1;
+	}
+
+	/* Send from one cpu only, so that the client's cpu-affine connection receives
+	 * packets on a cpu other than the one its connection IDs name.
+	 */
+	CPU_ZERO(&cpus);
+	CPU_SET(SERVER_CPU, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+		printf("sched_setaffinity failed %d\n", errno);
+		return -1;
+	}
+
+	while (1) {
+		addrlen = sizeof(ra);
+		sockfd = accept(listenfd, (struct sockaddr *)&ra, &addrlen);
+		if (sockfd < 0) {
+			printf("socket accept failed %d %d\n", errno, sockfd);
+			return -1;
+		}
+		if (check_lb_config(sockfd) || check_lb_conn_id(sockfd))
+			return -1;
+		if (quic_server_handshake(sockfd, argv[4], argv[5], NULL))
+			return -1;
+		if (do_server_echo(sockfd))
+			return -1;
+		close(sockfd);
+	}
+	close(listenfd);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2 || (strcmp(argv[1], "server") && strcmp(argv[1], "client"))) {
+		printf("%s server|client ...\n", argv[0]);
+		return 0;
+	}
+
+	quic_set_log_level(LOG_NOTICE);
+
+	if (!strcmp(argv[1], "client"))
+		return do_client(argc, argv);
+
+	return do_server(argc, argv);
+}
@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/quic.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+/* Lists QUIC sockets through sock_diag, like 'ss', with the filters done in the kernel by
+ * inet_diag bytecode.  It exits with 1 if no socket matched, so scripts can check for one.
+ */
+
+#define TCPF_ESTABLISHED	(1 << 1)
+#define TCPF_SYN_RECV		(1 << 3)
+#define TCPF_CLOSE		(1 << 7)
+#define TCPF_LISTEN		(1 << 10)
+
+struct options {
+	char *saddr;
+	char *daddr;
+	uint16_t sport;
+	uint16_t dport;
+	uint32_t states;
+	uint8_t family;
+	uint8_t info;
+	uint8_t count;
+};
+
+static struct options opts;
+
+static struct option long_options[] = {
+	{"listening",	no_argument,		0,	'l'},
+	{"all",		no_argument,		0,	'a'},
+	{"info",	no_argument,		0,	'i'},
+	{"count",	no_argument,		0,	'c'},
+	{"saddr",	required_argument,	0,	'S'},
+	{"daddr",	required_argument,	0,	'D'},
+	{"sport",	required_argument,	0,	's'},
+	{"dport",	required_argument,	0,	'd'},
+	{"ipv4",	no_argument,		0,	'4'},
+	{"ipv6",	no_argument,		0,	'6'},
+	{"help",	no_argument,		0,	'h'},
+	{0,		0,			0,	 0 }
+};
+
+static void print_usage(char *cmd)
+{
+	printf("%s:\n\n", cmd);
+	printf("    --listening/-l:         list listening sockets only\n");
+	printf("    --all/-a:               list sockets in all states\n");
+	printf("    --info/-i:              show congestion, RTT, stream and CID details\n");
+	printf("    --count/-c:             only print the number of sockets and dump time\n");
+	printf("    --saddr/-S <S>:         local address to match\n");
+	printf("    --daddr/-D <D>:         peer address to match\n");
+	printf("    --sport/-s <s>:         local port to match\n");
+	printf("    --dport/-d <d>:         peer port to match\n");
+	printf("    --ipv4/-4:              IPv4 sockets only\n");
+	printf("    --ipv6/-6:              IPv6 sockets only\n");
+	printf("    --help/-h <h>:          show help\n\n");
+}
+
+static int parse_options(int argc, char *argv[], struct options *opts)
+{
+	int c, option_index = 0;
+
+	opts->states = TCPF_ESTABLISHED | TCPF_SYN_RECV;
+	while (1) {
+		c = getopt_long(argc, argv, "laicS:D:s:d:46h", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'l':
+			opts->states = TCPF_LISTEN;
+			break;
+		case 'a':
+			opts->states = TCPF_ESTABLISHED | TCPF_SYN_RECV | TCPF_CLOSE | TCPF_LISTEN;
+			break;
+		case 'i':
+			opts->info = 1;
+			break;
+		case 'c':
+			opts->count = 1;
+			break;
+		case 'S':
+			opts->saddr = optarg;
+			break;
+		case 'D':
+			opts->daddr = optarg;
+			break;
+		case 's':
+			opts->sport = atoi(optarg);
+			break;
+		case 'd':
+			opts->dport = atoi(optarg);
+			break;
+		case '4':
+			opts->family = AF_INET;
+			break;
+		case '6':
+			opts->family = AF_INET6;
+			break;
+		case 'h':
+			print_usage(argv[0]);
+			return 1;
+		default:
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* The filter is a chain of conditions that all have to match: each op jumps to the next one
+ * on a match, and past the end of the bytecode, which rejects the socket, on a mismatch.
+ */
+struct filter {
+	uint8_t buf[256];
+	uint32_t len;
+	uint32_t ops[8];
+	uint32_t nops;
+};
+
+static void filter_add(struct filter *f, uint8_t code, void *data, uint32_t len)
+{
+	struct inet_diag_bc_op *op = (void *)(f->buf + f->len);
+
+	op->code = code;
+	op->yes = sizeof(*op) + len;
+	memcpy(op + 1, data, len);
+	f->ops[f->nops++] = f->len;
+	f->len += op->yes;
+}
+
+static void filter_port(struct filter *f, uint8_t code, uint16_t port)
+{
+	struct inet_diag_bc_op op = { .no = port };
+
+	filter_add(f, code, &op, sizeof(op));
+}
+
+static int filter_addr(struct filter *f, uint8_t code, const char *addr, uint8_t family)
+{
+	struct {
+		struct inet_diag_hostcond cond;
+		uint8_t addr[16];
+	} c = {};
+
+	c.cond.family = family;
+	c.cond.port = -1;
+	c.cond.prefix_len = family == AF_INET ? 32 : 128;
+	if (inet_pton(family, addr, c.addr) != 1)
+		return -1;
+	filter_add(f, code, &c, sizeof(c.cond) + c.cond.prefix_len / 8);
+	return 0;
+}
+
+static void filter_end(struct filter *f)
+{
+	struct inet_diag_bc_op *op;
+	uint32_t i;
+
+	for (i = 0; i < f->nops; i++) {
+		op = (void *)(f->buf + f->ops[i]);
+		op->no = f->len - f->ops[i] + sizeof(*op);
+	}
+}
+
+static uint8_t addr_family(const char *addr)
+{
+	return strchr(addr, ':') ? AF_INET6 : AF_INET;
+}
+
+static int filter_build(struct filter *f, uint8_t family)
+{
+	memset(f, 0, sizeof(*f));
+	if (opts.sport)
+		filter_port(f, INET_DIAG_BC_S_EQ, opts.sport);
+	if (opts.dport)
+		filter_port(f, INET_DIAG_BC_D_EQ, opts.dport);
+	if (opts.saddr) {
+		if (addr_family(opts.saddr) != family)
+			return 1;
+		if (filter_addr(f, INET_DIAG_BC_S_COND, opts.saddr, family))
+			return -1;
+	}
+	if (opts.daddr) {
+		if (addr_family(opts.daddr) != family)
+			return 1;
+		if (filter_addr(f, INET_DIAG_BC_D_COND, opts.daddr, family))
+			return -1;
+	}
+	filter_end(f);
+	return 0;
+}
+
+static const char *state_name(uint8_t state)
+{
+	switch (state) {
+	case 1:
+		return "ESTAB";
+	case 3:
+		return "SYN-RECV";
+	case 7:
+		return "CLOSE";
+	case 10:
+		return "LISTEN";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+static void print_cid(const char *name, uint8_t *cid, uint8_t len)
+{
+	uint8_t i;
+
+	printf(" %s:", name);
+	for (i = 0; i < len && i < QUIC_DIAG_CONN_ID_MAX_LEN; i++)
+		printf("%02x", cid[i]);
+}
+
+static void print_info(struct quic_info *info, const char *cong)
+{
+	printf("\t %s cwnd:%u ssthresh:%u inflight:%u mss:%u pto_count:%u\n",
+	       cong ?: "unknown", info->window, info->ssthresh, info->inflight, info->mss,
+	       info->pto_count);
+	printf("\t rtt:%.3f/%.3f minrtt:%.3f lastrtt:%.3f pto:%.3f pacing_rate:%llu"
+	       "bps\n", info->smoothed_rtt / 1e3, info->rttvar / 1e3, info->min_rtt / 1e3,
+	       info->latest_rtt / 1e3, info->pto / 1e3, info->pacing_rate * 8);
+	printf("\t bytes_sent:%llu bytes_read:%llu streams:%u/%u local %u/%u peer"
+	       " key_phase:%u\n", info->bytes_sent, info->bytes_read, info->local_streams_bidi,
+	       info->local_streams_uni, info->peer_streams_bidi, info->peer_streams_uni,
+	       info->key_phase);
+	printf("\t");
+	print_cid("scid", info->scid, info->scid_len);
+	print_cid("dcid", info->dcid, info->dcid_len);
+	printf("\n");
+}
+
+static void print_sock(struct inet_diag_msg *r, int len)
+{
+	char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN], local[64], peer[64];
+	struct quic_info *info = NULL;
+	struct rtattr *attr;
+	const char *cong = NULL;
+
+	inet_ntop(r->idiag_family, r->id.idiag_src, src, sizeof(src));
+	inet_ntop(r->idiag_family, r->id.idiag_dst, dst, sizeof(dst));
+	snprintf(local, sizeof(local), r->idiag_family == AF_INET6 ? "[%s]:%u" : "%s:%u", src,
+		 ntohs(r->id.idiag_sport));
+	snprintf(peer, sizeof(peer), r->idiag_family == AF_INET6 ? "[%s]:%u" : "%s:%u", dst,
+		 ntohs(r->id.idiag_dport));
+	printf("%-10s %-8u %-8u %-40s %-40s uid:%u ino:%u\n", state_name(r->idiag_state),
+	       r->idiag_rqueue, r->idiag_wqueue, local, peer, r->idiag_uid, r->idiag_inode);
+	if (!opts.info)
+		return;
+
+	for (attr = (struct rtattr *)(r + 1); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+		if (attr->rta_type == INET_DIAG_INFO &&
+		    RTA_PAYLOAD(attr) >= sizeof(struct quic_info))
+			info = RTA_DATA(attr);
+		else if (attr->rta_type == INET_DIAG_CONG)
+			cong = RTA_DATA(attr);
+	}
+	if (info && r->idiag_state != 10)
+		print_info(info, cong);
+}
+
+static int do_dump(int fd, uint8_t family, uint64_t *count)
+{
+	struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
+	struct {
+		struct nlmsghdr nlh;
+		struct inet_diag_req_v2 r;
+		uint8_t attrs[512];
+	} req = {};
+	uint32_t protocol = IPPROTO_QUIC;
+	struct nlmsghdr *nlh;
+	struct filter filter;
+	struct rtattr *attr;
+	char buf[32768];
+	int ret, len;
+
+	ret = filter_build(&filter, family);
+	if (ret)
+		return ret < 0 ? -1 : 0; /* No socket of this family can match. */
+
+	req.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.r));
+	req.r.sdiag_family = family;
+	req.r.idiag_states = opts.states;
+	if (opts.info)
+		req.r.idiag_ext = (1 << (INET_DIAG_INFO - 1)) | (1 << (INET_DIAG_CONG - 1));
+
+	/* IPPROTO_QUIC does not fit in sdiag_protocol, so it goes in INET_DIAG_REQ_PROTOCOL. */
+	attr = (struct rtattr *)((char *)&req + NLMSG_ALIGN(req.nlh.nlmsg_len));
+	attr->rta_type = INET_DIAG_REQ_PROTOCOL;
+	attr->rta_len = RTA_LENGTH(sizeof(protocol));
+	memcpy(RTA_DATA(attr), &protocol, sizeof(protocol));
+	req.nlh.nlmsg_len = NLMSG_ALIGN(req.nlh.nlmsg_len) + RTA_ALIGN(attr->rta_len);
+	if (filter.len) {
+		attr = (struct rtattr *)((char *)&req + req.nlh.nlmsg_len);
+		attr->rta_type = INET_DIAG_REQ_BYTECODE;
+		attr->rta_len = RTA_LENGTH(filter.len);
+		memcpy(RTA_DATA(attr), filter.buf, filter.len);
+		req.nlh.nlmsg_len += RTA_ALIGN(attr->rta_len);
+	}
+
+	if (sendto(fd, &req, req.nlh.nlmsg_len, 0, (struct sockaddr *)&nladdr,
+		   sizeof(nladdr)) < 0) {
+		printf("send error %d\n", errno);
+		return -1;
+	}
+
+	while (1) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			printf("recv error %d\n", errno);
+			return -1;
+		}
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (nlh->nlmsg_type == NLMSG_ERROR) {
+				ret = ((struct nlmsgerr *)NLMSG_DATA(nlh))->error;
+				printf("dump error %d%s\n", ret,
+				       ret == -ENOENT ? " (quic_diag not loaded?)" : "");
+				return -1;
+			}
+			(*count)++;
+			if (!opts.count)
+				print_sock(NLMSG_DATA(nlh), nlh->nlmsg_len -
+					   NLMSG_LENGTH(sizeof(struct inet_diag_msg)));
+		}
+	}
+}
+
+static uint64_t get_now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t count = 0, start;
+	int fd, ret;
+
+	ret = parse_options(argc, argv, &opts);
+	if (ret) {
+		if (ret < 0)
+			print_usage(argv[0]);
+		return ret < 0;
+	}
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+	if (fd < 0) {
+		printf("socket error %d\n", errno);
+		return -1;
+	}
+
+	if (!opts.count)
+		printf("%-10s %-8s %-8s %-40s %-40s\n", "State", "Recv-Q", "Send-Q",
+		       "Local Address:Port", "Peer Address:Port");
+	start = get_now_ns();
+	if ((opts.family != AF_INET6 && do_dump(fd, AF_INET, &count)) ||
+	    (opts.family != AF_INET && do_dump(fd, AF_INET6, &count))) {
+		close(fd);
+		return -1;
+	}
+	if (opts.count)
+		printf("%" PRIu64 " sockets dumped in %.3f ms\n", count,
+		       (get_now_ns() - start) / 1e6);
+
+	close(fd);
+	return !count;
+}
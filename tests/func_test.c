@@ -1,6 +1,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <poll.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <linux/tls.h>
@@ -12,6 +13,7 @@
 
 #define MSG_LEN	4096
 char msg[MSG_LEN + 1];
+static char bulk[262144];
 
 static const char *parse_address(
 	char const *address, char const *port, struct sockaddr_storage *sas)
@@ -47,6 +49,26 @@ static void set_port(struct sockaddr_storage *sas, unsigned short port)
 		((struct sockaddr_in6 *)sas)->sin6_port = htons(port);
 }
 
+/* A counter of all QUIC sockets in this netns, from /proc/net/quic/snmp. */
+static unsigned long long get_mib_stat(const char *stat)
+{
+	unsigned long long val;
+	char name[64];
+	FILE *fp;
+
+	fp = fopen("/proc/net/quic/snmp", "r");
+	if (!fp)
+		return 0;
+	while (fscanf(fp, "%63s %llu", name, &val) == 2) {
+		if (!strcmp(name, stat)) {
+			fclose(fp);
+			return val;
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
 static int do_client_notification_test(int sockfd)
 {
 	struct quic_connection_id_info connid_info = {};
@@ -787,9 +809,17 @@ static int do_client_close_test(int sockfd)
 static int do_client_connection_test(int sockfd)
 {
 	struct quic_connection_id_info info = {};
+	struct quic_transport_param param = {};
+	struct quic_stream_priority prio = {};
+	struct quic_load_balancer lb = {};
+	struct quic_stream_info sinfo = {};
 	struct sockaddr_storage addr = {};
+	struct quic_config config = {};
+	unsigned long long acks, pkts, start_acks, start_pkts;
 	unsigned int optlen, flags;
+	struct pollfd pfd = {};
 	char opt[100] = {};
+	uint32_t lowat, affine;
 	int64_t sid = 0;
 	int ret, port;
 
@@ -1276,6 +1306,351 @@ static int do_client_connection_test(int sockfd)
 		return -1;
 	}
 	printf("test27: PASS (do not allow to send datagram bigger than max_datagram)\n");
+
+	lowat = 4096;
+	optlen = sizeof(lowat);
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_NOTSENT_LOWAT, &lowat, optlen);
+	if (ret == -1) {
+		printf("socket setsockopt notsent_lowat error %d\n", errno);
+		return -1;
+	}
+	lowat = 0;
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_NOTSENT_LOWAT, &lowat, &optlen);
+	if (ret == -1 || lowat != 4096) {
+		printf("test28: FAIL ret %d, lowat %u\n", ret, lowat);
+		return -1;
+	}
+	printf("test28: PASS (set and get notsent_lowat)\n");
+
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_NOTSENT_LOWAT, &lowat, 1);
+	if (ret != -1 || errno != EINVAL) {
+		printf("test29: FAIL ret %d, error %d\n", ret, errno);
+		return -1;
+	}
+	lowat = 0;
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_NOTSENT_LOWAT, &lowat, optlen);
+	if (ret == -1) {
+		printf("socket setsockopt notsent_lowat error %d\n", errno);
+		return -1;
+	}
+	printf("test29: PASS (not allowed to set notsent_lowat with a short optlen)\n");
+
+	memset(&param, 0, sizeof(param));
+	param.remote = 1;
+	optlen = sizeof(param);
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_TRANSPORT_PARAM, &param, &optlen);
+	if (ret == -1 || param.min_ack_delay != 1000) {
+		printf("test30: FAIL ret %d, min_ack_delay %u\n", ret, param.min_ack_delay);
+		return -1;
+	}
+	printf("test30: PASS (get min_ack_delay from peer transport parameters)\n");
+
+	optlen = sizeof(config);
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CONFIG, &config, &optlen);
+	if (ret == -1 || config.ack_eliciting_threshold != 2 ||
+	    config.ack_reordering_threshold != 1) {
+		printf("test31: FAIL ret %d, ack_eliciting_threshold %u, "
+		       "ack_reordering_threshold %u\n", ret, config.ack_eliciting_threshold,
+		       config.ack_reordering_threshold);
+		return -1;
+	}
+	printf("test31: PASS (get ack policy from config)\n");
+
+	config.ack_eliciting_threshold = 10;
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CONFIG, &config, optlen);
+	if (ret != -1 || errno != EINVAL) {
+		printf("test32: FAIL ret %d, error %d\n", ret, errno);
+		return -1;
+	}
+	printf("test32: PASS (not allowed to change ack policy after handshake)\n");
+
+	optlen = sizeof(sinfo);
+	sinfo.stream_id = -1;
+	sinfo.stream_flags = 0;
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_OPEN, &sinfo, &optlen);
+	if (ret == -1) {
+		printf("socket getsockopt stream open error %d\n", errno);
+		return -1;
+	}
+	prio.stream_id = sinfo.stream_id;
+	prio.urgency = 8;
+	prio.incremental = 0;
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_PRIORITY, &prio, sizeof(prio));
+	if (ret != -1 || errno != EINVAL) {
+		printf("test33: FAIL ret %d, error %d\n", ret, errno);
+		return -1;
+	}
+	printf("test33: PASS (not allowed to set stream urgency out of range)\n");
+
+	optlen = sizeof(prio);
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_PRIORITY, &prio, &optlen);
+	if (ret == -1 || prio.urgency != 3 || prio.incremental || prio.weight != 16) {
+		printf("test34: FAIL ret %d, urgency %u, incremental %u, weight %u\n", ret,
+		       prio.urgency, prio.incremental, prio.weight);
+		return -1;
+	}
+	printf("test34: PASS (get default stream priority)\n");
+
+	prio.weight = 257;
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_PRIORITY, &prio, sizeof(prio));
+	if (ret != -1 || errno != EINVAL) {
+		printf("test35: FAIL ret %d, error %d\n", ret, errno);
+		return -1;
+	}
+	prio.incremental = 1;
+	prio.weight = 0;
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_PRIORITY, &prio, sizeof(prio));
+	if (ret == -1) {
+		printf("socket setsockopt stream priority error %d\n", errno);
+		return -1;
+	}
+	optlen = sizeof(prio);
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_PRIORITY, &prio, &optlen);
+	if (ret == -1 || !prio.incremental || prio.weight != 16) {
+		printf("test35: FAIL ret %d, incremental %u, weight %u\n", ret, prio.incremental,
+		       prio.weight);
+		return -1;
+	}
+	printf("test35: PASS (stream weight is limited and kept when set to 0)\n");
+
+	/* The server answers on this stream with a bulk reply at urgency 7 until it is blocked
+	 * by flow control, then sends a short reply on its own bidi stream 1 at urgency 0, and
+	 * the end of the bulk reply last.  The urgent reply must not wait for the bulk one.
+	 */
+	strcpy(msg, "client priority");
+	ret = quic_sendmsg(sockfd, msg, strlen(msg), sinfo.stream_id, MSG_QUIC_STREAM_FIN);
+	if (ret == -1) {
+		printf("send error %d\n", errno);
+		return -1;
+	}
+	while (1) {
+		flags = 0;
+		memset(msg, 0, sizeof(msg));
+		ret = quic_recvmsg(sockfd, msg, sizeof(msg), &sid, &flags);
+		if (ret == -1) {
+			printf("recv error %d\n", errno);
+			return -1;
+		}
+		if (flags & MSG_QUIC_NOTIFICATION)
+			continue;
+		if (flags & MSG_QUIC_STREAM_FIN)
+			break;
+	}
+	if (sid != 1 || strcmp(msg, "server priority")) {
+		printf("test36: FAIL msg %s, sid %d\n", msg, (int)sid);
+		return -1;
+	}
+	while (1) {
+		flags = 0;
+		ret = quic_recvmsg(sockfd, msg, sizeof(msg), &sid, &flags);
+		if (ret == -1) {
+			printf("recv error %d\n", errno);
+			return -1;
+		}
+		if (sid == sinfo.stream_id && (flags & MSG_QUIC_STREAM_FIN))
+			break;
+	}
+	printf("test36: PASS (urgent stream data is sent ahead of bulk stream data)\n");
+
+	optlen = sizeof(lb);
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_LOAD_BALANCER, &lb, &optlen);
+	if (ret == -1 || lb.server_id_len) {
+		printf("test37: FAIL ret %d, server_id_len %u\n", ret, lb.server_id_len);
+		return -1;
+	}
+	lb.server_id_len = 4;
+	lb.nonce_len = 8;
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_LOAD_BALANCER, &lb, sizeof(lb));
+	if (ret != -1 || errno != EINVAL) {
+		printf("test37: FAIL ret %d, error %d\n", ret, errno);
+		return -1;
+	}
+	printf("test37: PASS (not allowed to set load balancer config after connect)\n");
+
+	optlen = sizeof(affine);
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CPU_AFFINITY, &affine, &optlen);
+	if (ret == -1 || affine) {
+		printf("test38: FAIL ret %d, affine %u\n", ret, affine);
+		return -1;
+	}
+	affine = 1;
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CPU_AFFINITY, &affine, optlen);
+	if (ret != -1 || errno != EINVAL) {
+		printf("test38: FAIL ret %d, error %d\n", ret, errno);
+		return -1;
+	}
+	printf("test38: PASS (not allowed to change cpu affinity after connect)\n");
+
+	/* Data corked by MSG_MORE stays unsent, which keeps the socket unwritable with the
+	 * unsent data above notsent_lowat until a send pushes it out.
+	 */
+	lowat = 512;
+	optlen = sizeof(lowat);
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_NOTSENT_LOWAT, &lowat, optlen);
+	if (ret == -1) {
+		printf("socket setsockopt notsent_lowat error %d\n", errno);
+		return -1;
+	}
+	optlen = sizeof(sinfo);
+	sinfo.stream_id = -1;
+	sinfo.stream_flags = 0;
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_OPEN, &sinfo, &optlen);
+	if (ret == -1) {
+		printf("socket getsockopt stream open error %d\n", errno);
+		return -1;
+	}
+	memset(msg, 0, sizeof(msg));
+	strcpy(msg, "client lowat");
+	ret = quic_sendmsg(sockfd, msg, 1000, sinfo.stream_id, MSG_MORE);
+	if (ret != 1000) {
+		printf("send error %d %d\n", ret, errno);
+		return -1;
+	}
+	pfd.fd = sockfd;
+	pfd.events = POLLOUT;
+	ret = poll(&pfd, 1, 0);
+	if (ret) {
+		printf("test39: FAIL ret %d, revents %d\n", ret, pfd.revents);
+		return -1;
+	}
+	printf("test39: PASS (not writable while unsent data is above notsent_lowat)\n");
+
+	ret = quic_sendmsg(sockfd, msg, 1, sinfo.stream_id, MSG_DONTWAIT);
+	if (ret != -1 || errno != EAGAIN) {
+		printf("test40: FAIL ret %d, error %d\n", ret, errno);
+		return -1;
+	}
+	ret = poll(&pfd, 1, 2000);
+	if (ret != 1 || !(pfd.revents & POLLOUT)) {
+		printf("test40: FAIL ret %d, revents %d\n", ret, pfd.revents);
+		return -1;
+	}
+	printf("test40: PASS (writable once unsent data is sent below notsent_lowat)\n");
+
+	lowat = 0;
+	optlen = sizeof(lowat);
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_NOTSENT_LOWAT, &lowat, optlen);
+	if (ret == -1) {
+		printf("socket setsockopt notsent_lowat error %d\n", errno);
+		return -1;
+	}
+	ret = quic_sendmsg(sockfd, NULL, 0, sinfo.stream_id, MSG_QUIC_STREAM_FIN);
+	if (ret == -1) {
+		printf("send error %d\n", errno);
+		return -1;
+	}
+	while (1) {
+		flags = 0;
+		memset(msg, 0, sizeof(msg));
+		ret = quic_recvmsg(sockfd, msg, sizeof(msg), &sid, &flags);
+		if (ret == -1) {
+			printf("recv error %d\n", errno);
+			return -1;
+		}
+		if (sid == sinfo.stream_id && (flags & MSG_QUIC_STREAM_FIN))
+			break;
+	}
+	if (strcmp(msg, "client lowat")) {
+		printf("test41: FAIL msg %s\n", msg);
+		return -1;
+	}
+	printf("test41: PASS (corked data is delivered after the notsent_lowat wait)\n");
+
+	/* The server sends a bulk reply, which this side ACKs every 2 ack-eliciting packets
+	 * under its local ACK policy, plus the ACKs sent when the ack delay timer fires.  Both
+	 * ends share the MIB of this netns, but the server sends little else than the bulk
+	 * data, and this side little else than ACKs.
+	 */
+	start_acks = get_mib_stat("QuicFrmOutAcks");
+	start_pkts = get_mib_stat("QuicPktOutApps");
+	optlen = sizeof(sinfo);
+	sinfo.stream_id = -1;
+	sinfo.stream_flags = 0;
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_OPEN, &sinfo, &optlen);
+	if (ret == -1) {
+		printf("socket getsockopt stream open error %d\n", errno);
+		return -1;
+	}
+	strcpy(msg, "client ack_rate");
+	ret = quic_sendmsg(sockfd, msg, strlen(msg), sinfo.stream_id, MSG_QUIC_STREAM_FIN);
+	if (ret == -1) {
+		printf("send error %d\n", errno);
+		return -1;
+	}
+	while (1) {
+		flags = 0;
+		ret = quic_recvmsg(sockfd, msg, sizeof(msg), &sid, &flags);
+		if (ret == -1) {
+			printf("recv error %d\n", errno);
+			return -1;
+		}
+		if (sid == sinfo.stream_id && (flags & MSG_QUIC_STREAM_FIN))
+			break;
+	}
+	acks = get_mib_stat("QuicFrmOutAcks") - start_acks;
+	pkts = get_mib_stat("QuicPktOutApps") - start_pkts - acks;
+	if (pkts < 100 || acks * 2 + 4 < pkts || acks * 2 > pkts + pkts / 4 + 8) {
+		printf("test42: FAIL acks %llu, packets %llu\n", acks, pkts);
+		return -1;
+	}
+	printf("test42: PASS (ACK every 2 ack-eliciting packets, %llu ACKs for %llu packets)\n",
+	       acks, pkts);
+
+	/* The server has no local ACK eliciting threshold, so it ACKs on the ack delay timer
+	 * alone, a few times per bulk transfer on loopback.  With the min_ack_delay it
+	 * advertised, this side asks it with ACK_FREQUENCY frames to ACK every 2 to 11
+	 * ack-eliciting packets instead.  Both ends share the MIB of this netns, but the
+	 * server sends little else than ACKs, and this side little else than the bulk data
+	 * in the 1-RTT packets that carry no ACK.
+	 */
+	start_acks = get_mib_stat("QuicFrmOutAcks");
+	start_pkts = get_mib_stat("QuicPktOutApps");
+	optlen = sizeof(sinfo);
+	sinfo.stream_id = -1;
+	sinfo.stream_flags = 0;
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_OPEN, &sinfo, &optlen);
+	if (ret == -1) {
+		printf("socket getsockopt stream open error %d\n", errno);
+		return -1;
+	}
+	strcpy(msg, "client ack_frequency");
+	ret = quic_sendmsg(sockfd, msg, strlen(msg), sinfo.stream_id, MSG_QUIC_STREAM_FIN);
+	if (ret == -1) {
+		printf("send error %d\n", errno);
+		return -1;
+	}
+	sinfo.stream_id = -1;
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_OPEN, &sinfo, &optlen);
+	if (ret == -1) {
+		printf("socket getsockopt stream open error %d\n", errno);
+		return -1;
+	}
+	memset(bulk, 'c', sizeof(bulk));
+	ret = quic_sendmsg(sockfd, bulk, sizeof(bulk), sinfo.stream_id, MSG_QUIC_STREAM_FIN);
+	if (ret == -1) {
+		printf("send error %d\n", errno);
+		return -1;
+	}
+	while (1) {
+		flags = 0;
+		memset(msg, 0, sizeof(msg));
+		ret = quic_recvmsg(sockfd, msg, sizeof(msg), &sid, &flags);
+		if (ret == -1) {
+			printf("recv error %d\n", errno);
+			return -1;
+		}
+		if (sid == sinfo.stream_id && (flags & MSG_QUIC_STREAM_FIN))
+			break;
+	}
+	acks = get_mib_stat("QuicFrmOutAcks") - start_acks;
+	pkts = get_mib_stat("QuicPktOutApps") - start_pkts - acks;
+	if (strcmp(msg, "server ack_frequency") || pkts < 100 || acks * 11 + 4 < pkts ||
+	    acks * 2 > pkts + pkts / 4 + 8) {
+		printf("test43: FAIL msg %s, acks %llu, packets %llu\n", msg, acks, pkts);
+		return -1;
+	}
+	printf("test43: PASS (peer ACKs at the ACK_FREQUENCY cadence, %llu ACKs for %llu "
+	       "packets)\n", acks, pkts);
 	return 0;
 }
 
@@ -2057,6 +2432,89 @@ static int do_client_test(int sockfd)
 	return do_client_close_test(sockfd);
 }
 
+static int do_server_priority_test(int sockfd, int64_t sid)
+{
+	struct quic_stream_priority prio = {};
+	struct quic_stream_info sinfo = {};
+	unsigned int optlen;
+	int ret, i;
+
+	prio.stream_id = sid;
+	prio.urgency = 7;
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_PRIORITY, &prio, sizeof(prio));
+	if (ret == -1) {
+		printf("socket setsockopt stream priority error %d\n", errno);
+		return -1;
+	}
+
+	optlen = sizeof(sinfo);
+	sinfo.stream_id = 1;
+	ret = getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_OPEN, &sinfo, &optlen);
+	if (ret == -1) {
+		printf("socket getsockopt stream open error %d\n", errno);
+		return -1;
+	}
+	prio.stream_id = sinfo.stream_id;
+	prio.urgency = 0;
+	ret = setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_PRIORITY, &prio, sizeof(prio));
+	if (ret == -1) {
+		printf("socket setsockopt stream priority error %d\n", errno);
+		return -1;
+	}
+
+	/* Fill the bulk stream until it is blocked by the client's flow control window or by
+	 * the send buffer, so that its FIN is queued only after the urgent reply.
+	 */
+	memset(bulk, 'b', sizeof(bulk));
+	for (i = 0; i < 64; i++) {
+		ret = quic_sendmsg(sockfd, bulk, sizeof(bulk), sid, MSG_DONTWAIT);
+		if (ret == -1) {
+			if (errno == ENOSPC || errno == EAGAIN)
+				break;
+			printf("send %d %d\n", ret, errno);
+			return -1;
+		}
+	}
+	strcpy(msg, "server priority");
+	ret = quic_sendmsg(sockfd, msg, strlen(msg), sinfo.stream_id, MSG_QUIC_STREAM_FIN);
+	if (ret == -1) {
+		printf("send %d %d\n", ret, errno);
+		return -1;
+	}
+	ret = quic_sendmsg(sockfd, bulk, sizeof(bulk), sid, MSG_QUIC_STREAM_FIN);
+	if (ret == -1) {
+		printf("send %d %d\n", ret, errno);
+		return -1;
+	}
+	return 0;
+}
+
+/* Reads the bulk data the client sends on its next stream, and replies on it. */
+static int do_server_ack_freq_test(int sockfd)
+{
+	uint32_t flags = 0;
+	int64_t sid = 0;
+	int ret;
+
+	while (1) {
+		ret = quic_recvmsg(sockfd, bulk, sizeof(bulk), &sid, &flags);
+		if (ret == -1) {
+			printf("recv error %d %d\n", ret, errno);
+			return -1;
+		}
+		if (flags & MSG_QUIC_STREAM_FIN)
+			break;
+		flags = 0;
+	}
+	strcpy(msg, "server ack_frequency");
+	ret = quic_sendmsg(sockfd, msg, strlen(msg), sid, MSG_QUIC_STREAM_FIN);
+	if (ret == -1) {
+		printf("send %d %d\n", ret, errno);
+		return -1;
+	}
+	return 0;
+}
+
 static int do_server_test(int sockfd)
 {
 	struct quic_errinfo errinfo = {};
@@ -2115,6 +2573,28 @@ static int do_server_test(int sockfd)
 		if (!(flags & MSG_QUIC_STREAM_FIN) && !(flags & MSG_QUIC_DATAGRAM))
 			continue;
 
+		if (!strcmp(msg, "client priority")) {
+			if (do_server_priority_test(sockfd, sid))
+				return -1;
+			goto reset;
+		}
+
+		if (!strcmp(msg, "client ack_frequency")) {
+			if (do_server_ack_freq_test(sockfd))
+				return -1;
+			goto reset;
+		}
+
+		if (!strcmp(msg, "client ack_rate")) {
+			memset(bulk, 'b', sizeof(bulk));
+			ret = quic_sendmsg(sockfd, bulk, sizeof(bulk), sid, MSG_QUIC_STREAM_FIN);
+			if (ret == -1) {
+				printf("send %d %d\n", ret, errno);
+				return -1;
+			}
+			goto reset;
+		}
+
 		if (!strcmp(msg, "client migration")) {
 			optlen = sizeof(addr);
 			ret = getsockname(sockfd, (struct sockaddr *)&addr, &optlen);
@@ -2200,6 +2680,7 @@ static int do_client(int argc, char *argv[])
 {
 	struct quic_transport_param param = {};
 	struct sockaddr_storage ra = {};
+	struct quic_config config = {};
 	char *pkey = NULL;
 	const char *rc;
 	int sockfd;
@@ -2226,6 +2707,9 @@ static int do_client(int argc, char *argv[])
 		return -1;
 	}
 
+	/* No min_ack_delay on this side, so the server does not replace the local ACK policy
+	 * below with ACK_FREQUENCY frames.
+	 */
 	param.max_datagram_frame_size = 1400;
 	if (argc < 5)
 		goto start;
@@ -2234,6 +2718,11 @@ start:
 	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_TRANSPORT_PARAM, &param, sizeof(param)))
 		return -1;
 
+	config.ack_eliciting_threshold = 2;
+	config.ack_reordering_threshold = 1;
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CONFIG, &config, sizeof(config)))
+		return -1;
+
 	if (quic_client_handshake(sockfd, pkey, NULL, NULL))
 		return -1;
 	printf("HANDSHAKE DONE\n");
@@ -2282,6 +2771,7 @@ static int do_server(int argc, char *argv[])
 	}
 
 	param.max_datagram_frame_size = 1400;
+	param.min_ack_delay = 1000;
 	pkey = argv[4];
 	cert = argv[5];
 
@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include <netinet/quic.h>
+#include <sys/epoll.h>
+#include <sys/syslog.h>
+#include <sys/resource.h>
+
+#define ALPN		"sample"
+#define SECONDS		1000000
+#define MAX_THREADS	1024
+
+struct options {
+	char *pkey;
+	char *cert;
+	char *addr;
+	char *port;
+	uint8_t is_serv;
+	uint8_t hold;
+	uint8_t trace;
+	uint32_t threads;
+	uint32_t conns;
+};
+
+static struct options opts;
+
+/* A log-linear histogram in the style of HdrHistogram: values below 2^HIST_SUB_BITS are
+ * counted exactly, and each power of two above is split into 2^(HIST_SUB_BITS - 1) buckets,
+ * which keeps the relative error of any recorded value under 1%.
+ */
+#define HIST_SUB_BITS	8
+#define HIST_SUB_COUNT	(1U << HIST_SUB_BITS)
+#define HIST_SUB_HALF	(HIST_SUB_COUNT / 2)
+#define HIST_SIZE	((64 - HIST_SUB_BITS + 2) * HIST_SUB_HALF)
+
+struct hist {
+	uint64_t counts[HIST_SIZE];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t max;
+};
+
+static uint32_t hist_index(uint64_t v)
+{
+	uint32_t shift;
+
+	if (v < HIST_SUB_COUNT)
+		return v;
+	shift = 63 - __builtin_clzll(v) - (HIST_SUB_BITS - 1);
+	return shift * HIST_SUB_HALF + (v >> shift);
+}
+
+/* The middle of the range of values counted in bucket 'i'. */
+static uint64_t hist_value(uint32_t i)
+{
+	uint32_t shift;
+
+	if (i < HIST_SUB_COUNT)
+		return i;
+	shift = i / HIST_SUB_HALF - 1;
+	return ((uint64_t)(i - shift * HIST_SUB_HALF) << shift) + (1ULL << (shift - 1));
+}
+
+static void hist_record(struct hist *h, uint64_t v)
+{
+	h->counts[hist_index(v)]++;
+	h->total++;
+	h->sum += v;
+	if (v > h->max)
+		h->max = v;
+}
+
+static void hist_merge(struct hist *h, struct hist *from)
+{
+	uint32_t i;
+
+	for (i = 0; i < HIST_SIZE; i++)
+		h->counts[i] += from->counts[i];
+	h->total += from->total;
+	h->sum += from->sum;
+	if (from->max > h->max)
+		h->max = from->max;
+}
+
+static uint64_t hist_percentile(struct hist *h, double p)
+{
+	uint64_t rank = (uint64_t)(p / 100 * h->total + 0.5), seen = 0;
+	uint32_t i;
+
+	if (!rank)
+		rank = 1;
+	for (i = 0; i < HIST_SIZE; i++) {
+		seen += h->counts[i];
+		if (seen >= rank)
+			return hist_value(i) < h->max ? hist_value(i) : h->max;
+	}
+	return h->max;
+}
+
+/* Prints the latencies recorded in ns as us. */
+static void hist_print(const char *name, struct hist *h)
+{
+	double us = 1000;
+
+	if (!h->total) {
+		printf("  %-28s no samples\n", name);
+		return;
+	}
+	printf("  %-28s mean %8.1f  p50 %8.1f  p90 %8.1f  p99 %8.1f  p99.9 %8.1f  max %8.1f\n",
+	       name, (double)h->sum / h->total / us, hist_percentile(h, 50) / us,
+	       hist_percentile(h, 90) / us, hist_percentile(h, 99) / us,
+	       hist_percentile(h, 99.9) / us, h->max / us);
+}
+
+static struct option long_options[] = {
+	{"addr",	required_argument,	0,	'a'},
+	{"port",	required_argument,	0,	'p'},
+	{"pkey",	required_argument,	0,	'k'},
+	{"cert",	required_argument,	0,	'c'},
+	{"threads",	required_argument,	0,	'T'},
+	{"conns",	required_argument,	0,	'C'},
+	{"hold",	no_argument,		0,	'H'},
+	{"trace",	no_argument,		0,	't'},
+	{"listen",	no_argument,		0,	'l'},
+	{"help",	no_argument,		0,	'h'},
+	{0,		0,			0,	 0 }
+};
+
+static void print_usage(char *cmd)
+{
+	printf("%s:\n\n", cmd);
+	printf("    --listen/-l:            work as a server\n");
+	printf("    --addr/-a <a>:          server IP address\n");
+	printf("    --port/-p <p>:          server port\n");
+	printf("    --pkey/-k <k>:          private key file\n");
+	printf("    --cert/-c <c>:          certificate file\n");
+	printf("    --help/-h <h>:          show help\n");
+	printf("    --threads/-T <T>:       threads doing handshakes\n");
+	printf("    --conns/-C <C>:         connections to set up in total (client)\n");
+	printf("    --hold/-H:              keep connections open until all are set up (client)\n");
+	printf("    --trace/-t:             break server setup time down with the quic\n");
+	printf("                            tracepoints (client, on the server host)\n\n");
+}
+
+static int parse_options(int argc, char *argv[], struct options *opts)
+{
+	int c, option_index = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, "la:p:k:c:T:C:Hth", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'l':
+			opts->is_serv = 1;
+			break;
+		case 'a':
+			opts->addr = optarg;
+			break;
+		case 'p':
+			opts->port = optarg;
+			break;
+		case 'k':
+			opts->pkey = optarg;
+			break;
+		case 'c':
+			opts->cert = optarg;
+			break;
+		case 'T':
+			opts->threads = atoi(optarg);
+			if (!opts->threads || opts->threads > MAX_THREADS)
+				return -1;
+			break;
+		case 'C':
+			opts->conns = atoi(optarg);
+			if (!opts->conns)
+				return -1;
+			break;
+		case 'H':
+			opts->hold = 1;
+			break;
+		case 't':
+			opts->trace = 1;
+			break;
+		case 'h':
+			print_usage(argv[0]);
+			return 1;
+		default:
+			return -1;
+		}
+	}
+
+	if (opts->is_serv && (!opts->cert || !opts->pkey))
+		return -1;
+	return 0;
+}
+
+static uint64_t get_now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* Every connection holds a file descriptor on both sides with --hold. */
+static void raise_nofile_limit(void)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl))
+		return;
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+/* Tracing through tracefs: the quic tracepoints are enabled around the run, and the trace
+ * buffer is parsed afterwards to split the server's setup time into the kernel phases
+ * reported by quic_accept, and the handshake from accept() to quic_handshake_done, most
+ * of which is the userspace TLS handshake.
+ */
+static const char *tracefs;
+static const char *trace_events[] = {
+	"quic_conn_request",
+	"quic_accept",
+	"quic_handshake_done",
+};
+
+static int trace_write(const char *file, const char *val)
+{
+	char path[256];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/%s", tracefs, file);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, val, strlen(val));
+	close(fd);
+	return ret < 0 ? -1 : 0;
+}
+
+static int trace_enable(int on)
+{
+	char file[128];
+	uint32_t i;
+
+	for (i = 0; i < sizeof(trace_events) / sizeof(trace_events[0]); i++) {
+		snprintf(file, sizeof(file), "events/quic/%s/enable", trace_events[i]);
+		if (trace_write(file, on ? "1" : "0"))
+			return -1;
+	}
+	return 0;
+}
+
+static int trace_start(void)
+{
+	if (!access("/sys/kernel/tracing/events/quic", F_OK))
+		tracefs = "/sys/kernel/tracing";
+	else if (!access("/sys/kernel/debug/tracing/events/quic", F_OK))
+		tracefs = "/sys/kernel/debug/tracing";
+	if (!tracefs) {
+		printf("no quic tracepoints found in tracefs\n");
+		return -1;
+	}
+	if (trace_write("buffer_size_kb", "16384") || trace_write("trace", "") ||
+	    trace_enable(1)) {
+		printf("tracefs setup failed %d\n", errno);
+		trace_enable(0);
+		return -1;
+	}
+	return 0;
+}
+
+/* Accept timestamps by nsk, to match the quic_handshake_done events of the same socket. */
+#define TRACE_HASH_SIZE	(1 << 16)
+
+struct trace_sock {
+	uint64_t sk;
+	double ts;
+};
+
+static struct trace_sock *trace_sock_get(struct trace_sock *socks, uint64_t sk)
+{
+	uint32_t i = (sk ^ (sk >> 16) ^ (sk >> 32)) & (TRACE_HASH_SIZE - 1), n;
+
+	for (n = 0; n < TRACE_HASH_SIZE; n++, i = (i + 1) & (TRACE_HASH_SIZE - 1))
+		if (!socks[i].sk || socks[i].sk == sk)
+			return &socks[i];
+	return NULL;
+}
+
+/* Returns the event arguments in 'line' if it is event 'name', and its timestamp. */
+static char *trace_event(char *line, const char *name, double *ts)
+{
+	char pattern[64], *p, *q;
+
+	snprintf(pattern, sizeof(pattern), ": %s: ", name);
+	p = strstr(line, pattern);
+	if (!p)
+		return NULL;
+	for (q = p; q > line && q[-1] != ' '; q--)
+		;
+	*ts = strtod(q, NULL);
+	return p + strlen(pattern);
+}
+
+static void trace_stop(void)
+{
+	struct hist *queue, *init, *setup, *handshake;
+	uint32_t queue_us, init_us, setup_us, serv;
+	uint64_t requests = 0, sk, nsk;
+	struct trace_sock *socks, *s;
+	char path[256], line[512], *args;
+	unsigned int version;
+	double ts;
+	FILE *fp;
+
+	trace_enable(0);
+
+	queue = calloc(1, sizeof(*queue));
+	init = calloc(1, sizeof(*init));
+	setup = calloc(1, sizeof(*setup));
+	handshake = calloc(1, sizeof(*handshake));
+	socks = calloc(TRACE_HASH_SIZE, sizeof(*socks));
+	snprintf(path, sizeof(path), "%s/trace", tracefs);
+	fp = fopen(path, "r");
+	if (!queue || !init || !setup || !handshake || !socks || !fp) {
+		printf("trace read failed\n");
+		goto out;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (trace_event(line, "quic_conn_request", &ts)) {
+			requests++;
+			continue;
+		}
+		args = trace_event(line, "quic_accept", &ts);
+		if (args) {
+			if (sscanf(args, "sk=%*s nsk=%" SCNx64 " queue_us=%u init_us=%u setup_us=%u",
+				   &nsk, &queue_us, &init_us, &setup_us) != 4)
+				continue;
+			hist_record(queue, queue_us * 1000ULL);
+			hist_record(init, init_us * 1000ULL);
+			hist_record(setup, setup_us * 1000ULL);
+			s = trace_sock_get(socks, nsk);
+			if (s) {
+				s->sk = nsk;
+				s->ts = ts;
+			}
+			continue;
+		}
+		args = trace_event(line, "quic_handshake_done", &ts);
+		if (args) {
+			if (sscanf(args, "sk=%" SCNx64 " version=%x serv=%u", &sk, &version,
+				   &serv) != 3 || !serv)
+				continue;
+			s = trace_sock_get(socks, sk);
+			if (s && s->sk == sk) {
+				hist_record(handshake, (uint64_t)((ts - s->ts) * 1e9));
+				s->sk = (uint64_t)-1; /* A later socket may reuse the address. */
+			}
+		}
+	}
+
+	printf("server setup breakdown (us, from %" PRIu64 " requests):\n", requests);
+	hist_print("kernel: accept queue wait", queue);
+	hist_print("kernel: accept sock init", init);
+	hist_print("kernel: accept sock setup", setup);
+	hist_print("accept to established", handshake);
+	if (queue->total < opts.conns)
+		printf("  %" PRIu64 " of %u accepts traced; trace buffer overflow?\n",
+		       queue->total, opts.conns);
+out:
+	if (fp)
+		fclose(fp);
+	free(queue);
+	free(init);
+	free(setup);
+	free(handshake);
+	free(socks);
+}
+
+struct client_thread {
+	pthread_t thread;
+	struct addrinfo *rp;
+	uint32_t conns;
+	uint32_t failed;
+	int *fds;
+	struct hist hist;
+};
+
+static int client_connect(struct addrinfo *rp)
+{
+	int sockfd;
+
+	sockfd = socket(rp->ai_family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (sockfd < 0) {
+		printf("socket create failed %d\n", errno);
+		return -1;
+	}
+	if (connect(sockfd, rp->ai_addr, rp->ai_addrlen)) {
+		printf("socket connect failed %d\n", errno);
+		close(sockfd);
+		return -1;
+	}
+	if (quic_client_handshake(sockfd, NULL, NULL, ALPN)) {
+		close(sockfd);
+		return -1;
+	}
+	return sockfd;
+}
+
+static void *client_thread(void *arg)
+{
+	struct client_thread *t = arg;
+	uint64_t start;
+	uint32_t i;
+	int sockfd;
+
+	for (i = 0; i < t->conns; i++) {
+		start = get_now_ns();
+		sockfd = client_connect(t->rp);
+		if (sockfd < 0) {
+			t->failed++;
+			continue;
+		}
+		hist_record(&t->hist, get_now_ns() - start);
+		if (opts.hold)
+			t->fds[i] = sockfd;
+		else
+			close(sockfd);
+	}
+	return NULL;
+}
+
+static int do_client(void)
+{
+	struct client_thread *threads;
+	uint32_t i, j, failed = 0;
+	struct addrinfo *rp;
+	uint64_t start, ns;
+	struct hist *h;
+	int ret = -1;
+
+	if (getaddrinfo(opts.addr, opts.port, NULL, &rp)) {
+		printf("getaddrinfo error\n");
+		return -1;
+	}
+
+	threads = calloc(opts.threads, sizeof(*threads));
+	h = calloc(1, sizeof(*h));
+	if (!threads || !h)
+		goto free;
+	for (i = 0; i < opts.threads; i++) {
+		threads[i].rp = rp;
+		threads[i].conns = opts.conns / opts.threads + (i < opts.conns % opts.threads);
+		if (opts.hold) {
+			threads[i].fds = malloc(threads[i].conns * sizeof(int));
+			if (!threads[i].fds)
+				goto free;
+			memset(threads[i].fds, -1, threads[i].conns * sizeof(int));
+		}
+	}
+
+	if (opts.trace && trace_start())
+		goto free;
+
+	start = get_now_ns();
+	for (i = 0; i < opts.threads; i++) {
+		if (pthread_create(&threads[i].thread, NULL, client_thread, &threads[i])) {
+			printf("pthread create failed\n");
+			exit(-1);
+		}
+	}
+	for (i = 0; i < opts.threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		hist_merge(h, &threads[i].hist);
+		failed += threads[i].failed;
+	}
+	ns = get_now_ns() - start;
+
+	printf("%" PRIu64 " handshakes (%u failed) from %u threads in %.2f Sec: %.0f handshakes/s\n",
+	       h->total, failed, opts.threads, ns / 1e9, h->total * 1e9 / ns);
+	if (h->total) {
+		printf("client setup latency (us):\n");
+		hist_print("connect + handshake", h);
+		printf("{\"threads\": %u, \"conns\": %u, \"hold\": %u, \"failed\": %u, "
+		       "\"handshakes_per_sec\": %.0f, \"p50_us\": %.1f, \"p99_us\": %.1f, "
+		       "\"p999_us\": %.1f, \"max_us\": %.1f}\n", opts.threads, opts.conns,
+		       opts.hold, failed, h->total * 1e9 / ns, hist_percentile(h, 50) / 1e3,
+		       hist_percentile(h, 99) / 1e3, hist_percentile(h, 99.9) / 1e3,
+		       h->max / 1e3);
+	}
+
+	if (opts.trace)
+		trace_stop();
+	ret = failed ? -1 : 0;
+free:
+	if (threads) {
+		for (i = 0; i < opts.threads; i++) {
+			for (j = 0; threads[i].fds && j < threads[i].conns; j++)
+				if (threads[i].fds[j] >= 0)
+					close(threads[i].fds[j]);
+			free(threads[i].fds);
+		}
+	}
+	free(threads);
+	free(h);
+	freeaddrinfo(rp);
+	return ret;
+}
+
+/* Server: each thread accepts and runs the handshake for one connection at a time, then
+ * hands the socket to the reaper, which closes it once the client closes its side.
+ */
+static int listenfd, epollfd;
+static uint64_t serv_handshakes, serv_handshake_ns, serv_failed;
+
+static void *server_thread(void *arg)
+{
+	struct epoll_event ev = { .events = EPOLLRDHUP };
+	uint64_t start;
+	int sockfd;
+
+	while (1) {
+		sockfd = accept(listenfd, NULL, NULL);
+		if (sockfd < 0) {
+			printf("socket accept failed %d %d\n", errno, sockfd);
+			if (errno == EMFILE || errno == ENFILE) {
+				usleep(1000);
+				continue;
+			}
+			return NULL;
+		}
+		start = get_now_ns();
+		if (quic_server_handshake(sockfd, opts.pkey, opts.cert, ALPN)) {
+			__atomic_fetch_add(&serv_failed, 1, __ATOMIC_RELAXED);
+			close(sockfd);
+			continue;
+		}
+		__atomic_fetch_add(&serv_handshake_ns, get_now_ns() - start, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&serv_handshakes, 1, __ATOMIC_RELAXED);
+
+		ev.data.fd = sockfd;
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, sockfd, &ev))
+			close(sockfd);
+	}
+	return NULL;
+}
+
+static void *server_reaper(void *arg)
+{
+	struct epoll_event evs[64];
+	int i, n;
+
+	while (1) {
+		n = epoll_wait(epollfd, evs, 64, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			printf("epoll wait failed %d\n", errno);
+			return NULL;
+		}
+		for (i = 0; i < n; i++)
+			close(evs[i].data.fd); /* Closing also removes it from the epoll set. */
+	}
+	return NULL;
+}
+
+/* Prints the handshake rate and the average time quic_server_handshake() took for every
+ * second with handshakes.
+ */
+static void server_report(void)
+{
+	uint64_t count, ns, failed, last_count = 0, last_ns = 0, last_failed = 0;
+
+	while (1) {
+		sleep(1);
+		count = __atomic_load_n(&serv_handshakes, __ATOMIC_RELAXED);
+		ns = __atomic_load_n(&serv_handshake_ns, __ATOMIC_RELAXED);
+		failed = __atomic_load_n(&serv_failed, __ATOMIC_RELAXED);
+		if (count == last_count && failed == last_failed)
+			continue;
+		printf("server: %" PRIu64 " handshakes/s (%" PRIu64 " failed), "
+		       "avg handshake %.1f us\n", count - last_count, failed - last_failed,
+		       count == last_count ? 0 : (ns - last_ns) / 1e3 / (count - last_count));
+		fflush(stdout);
+		last_count = count;
+		last_ns = ns;
+		last_failed = failed;
+	}
+}
+
+static int do_server(void)
+{
+	struct addrinfo *rp;
+	pthread_t thread;
+	uint32_t i;
+
+	if (getaddrinfo(opts.addr, opts.port, NULL, &rp)) {
+		printf("getaddrinfo error\n");
+		return -1;
+	}
+
+	listenfd = socket(rp->ai_family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (listenfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	if (bind(listenfd, rp->ai_addr, rp->ai_addrlen)) {
+		printf("socket bind failed\n");
+		return -1;
+	}
+	if (setsockopt(listenfd, SOL_QUIC, QUIC_SOCKOPT_ALPN, ALPN, strlen(ALPN))) {
+		printf("socket setsockopt alpn failed\n");
+		return -1;
+	}
+	if (listen(listenfd, 4096)) {
+		printf("socket listen failed\n");
+		return -1;
+	}
+	epollfd = epoll_create1(0);
+	if (epollfd < 0) {
+		printf("epoll create failed\n");
+		return -1;
+	}
+
+	if (pthread_create(&thread, NULL, server_reaper, NULL)) {
+		printf("pthread create failed\n");
+		return -1;
+	}
+	for (i = 0; i < opts.threads; i++) {
+		if (pthread_create(&thread, NULL, server_thread, NULL)) {
+			printf("pthread create failed\n");
+			return -1;
+		}
+	}
+
+	server_report();
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	opts.threads = 16;
+	opts.conns = 10000;
+	opts.addr = "::";
+	opts.port = "1234";
+
+	ret = parse_options(argc, argv, &opts);
+	if (ret) {
+		if (ret < 0)
+			printf("parse options error\n");
+		return -1;
+	}
+
+	quic_set_log_level(LOG_NOTICE);
+	raise_nofile_limit();
+
+	if (!opts.is_serv)
+		return do_client();
+
+	return do_server();
+}
@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <poll.h>
+#include <inttypes.h>
 #include <sys/stat.h>
 #include <linux/tls.h>
 #include <arpa/inet.h>
@@ -18,6 +20,8 @@
 #define TOT_LEN		1 * 1024 * 1024 * 1024
 
 #define SECONDS		1000000
+#define MAX_STREAMS	16
+#define MAX_PINGPONGS	1000000
 
 char snd_msg[SND_MSG_LEN];
 char rcv_msg[RCV_MSG_LEN];
@@ -32,6 +36,11 @@ struct options {
 	char *port;
 	uint8_t is_serv;
 	uint8_t no_crypt;
+	uint8_t ack_threshold;
+	uint8_t streams;
+	uint32_t min_ack_delay;
+	uint32_t pingpongs;
+	uint32_t busy_poll;
 	uint64_t tot_len;
 	uint64_t msg_len;
 };
@@ -47,6 +56,11 @@ static struct option long_options[] = {
 	{"tot_len",	required_argument,	0,	't'},
 	{"listen",	no_argument,		0,	'l'},
 	{"no_crypt",	no_argument,		0,	'x'},
+	{"ack_threshold", required_argument,	0,	'A'},
+	{"min_ack_delay", required_argument,	0,	'D'},
+	{"streams",	required_argument,	0,	'n'},
+	{"pingpong",	required_argument,	0,	'P'},
+	{"busy_poll",	required_argument,	0,	'B'},
 	{"help",	no_argument,		0,	'h'},
 	{0,		0,			0,	 0 }
 };
@@ -64,7 +78,12 @@ static void print_usage(char *cmd)
 	printf("    --help/-h <h>:          show help\n");
 	printf("    --msg_len/-m <m>:       msg_len to send\n");
 	printf("    --tot_len/-t <t>:       tot_len to send\n");
-	printf("    --no_crypt/-x <x>:      disable 1rtt encryption\n\n");
+	printf("    --no_crypt/-x <x>:      disable 1rtt encryption\n");
+	printf("    --ack_threshold/-A <A>: ACK every A ack-eliciting packets\n");
+	printf("    --min_ack_delay/-D <D>: enable ACK frequency with min_ack_delay D us\n");
+	printf("    --streams/-n <n>:       send on n incremental streams weighted 1:2:..:n\n");
+	printf("    --pingpong/-P <P>:      P round trips of msg_len bytes, report latency\n");
+	printf("    --busy_poll/-B <B>:     set SO_BUSY_POLL to B us on the connection\n\n");
 }
 
 static int parse_options(int argc, char *argv[], struct options *opts)
@@ -72,7 +91,7 @@ static int parse_options(int argc, char *argv[], struct options *opts)
 	int c, option_index = 0;
 
 	while (1) {
-		c = getopt_long(argc, argv, "la:p:m:t:k:c:s:i:xh", long_options, &option_index);
+		c = getopt_long(argc, argv, "la:p:m:t:k:c:s:i:xA:D:n:P:B:h", long_options, &option_index);
 		if (c == -1)
 			break;
 
@@ -109,6 +128,25 @@ static int parse_options(int argc, char *argv[], struct options *opts)
 		case 'x':
 			opts->no_crypt = 1;
 			break;
+		case 'A':
+			opts->ack_threshold = atoi(optarg);
+			break;
+		case 'D':
+			opts->min_ack_delay = atoi(optarg);
+			break;
+		case 'n':
+			opts->streams = atoi(optarg);
+			if (!opts->streams || opts->streams > MAX_STREAMS)
+				return -1;
+			break;
+		case 'P':
+			opts->pingpongs = atoi(optarg);
+			if (!opts->pingpongs || opts->pingpongs > MAX_PINGPONGS)
+				return -1;
+			break;
+		case 'B':
+			opts->busy_poll = atoi(optarg);
+			break;
 		case 'h':
 			print_usage(argv[0]);
 			return 1;
@@ -122,15 +160,94 @@ static int parse_options(int argc, char *argv[], struct options *opts)
 	return 0;
 }
 
+static int set_ack_options(int sockfd, struct options *opts)
+{
+	struct quic_config config = {};
+
+	if (!opts->ack_threshold)
+		return 0;
+
+	config.ack_eliciting_threshold = opts->ack_threshold;
+	config.ack_reordering_threshold = 1;
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CONFIG, &config, sizeof(config))) {
+		printf("socket setsockopt config failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int set_busy_poll(int sockfd, struct options *opts)
+{
+	if (!opts->busy_poll)
+		return 0;
+
+	if (setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &opts->busy_poll,
+		       sizeof(opts->busy_poll))) {
+		printf("socket setsockopt busy poll failed %d\n", errno);
+		return -1;
+	}
+	return 0;
+}
+
+/* ACK frames sent by all QUIC sockets on this host, from /proc/net/quic/snmp. */
+static uint64_t get_ack_count(void)
+{
+	char name[64];
+	uint64_t val;
+	FILE *fp;
+
+	fp = fopen("/proc/net/quic/snmp", "r");
+	if (!fp)
+		return 0;
+	while (fscanf(fp, "%63s %" SCNu64, name, &val) == 2) {
+		if (!strcmp(name, "QuicFrmOutAcks")) {
+			fclose(fp);
+			return val;
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* Echoes back whatever arrives on a stream until its FIN, which is echoed too. */
+static int do_server_pingpong(int sockfd)
+{
+	uint32_t flags = 0;
+	int64_t sid = 0;
+	int ret;
+
+	while (!(flags & MSG_QUIC_STREAM_FIN)) {
+		flags = 0;
+		ret = quic_recvmsg(sockfd, rcv_msg, sizeof(rcv_msg), &sid, &flags);
+		if (ret == -1) {
+			printf("recv error %d %d\n", ret, errno);
+			return -1;
+		}
+		ret = quic_sendmsg(sockfd, rcv_msg, ret, sid, flags & MSG_QUIC_STREAM_FIN);
+		if (ret == -1) {
+			printf("send %d %d\n", ret, errno);
+			return -1;
+		}
+	}
+	printf("PINGPONG DONE\n");
+
+	flags = 0;
+	quic_recvmsg(sockfd, &rcv_msg, sizeof(rcv_msg), &sid, &flags);
+
+	close(sockfd);
+	printf("CLOSE DONE\n");
+	return 0;
+}
+
 static int do_server(struct options *opts)
 {
 	struct quic_transport_param param = {};
-	uint32_t flags = 0, addrlen, len = 0;
+	uint32_t flags = 0, addrlen, len = 0, done = 0;
 	struct sockaddr_storage ra = {};
 	struct sockaddr_in la = {};
 	int ret, sockfd, listenfd;
+	int64_t sid = 0, max_sid = 0;
 	struct addrinfo *rp;
-	int64_t sid = 0;
 
 	if (getaddrinfo(opts->addr, opts->port, NULL, &rp)) {
 		printf("getaddrinfo error\n");
@@ -173,10 +290,13 @@ listen:
 	param.stateless_reset = 1;
 	param.max_idle_timeout = 120 * SECONDS;
 	param.disable_1rtt_encryption = opts->no_crypt;
+	param.min_ack_delay = opts->min_ack_delay;
 	if (setsockopt(listenfd, SOL_QUIC, QUIC_SOCKOPT_TRANSPORT_PARAM, &param, sizeof(param))) {
 		printf("socket setsockopt transport param failed\n");
 		return -1;
 	}
+	if (set_ack_options(listenfd, opts))
+		return -1;
 	if (setsockopt(listenfd, SOL_QUIC, QUIC_SOCKOPT_ALPN, alpn, strlen(alpn))) {
 		printf("socket setsockopt alpn failed\n");
 		return -1;
@@ -203,6 +323,15 @@ loop:
 
 	printf("HANDSHAKE DONE\n");
 
+	if (set_busy_poll(sockfd, opts))
+		return -1;
+
+	if (opts->pingpongs) {
+		if (do_server_pingpong(sockfd))
+			return -1;
+		goto loop;
+	}
+
 	while (1) {
 		ret = quic_recvmsg(sockfd, &rcv_msg, opts->msg_len * 16, &sid, &flags);
 		if (ret == -1) {
@@ -210,20 +339,34 @@ loop:
 			return 1;
 		}
 		len += ret;
-		usleep(20);
-		if (flags & MSG_QUIC_STREAM_FIN)
-			break;
-		printf("  recv len: %u, stream_id: %d, flags: %u.\n", len, (int)sid, flags);
-	}
+		if (sid > max_sid)
+			max_sid = sid;
+		/* No per-read delay or output in the fairness runs over several streams: the
+		 * reads pace the receive windows, and so the rates the streams get.
+		 */
+		if (!max_sid)
+			usleep(20);
+		if (!(flags & MSG_QUIC_STREAM_FIN)) {
+			if (!max_sid)
+				printf("  recv len: %u, stream_id: %d, flags: %u.\n", len, (int)sid,
+				       flags);
+			continue;
+		}
 
-	printf("RECV DONE: tot_len %u, stream_id: %d, flags: %u.\n", len, (int)sid, flags);
+		printf("RECV DONE: tot_len %u, stream_id: %d, flags: %u.\n", len, (int)sid, flags);
 
-	flags = MSG_QUIC_STREAM_FIN;
-	strcpy(snd_msg, "recv done");
-	ret = quic_sendmsg(sockfd, snd_msg, strlen(snd_msg), sid, flags);
-	if (ret == -1) {
-		printf("send %d %d\n", ret, errno);
-		return -1;
+		flags = MSG_QUIC_STREAM_FIN;
+		strcpy(snd_msg, "recv done");
+		ret = quic_sendmsg(sockfd, snd_msg, strlen(snd_msg), sid, flags);
+		if (ret == -1) {
+			printf("send %d %d\n", ret, errno);
+			return -1;
+		}
+		/* The client opens its bidi streams 0, 4, 8, ... in order and writes to all of
+		 * them from the start, so every stream up to max_sid is in use.
+		 */
+		if (++done == max_sid / 4 + 1)
+			break;
 	}
 
 	flags = 0;
@@ -233,6 +376,8 @@ loop:
 	printf("CLOSE DONE\n");
 
 	len = 0;
+	done = 0;
+	max_sid = 0;
 	goto loop;
 	return 0;
 }
@@ -244,13 +389,183 @@ static uint64_t get_now_time()
 	return t.tv_sec * 1000 + ( t.tv_nsec + 500000 ) / 1000000 ;
 }
 
+/* Sends tot_len bytes split over opts->streams incremental streams, with stream i weighted
+ * i + 1, and reports the throughput of each stream from the server's per-stream reply.
+ * MSG_DONTWAIT keeps one stream blocked by flow control (ENOSPC) from holding the others.
+ */
+static int do_client_streams(int sockfd, struct options *opts)
+{
+	uint64_t start, end[MAX_STREAMS], sent[MAX_STREAMS] = {}, per;
+	struct quic_stream_priority prio = {};
+	struct quic_stream_info sinfo = {};
+	uint32_t i, flags, optlen, left;
+	struct pollfd pfd = {};
+	int64_t sid, len;
+	int ret, progress, full;
+	float rate;
+
+	per = opts->tot_len / opts->streams;
+	for (i = 0; i < opts->streams; i++) {
+		optlen = sizeof(sinfo);
+		sinfo.stream_id = i * 4;
+		sinfo.stream_flags = 0;
+		if (getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_OPEN, &sinfo, &optlen)) {
+			printf("socket getsockopt stream open failed\n");
+			return -1;
+		}
+		prio.stream_id = sinfo.stream_id;
+		prio.urgency = 3;
+		prio.incremental = 1;
+		prio.weight = (i + 1) * 16;
+		if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_PRIORITY, &prio,
+			       sizeof(prio))) {
+			printf("socket setsockopt stream priority failed\n");
+			return -1;
+		}
+	}
+
+	start = get_now_time();
+	left = opts->streams;
+	while (left) {
+		progress = 0;
+		full = 0;
+		for (i = 0; i < opts->streams; i++) {
+			if (sent[i] == per)
+				continue;
+			len = per - sent[i];
+			if (len > (int64_t)opts->msg_len)
+				len = opts->msg_len;
+			flags = MSG_DONTWAIT;
+			if (sent[i] + len == per)
+				flags |= MSG_QUIC_STREAM_FIN;
+			ret = quic_sendmsg(sockfd, snd_msg, len, i * 4, flags);
+			if (ret == -1) {
+				if (errno == EAGAIN) { /* Send buffer full */
+					full = 1;
+					continue;
+				}
+				if (errno == ENOSPC) /* Stream blocked by flow control */
+					continue;
+				printf("send %d %d\n", ret, errno);
+				return -1;
+			}
+			sent[i] += ret;
+			if (sent[i] == per)
+				left--;
+			progress = 1;
+		}
+		if (progress)
+			continue;
+		if (!full) { /* Wait for MAX_STREAM_DATA from the peer. */
+			usleep(20);
+			continue;
+		}
+		pfd.fd = sockfd;
+		pfd.events = POLLOUT;
+		poll(&pfd, 1, 1);
+	}
+	printf("SEND DONE: tot_len: %" PRIu64 ", streams: %u.\n", per * opts->streams,
+	       opts->streams);
+
+	for (left = opts->streams; left;) {
+		flags = 0;
+		ret = quic_recvmsg(sockfd, rcv_msg, sizeof(rcv_msg), &sid, &flags);
+		if (ret == -1) {
+			printf("recv error %d %d\n", ret, errno);
+			return 1;
+		}
+		if (!(flags & MSG_QUIC_STREAM_FIN) || sid / 4 >= opts->streams)
+			continue;
+		end[sid / 4] = get_now_time() - start;
+		left--;
+	}
+	for (i = 0; i < opts->streams; i++) {
+		rate = ((float)per * 8 * 1000) / 1024 / (end[i] ? end[i] : 1);
+		if (rate < 1024)
+			printf("STREAM %u (weight %u): %.1f Kbits/Sec\n", i * 4, (i + 1) * 16,
+			       rate);
+		else
+			printf("STREAM %u (weight %u): %.1f Mbits/Sec\n", i * 4, (i + 1) * 16,
+			       rate / 1024);
+	}
+
+	close(sockfd);
+	return 0;
+}
+
+static uint64_t get_now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Sends msg_len bytes and waits for the server to echo them back, opts->pingpongs times on
+ * one stream, and reports the percentiles of the round trip times.
+ */
+static int do_client_pingpong(int sockfd, struct options *opts)
+{
+	uint64_t *rtt, start, sum = 0;
+	uint32_t i, flags, n = opts->pingpongs;
+	int64_t sid = 0, len;
+	int ret;
+
+	rtt = calloc(n, sizeof(*rtt));
+	if (!rtt)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		start = get_now_ns();
+		flags = !i ? MSG_QUIC_STREAM_NEW : 0;
+		if (i == n - 1)
+			flags |= MSG_QUIC_STREAM_FIN;
+		ret = quic_sendmsg(sockfd, snd_msg, opts->msg_len, sid, flags);
+		if (ret == -1) {
+			printf("send %d %d\n", ret, errno);
+			goto err;
+		}
+		for (len = 0; len < (int64_t)opts->msg_len; len += ret) {
+			flags = 0;
+			ret = quic_recvmsg(sockfd, rcv_msg, sizeof(rcv_msg), &sid, &flags);
+			if (ret == -1) {
+				printf("recv error %d %d\n", ret, errno);
+				goto err;
+			}
+		}
+		rtt[i] = get_now_ns() - start;
+		sum += rtt[i];
+	}
+
+	qsort(rtt, n, sizeof(*rtt), cmp_u64);
+	printf("PINGPONG DONE: %u round trips of %" PRIu64 " bytes, busy_poll: %u us.\n", n,
+	       opts->msg_len, opts->busy_poll);
+	printf("RTT (us): avg %.1f, p50 %.1f, p99 %.1f, max %.1f\n", (double)sum / n / 1000,
+	       (double)rtt[n / 2] / 1000, (double)rtt[(uint64_t)n * 99 / 100] / 1000,
+	       (double)rtt[n - 1] / 1000);
+
+	free(rtt);
+	close(sockfd);
+	return 0;
+err:
+	free(rtt);
+	return -1;
+}
+
 static int do_client(struct options *opts)
 {
 	struct quic_transport_param param = {};
 	struct sockaddr_in ra = {};
 	uint32_t len = 0, flags;
+	uint64_t start, end, acks;
 	struct addrinfo *rp;
-	uint64_t start, end;
 	int ret, sockfd;
 	int64_t sid = 0;
 	float rate;
@@ -271,10 +586,13 @@ static int do_client(struct options *opts)
 
 		param.max_idle_timeout = 120 * SECONDS;
 		param.disable_1rtt_encryption = opts->no_crypt;
+		param.min_ack_delay = opts->min_ack_delay;
 		if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_TRANSPORT_PARAM, &param, sizeof(param))) {
 			printf("socket setsockopt transport param failed\n");
 			return -1;
 		}
+		if (set_ack_options(sockfd, opts))
+			return -1;
 
 		ra.sin6_family = AF_INET6;
 		ra.sin6_port = htons(atoi(opts->port));
@@ -295,10 +613,13 @@ static int do_client(struct options *opts)
 
 	param.max_idle_timeout = 120 * SECONDS;
 	param.disable_1rtt_encryption = opts->no_crypt;
+	param.min_ack_delay = opts->min_ack_delay;
 	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_TRANSPORT_PARAM, &param, sizeof(param))) {
 		printf("socket setsockopt transport param failed\n");
 		return -1;
 	}
+	if (set_ack_options(sockfd, opts))
+		return -1;
 
         ra.sin_family = AF_INET;
         ra.sin_port = htons(atoi(opts->port));
@@ -315,6 +636,16 @@ handshake:
 
 	printf("HANDSHAKE DONE.\n");
 
+	if (set_busy_poll(sockfd, opts))
+		return -1;
+
+	if (opts->pingpongs)
+		return do_client_pingpong(sockfd, opts);
+
+	if (opts->streams > 1)
+		return do_client_streams(sockfd, opts);
+
+	acks = get_ack_count();
 	start = get_now_time();
 	flags = MSG_QUIC_STREAM_NEW; /* open stream when send first msg */
 	ret = quic_sendmsg(sockfd, snd_msg, opts->msg_len, sid, flags);
@@ -358,6 +689,7 @@ handshake:
 		printf("ALL RECVD: %.1f Kbits/Sec\n", rate);
 	else
 		printf("ALL RECVD: %.1f Mbits/Sec\n", rate / 1024);
+	printf("ACK FRAMES: %" PRIu64 "\n", get_ack_count() - acks);
 
 	close(sockfd);
 	return 0;
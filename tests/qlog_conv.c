@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netinet/quic.h>
+
+/* Converts the records of the quic tracepoints into qlog, draft-ietf-quic-qlog-main-schema
+ * 0.3 in JSON, for tools like qvis.  The records are read from a saved trace text file, or
+ * from the tracefs trace_pipe with --live, where the tracing ring buffer is drained for the
+ * duration of the run.  The events of each socket go into their own qlog trace.
+ */
+
+struct options {
+	char *input;
+	char *output;
+	char *pid;
+	uint8_t live;
+	uint32_t duration;
+};
+
+static struct options opts;
+
+static struct option long_options[] = {
+	{"input",	required_argument,	0,	'i'},
+	{"output",	required_argument,	0,	'o'},
+	{"live",	no_argument,		0,	'l'},
+	{"duration",	required_argument,	0,	'd'},
+	{"pid",		required_argument,	0,	'P'},
+	{"help",	no_argument,		0,	'h'},
+	{0,		0,			0,	 0 }
+};
+
+static void print_usage(char *cmd)
+{
+	printf("%s:\n\n", cmd);
+	printf("    --input/-i <i>:         trace text file to convert (default stdin)\n");
+	printf("    --output/-o <o>:        qlog file to write (default stdout)\n");
+	printf("    --live/-l:              enable the quic tracepoints and read the trace_pipe\n");
+	printf("                            until SIGINT or the end of --duration\n");
+	printf("    --duration/-d <d>:      seconds to record with --live\n");
+	printf("    --pid/-P <P>:           only record events of these pids with --live\n");
+	printf("    --help/-h <h>:          show help\n\n");
+}
+
+static int parse_options(int argc, char *argv[], struct options *opts)
+{
+	int c, option_index = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, "i:o:ld:P:h", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'i':
+			opts->input = optarg;
+			break;
+		case 'o':
+			opts->output = optarg;
+			break;
+		case 'l':
+			opts->live = 1;
+			break;
+		case 'd':
+			opts->duration = atoi(optarg);
+			if (!opts->duration)
+				return -1;
+			break;
+		case 'P':
+			opts->pid = optarg;
+			break;
+		case 'h':
+			print_usage(argv[0]);
+			return 1;
+		default:
+			return -1;
+		}
+	}
+
+	if (opts->live && opts->input)
+		return -1;
+	return 0;
+}
+
+/* A connection is a socket address in the trace, with its qlog events kept as JSON text. */
+#define CONN_HASH_SIZE	(1 << 16)
+
+struct conn {
+	uint64_t sk;
+	double start;
+	char *events;
+	size_t len;
+	size_t size;
+	uint32_t count;
+	int8_t serv;
+	int8_t cong_state;
+};
+
+static struct conn *conns;
+
+static struct conn *conn_get(uint64_t sk, double ts)
+{
+	uint32_t i = (sk ^ (sk >> 16) ^ (sk >> 32)) & (CONN_HASH_SIZE - 1), n;
+
+	for (n = 0; n < CONN_HASH_SIZE; n++, i = (i + 1) & (CONN_HASH_SIZE - 1)) {
+		if (conns[i].sk == sk)
+			return &conns[i];
+		if (!conns[i].sk) {
+			conns[i].sk = sk;
+			conns[i].start = ts;
+			conns[i].serv = -1;
+			conns[i].cong_state = -1;
+			return &conns[i];
+		}
+	}
+	return NULL;
+}
+
+/* Appends one event of 'name' at 'ts' with the data members in 'fmt'. */
+static void conn_event(struct conn *c, double ts, const char *name, const char *fmt, ...)
+{
+	char data[512];
+	size_t need;
+	va_list ap;
+	char *p;
+	int n;
+
+	va_start(ap, fmt);
+	vsnprintf(data, sizeof(data), fmt, ap);
+	va_end(ap);
+
+	need = c->len + strlen(data) + 128;
+	if (need > c->size) {
+		p = realloc(c->events, need * 2);
+		if (!p)
+			return;
+		c->events = p;
+		c->size = need * 2;
+	}
+	n = snprintf(c->events + c->len, c->size - c->len,
+		     "%s\n        {\"time\": %.3f, \"name\": \"%s\", \"data\": {%s}}",
+		     c->count ? "," : "", (ts - c->start) * 1e3, name, data);
+	c->len += n;
+	c->count++;
+}
+
+/* Returns the value of 'key' in the event arguments 'args', which are 'key=value' pairs. */
+static const char *arg_str(const char *args, const char *key)
+{
+	size_t len = strlen(key);
+	const char *p = args;
+
+	while ((p = strstr(p, key))) {
+		if ((p == args || p[-1] == ' ') && p[len] == '=')
+			return p + len + 1;
+		p += len;
+	}
+	return NULL;
+}
+
+static uint64_t arg_u64(const char *args, const char *key)
+{
+	const char *v = arg_str(args, key);
+
+	return v ? strtoull(v, NULL, 0) : 0;
+}
+
+static int64_t arg_s64(const char *args, const char *key)
+{
+	const char *v = arg_str(args, key);
+
+	return v ? strtoll(v, NULL, 0) : 0;
+}
+
+static const char *packet_type(const char *args)
+{
+	const char *level = arg_str(args, "level");
+
+	if (!level)
+		return "unknown";
+	if (!strncmp(level, "INITIAL", 7))
+		return "initial";
+	if (!strncmp(level, "HANDSHAKE", 9))
+		return "handshake";
+	if (!strncmp(level, "EARLY", 5))
+		return "0RTT";
+	return "1RTT";
+}
+
+static const char *packet_space(const char *args)
+{
+	const char *type = packet_type(args);
+
+	return !strcmp(type, "initial") || !strcmp(type, "handshake") ? type : "application_data";
+}
+
+/* The stream states in netinet/quic.h: QUIC_STREAM_SEND_STATE_* for the sending part, and
+ * QUIC_STREAM_RECV_STATE_*, which follow them in the same enum, for the receiving part.
+ */
+static const char *stream_state(uint32_t send, uint32_t state)
+{
+	static const char *send_states[] = {
+		"ready", "send", "data_sent", "data_received", "reset_sent", "reset_received",
+	};
+	static const char *recv_states[] = {
+		"receive", "size_known", "data_received", "data_read", "reset_received",
+		"reset_read",
+	};
+
+	if (send)
+		return state <= QUIC_STREAM_SEND_STATE_RESET_RECVD ? send_states[state] : "unknown";
+	if (state < QUIC_STREAM_RECV_STATE_RECV || state > QUIC_STREAM_RECV_STATE_RESET_READ)
+		return "unknown";
+	return recv_states[state - QUIC_STREAM_RECV_STATE_RECV];
+}
+
+static void parse_event(const char *name, const char *args, double ts)
+{
+	const char *state;
+	struct conn *c;
+	uint64_t sk;
+	int8_t cong;
+
+	sk = strtoull(arg_str(args, "sk") ?: "0", NULL, 16);
+	c = sk ? conn_get(sk, ts) : NULL;
+	if (!c)
+		return;
+
+	if (!strcmp(name, "quic_packet_sent") || !strcmp(name, "quic_packet_recv")) {
+		conn_event(c, ts, name[12] == 's' ? "transport:packet_sent" :
+			   "transport:packet_received",
+			   "\"header\": {\"packet_type\": \"%s\", \"packet_number\": %" PRId64 "}, "
+			   "\"raw\": {\"length\": %" PRIu64 "}", packet_type(args),
+			   arg_s64(args, "number"), arg_u64(args, "len"));
+	} else if (!strcmp(name, "quic_packet_lost")) {
+		conn_event(c, ts, "recovery:packet_lost",
+			   "\"header\": {\"packet_type\": \"%s\", \"packet_number\": %" PRId64 "}",
+			   packet_type(args), arg_s64(args, "number"));
+	} else if (!strcmp(name, "quic_rtt_update")) {
+		conn_event(c, ts, "recovery:metrics_updated",
+			   "\"min_rtt\": %.3f, \"smoothed_rtt\": %.3f, \"latest_rtt\": %.3f, "
+			   "\"rtt_variance\": %.3f", arg_u64(args, "min_rtt") / 1e3,
+			   arg_u64(args, "smoothed_rtt") / 1e3, arg_u64(args, "latest_rtt") / 1e3,
+			   arg_u64(args, "rttvar") / 1e3);
+	} else if (!strcmp(name, "quic_cong_update")) {
+		conn_event(c, ts, "recovery:metrics_updated",
+			   "\"congestion_window\": %" PRIu64 ", \"bytes_in_flight\": %" PRIu64 ", "
+			   "\"ssthresh\": %" PRIu64 ", \"pacing_rate\": %" PRIu64,
+			   arg_u64(args, "window"), arg_u64(args, "inflight"),
+			   arg_u64(args, "ssthresh"), arg_u64(args, "pacing_rate") * 8);
+		state = arg_str(args, "state") ?: "";
+		if (!strncmp(state, "SLOW_START", 10))
+			cong = 0;
+		else if (!strncmp(state, "RECOVERY_PERIOD", 15))
+			cong = 1;
+		else
+			cong = 2;
+		if (cong != c->cong_state) {
+			conn_event(c, ts, "recovery:congestion_state_updated", "\"new\": \"%s\"",
+				   cong == 0 ? "slow_start" :
+				   cong == 1 ? "recovery" : "congestion_avoidance");
+			c->cong_state = cong;
+		}
+	} else if (!strcmp(name, "quic_pto_fire")) {
+		conn_event(c, ts, "recovery:loss_timer_updated",
+			   "\"timer_type\": \"pto\", \"packet_number_space\": \"%s\", "
+			   "\"event_type\": \"expired\"", packet_space(args));
+	} else if (!strcmp(name, "quic_stream_update")) {
+		conn_event(c, ts, "transport:stream_state_updated",
+			   "\"stream_id\": %" PRId64 ", \"stream_side\": \"%s\", \"new\": \"%s\"",
+			   arg_s64(args, "stream_id"),
+			   arg_u64(args, "send") ? "sending" : "receiving",
+			   stream_state(arg_u64(args, "send"), arg_u64(args, "state")));
+	} else if (!strcmp(name, "quic_key_update")) {
+		/* The local keys are the server keys on the server, and the client keys else. */
+		conn_event(c, ts, "security:key_updated",
+			   "\"key_type\": \"%s_1rtt_secret\", \"key_phase\": %" PRIu64 ", "
+			   "\"trigger\": \"%s\"",
+			   (c->serv == 1) == !!arg_u64(args, "local") ? "server" : "client",
+			   arg_u64(args, "key_phase"),
+			   arg_u64(args, "local") ? "local_update" : "remote_update");
+	} else if (!strcmp(name, "quic_handshake_done")) {
+		c->serv = arg_u64(args, "serv");
+		conn_event(c, ts, "connectivity:connection_state_updated",
+			   "\"new\": \"handshake_complete\"");
+	}
+}
+
+/* A trace line looks like: "<task>-<pid> [cpu] <flags> <ts>: <event>: <args>". */
+static void parse_line(char *line)
+{
+	char *p, *name, *args;
+	double ts;
+
+	p = strstr(line, ": quic_");
+	if (!p)
+		return;
+	name = p + 2;
+	args = strstr(name, ": ");
+	if (!args)
+		return;
+	*args = '\0';
+	args += 2;
+	args[strcspn(args, "\n")] = '\0';
+	for (*p = '\0'; p > line && p[-1] != ' '; p--)
+		;
+	ts = strtod(p, NULL);
+	parse_event(name, args, ts);
+}
+
+static void write_qlog(FILE *out)
+{
+	uint32_t i, n = 0;
+	struct conn *c;
+
+	fprintf(out, "{\n  \"qlog_version\": \"0.3\",\n  \"qlog_format\": \"JSON\",\n"
+		"  \"title\": \"quic kernel tracepoints\",\n  \"traces\": [");
+	for (i = 0; i < CONN_HASH_SIZE; i++) {
+		c = &conns[i];
+		if (!c->sk || !c->count)
+			continue;
+		fprintf(out, "%s\n    {\n      \"title\": \"sk=%" PRIx64 "\",\n"
+			"      \"vantage_point\": {\"type\": \"%s\"},\n"
+			"      \"common_fields\": {\"time_format\": \"relative\", "
+			"\"reference_time\": %.3f},\n      \"events\": [%s\n      ]\n    }",
+			n++ ? "," : "", c->sk, c->serv < 0 ? "unknown" :
+			c->serv ? "server" : "client", c->start * 1e3, c->events);
+	}
+	fprintf(out, "\n  ]\n}\n");
+}
+
+/* Live mode: all quic events are enabled, and the trace_pipe is drained until stopped. */
+static const char *tracefs;
+static volatile sig_atomic_t stopped;
+
+static void trace_signal(int sig)
+{
+	stopped = 1;
+}
+
+static int trace_write(const char *file, const char *val)
+{
+	char path[256];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/%s", tracefs, file);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, val, strlen(val));
+	close(fd);
+	return ret < 0 ? -1 : 0;
+}
+
+static FILE *trace_start(void)
+{
+	struct sigaction sa = {};
+	char path[256];
+	FILE *fp;
+
+	if (!access("/sys/kernel/tracing/events/quic", F_OK))
+		tracefs = "/sys/kernel/tracing";
+	else if (!access("/sys/kernel/debug/tracing/events/quic", F_OK))
+		tracefs = "/sys/kernel/debug/tracing";
+	if (!tracefs) {
+		fprintf(stderr, "no quic tracepoints found in tracefs\n");
+		return NULL;
+	}
+	if (trace_write("buffer_size_kb", "16384") || trace_write("trace", "") ||
+	    trace_write("set_event_pid", opts.pid ?: "") ||
+	    trace_write("events/quic/enable", "1")) {
+		fprintf(stderr, "tracefs setup failed %d\n", errno);
+		return NULL;
+	}
+
+	/* No SA_RESTART, so that the blocking trace_pipe read returns on the signal. */
+	sa.sa_handler = trace_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGALRM, &sa, NULL);
+	if (opts.duration)
+		alarm(opts.duration);
+
+	snprintf(path, sizeof(path), "%s/trace_pipe", tracefs);
+	fp = fopen(path, "r");
+	if (!fp)
+		fprintf(stderr, "trace_pipe open failed %d\n", errno);
+	return fp;
+}
+
+static void trace_stop(void)
+{
+	trace_write("events/quic/enable", "0");
+	trace_write("set_event_pid", "");
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *in = stdin, *out = stdout;
+	char line[1024];
+	int ret = -1;
+	uint32_t i;
+
+	ret = parse_options(argc, argv, &opts);
+	if (ret) {
+		if (ret < 0)
+			print_usage(argv[0]);
+		return ret < 0;
+	}
+	ret = -1;
+
+	conns = calloc(CONN_HASH_SIZE, sizeof(*conns));
+	if (!conns)
+		return -1;
+
+	if (opts.live)
+		in = trace_start();
+	else if (opts.input)
+		in = fopen(opts.input, "r");
+	if (!in) {
+		fprintf(stderr, "open input failed\n");
+		goto out;
+	}
+
+	while (!stopped && fgets(line, sizeof(line), in))
+		parse_line(line);
+
+	if (opts.output) {
+		out = fopen(opts.output, "w");
+		if (!out) {
+			fprintf(stderr, "open %s failed %d\n", opts.output, errno);
+			goto out;
+		}
+	}
+	write_qlog(out);
+	ret = 0;
+out:
+	if (opts.live && tracefs)
+		trace_stop();
+	if (in && in != stdin)
+		fclose(in);
+	if (out && out != stdout)
+		fclose(out);
+	for (i = 0; i < CONN_HASH_SIZE; i++)
+		free(conns[i].events);
+	free(conns);
+	return ret;
+}
@@ -0,0 +1,686 @@
+#include <stdio.h>
+#include <errno.h>
+#include <netdb.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <netinet/quic.h>
+#include <sys/syslog.h>
+#include <gnutls/socket.h>
+
+#define MAX_MSG_LEN	65536
+#define ALPN		"sample"
+#define TLS_PRIORITY	"NORMAL:-VERS-ALL:+VERS-TLS1.3"
+
+#define SECONDS		1000000
+
+enum {
+	PROTO_QUIC,
+	PROTO_TCP,
+	PROTO_TLS,
+};
+
+enum {
+	MODE_RR,	/* All requests on one stream of one connection */
+	MODE_SRR,	/* A new stream of one connection for each request */
+	MODE_CRR,	/* A new connection, including the handshake, for each request */
+};
+
+static const char *proto_names[] = { "quic", "tcp", "tls" };
+static const char *mode_names[] = { "rr", "srr", "crr" };
+static const char *cong_names[] = { "reno", "cubic", "prague" };
+
+struct options {
+	char *pkey;
+	char *cert;
+	char *addr;
+	char *port;
+	uint8_t is_serv;
+	uint8_t proto;
+	uint8_t mode;
+	uint8_t cong;
+	uint32_t count;
+	uint32_t warmup;
+	uint32_t req_len;
+	uint32_t resp_len;
+};
+
+static struct options opts;
+static char req_msg[MAX_MSG_LEN];
+static char resp_msg[MAX_MSG_LEN];
+static gnutls_certificate_credentials_t tls_cred;
+
+/* A log-linear histogram in the style of HdrHistogram: values below 2^HIST_SUB_BITS are
+ * counted exactly, and each power of two above is split into 2^(HIST_SUB_BITS - 1) buckets,
+ * which keeps the relative error of any recorded value under 1%.
+ */
+#define HIST_SUB_BITS	8
+#define HIST_SUB_COUNT	(1U << HIST_SUB_BITS)
+#define HIST_SUB_HALF	(HIST_SUB_COUNT / 2)
+#define HIST_SIZE	((64 - HIST_SUB_BITS + 2) * HIST_SUB_HALF)
+
+struct hist {
+	uint64_t counts[HIST_SIZE];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t max;
+};
+
+static uint32_t hist_index(uint64_t v)
+{
+	uint32_t shift;
+
+	if (v < HIST_SUB_COUNT)
+		return v;
+	shift = 63 - __builtin_clzll(v) - (HIST_SUB_BITS - 1);
+	return shift * HIST_SUB_HALF + (v >> shift);
+}
+
+/* The middle of the range of values counted in bucket 'i'. */
+static uint64_t hist_value(uint32_t i)
+{
+	uint32_t shift;
+
+	if (i < HIST_SUB_COUNT)
+		return i;
+	shift = i / HIST_SUB_HALF - 1;
+	return ((uint64_t)(i - shift * HIST_SUB_HALF) << shift) + (1ULL << (shift - 1));
+}
+
+static void hist_record(struct hist *h, uint64_t v)
+{
+	h->counts[hist_index(v)]++;
+	h->total++;
+	h->sum += v;
+	if (v > h->max)
+		h->max = v;
+}
+
+static uint64_t hist_percentile(struct hist *h, double p)
+{
+	uint64_t rank = (uint64_t)(p / 100 * h->total + 0.5), seen = 0;
+	uint32_t i;
+
+	if (!rank)
+		rank = 1;
+	for (i = 0; i < HIST_SIZE; i++) {
+		seen += h->counts[i];
+		if (seen >= rank)
+			return hist_value(i) < h->max ? hist_value(i) : h->max;
+	}
+	return h->max;
+}
+
+static struct option long_options[] = {
+	{"addr",	required_argument,	0,	'a'},
+	{"port",	required_argument,	0,	'p'},
+	{"pkey",	required_argument,	0,	'k'},
+	{"cert",	required_argument,	0,	'c'},
+	{"proto",	required_argument,	0,	'P'},
+	{"mode",	required_argument,	0,	'M'},
+	{"count",	required_argument,	0,	'n'},
+	{"warmup",	required_argument,	0,	'w'},
+	{"req_len",	required_argument,	0,	'q'},
+	{"resp_len",	required_argument,	0,	'r'},
+	{"cong",	required_argument,	0,	'g'},
+	{"listen",	no_argument,		0,	'l'},
+	{"help",	no_argument,		0,	'h'},
+	{0,		0,			0,	 0 }
+};
+
+static void print_usage(char *cmd)
+{
+	printf("%s:\n\n", cmd);
+	printf("    --listen/-l:            work as a server\n");
+	printf("    --addr/-a <a>:          server IP address\n");
+	printf("    --port/-p <p>:          server port\n");
+	printf("    --pkey/-k <k>:          private key file\n");
+	printf("    --cert/-c <c>:          certificate file\n");
+	printf("    --help/-h <h>:          show help\n");
+	printf("    --proto/-P <P>:         quic, or tcp/tls for a baseline (tls uses kTLS if\n");
+	printf("                            enabled in the GnuTLS config)\n");
+	printf("    --mode/-M <M>:          rr: one stream, srr: new stream per request,\n");
+	printf("                            crr: new connection per request\n");
+	printf("    --count/-n <n>:         requests to measure\n");
+	printf("    --warmup/-w <w>:        requests to send before measuring\n");
+	printf("    --req_len/-q <q>:       request size\n");
+	printf("    --resp_len/-r <r>:      response size\n");
+	printf("    --cong/-g <g>:          quic congestion control: reno, cubic or prague\n\n");
+}
+
+static int parse_name(const char *name, const char **names, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (!strcmp(name, names[i]))
+			return i;
+	return -1;
+}
+
+static int parse_options(int argc, char *argv[], struct options *opts)
+{
+	int c, option_index = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, "la:p:k:c:P:M:n:w:q:r:g:h", long_options,
+				&option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'l':
+			opts->is_serv = 1;
+			break;
+		case 'a':
+			opts->addr = optarg;
+			break;
+		case 'p':
+			opts->port = optarg;
+			break;
+		case 'k':
+			opts->pkey = optarg;
+			break;
+		case 'c':
+			opts->cert = optarg;
+			break;
+		case 'P':
+			c = parse_name(optarg, proto_names, 3);
+			if (c < 0)
+				return -1;
+			opts->proto = c;
+			break;
+		case 'M':
+			c = parse_name(optarg, mode_names, 3);
+			if (c < 0)
+				return -1;
+			opts->mode = c;
+			break;
+		case 'n':
+			opts->count = atoi(optarg);
+			if (!opts->count)
+				return -1;
+			break;
+		case 'w':
+			opts->warmup = atoi(optarg);
+			break;
+		case 'q':
+			opts->req_len = atoi(optarg);
+			if (!opts->req_len || opts->req_len > MAX_MSG_LEN)
+				return -1;
+			break;
+		case 'r':
+			opts->resp_len = atoi(optarg);
+			if (!opts->resp_len || opts->resp_len > MAX_MSG_LEN)
+				return -1;
+			break;
+		case 'g':
+			c = parse_name(optarg, cong_names, QUIC_CONG_ALG_MAX);
+			if (c < 0)
+				return -1;
+			opts->cong = c;
+			break;
+		case 'h':
+			print_usage(argv[0]);
+			return 1;
+		default:
+			return -1;
+		}
+	}
+
+	if (opts->proto != PROTO_QUIC && opts->mode == MODE_SRR) /* No streams in TCP. */
+		return -1;
+	if (opts->is_serv && opts->proto != PROTO_TCP && (!opts->cert || !opts->pkey))
+		return -1;
+	return 0;
+}
+
+static uint64_t get_now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* A TCP connection, with a TLS session on it for PROTO_TLS. */
+struct conn {
+	int sockfd;
+	gnutls_session_t session;
+};
+
+static int tls_start(struct conn *c, int server)
+{
+	int ret;
+
+	ret = gnutls_init(&c->session, server ? GNUTLS_SERVER : GNUTLS_CLIENT);
+	if (ret)
+		goto err;
+	ret = gnutls_credentials_set(c->session, GNUTLS_CRD_CERTIFICATE, tls_cred);
+	if (ret)
+		goto err;
+	ret = gnutls_priority_set_direct(c->session, TLS_PRIORITY, NULL);
+	if (ret)
+		goto err;
+	gnutls_transport_set_int(c->session, c->sockfd);
+	do {
+		ret = gnutls_handshake(c->session);
+	} while (ret < 0 && !gnutls_error_is_fatal(ret));
+	if (ret)
+		goto err;
+	return 0;
+err:
+	printf("tls handshake failed %d\n", ret);
+	return -1;
+}
+
+static int conn_send(struct conn *c, const char *buf, uint32_t len)
+{
+	uint32_t sent = 0;
+	ssize_t ret;
+
+	while (sent < len) {
+		if (c->session)
+			ret = gnutls_record_send(c->session, buf + sent, len - sent);
+		else
+			ret = send(c->sockfd, buf + sent, len - sent, 0);
+		if (ret <= 0)
+			return -1;
+		sent += ret;
+	}
+	return 0;
+}
+
+/* Returns 0 on EOF, which the server sees when a client is done. */
+static int conn_recv(struct conn *c, char *buf, uint32_t len)
+{
+	uint32_t got = 0;
+	ssize_t ret;
+
+	while (got < len) {
+		if (c->session)
+			ret = gnutls_record_recv(c->session, buf + got, len - got);
+		else
+			ret = recv(c->sockfd, buf + got, len - got, 0);
+		if (ret <= 0)
+			return ret == 0 && !got ? 0 : -1;
+		got += ret;
+	}
+	return 1;
+}
+
+static void conn_close(struct conn *c)
+{
+	if (c->session)
+		gnutls_deinit(c->session);
+	close(c->sockfd);
+	c->session = NULL;
+}
+
+static int tcp_connect(struct addrinfo *rp, struct conn *c)
+{
+	int one = 1;
+
+	c->session = NULL;
+	c->sockfd = socket(rp->ai_family, SOCK_STREAM, IPPROTO_TCP);
+	if (c->sockfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	setsockopt(c->sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(c->sockfd, rp->ai_addr, rp->ai_addrlen)) {
+		printf("socket connect failed\n");
+		close(c->sockfd);
+		return -1;
+	}
+	if (opts.proto == PROTO_TLS && tls_start(c, 0)) {
+		conn_close(c);
+		return -1;
+	}
+	return 0;
+}
+
+static int quic_set_cong(int sockfd)
+{
+	struct quic_config config = {};
+
+	config.congestion_control_algo = opts.cong;
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_CONFIG, &config, sizeof(config))) {
+		printf("socket setsockopt config failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int quic_connect(struct addrinfo *rp)
+{
+	struct quic_transport_param param = {};
+	int sockfd;
+
+	sockfd = socket(rp->ai_family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (sockfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	param.max_idle_timeout = 120 * SECONDS;
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_TRANSPORT_PARAM, &param, sizeof(param))) {
+		printf("socket setsockopt transport param failed\n");
+		goto err;
+	}
+	if (quic_set_cong(sockfd))
+		goto err;
+	if (connect(sockfd, rp->ai_addr, rp->ai_addrlen)) {
+		printf("socket connect failed\n");
+		goto err;
+	}
+	if (quic_client_handshake(sockfd, NULL, NULL, ALPN))
+		goto err;
+	return sockfd;
+err:
+	close(sockfd);
+	return -1;
+}
+
+/* Receives one response, resp_len bytes or up to the stream FIN. */
+static int quic_recv_resp(int sockfd)
+{
+	uint32_t got = 0, flags = 0;
+	int64_t sid;
+	int ret;
+
+	while (got < opts.resp_len && !(flags & MSG_QUIC_STREAM_FIN)) {
+		flags = 0;
+		ret = quic_recvmsg(sockfd, resp_msg, sizeof(resp_msg), &sid, &flags);
+		if (ret == -1) {
+			printf("recv error %d %d\n", ret, errno);
+			return -1;
+		}
+		got += ret;
+	}
+	return 0;
+}
+
+/* One request and its response; 'sockfd' is the connection for RR and SRR, and 'i' is the
+ * index of the request.
+ */
+static int quic_request(struct addrinfo *rp, int sockfd, uint32_t i)
+{
+	uint32_t flags = MSG_QUIC_STREAM_NEW | MSG_QUIC_STREAM_FIN;
+	int64_t sid = 0;
+	int ret;
+
+	if (opts.mode == MODE_CRR) {
+		sockfd = quic_connect(rp);
+		if (sockfd < 0)
+			return -1;
+	} else if (opts.mode == MODE_SRR) {
+		sid = (int64_t)i * 4;
+	} else {
+		flags = i ? 0 : MSG_QUIC_STREAM_NEW;
+	}
+
+	ret = quic_sendmsg(sockfd, req_msg, opts.req_len, sid, flags);
+	if (ret == -1) {
+		printf("send %d %d\n", ret, errno);
+		ret = -1;
+		goto out;
+	}
+	ret = quic_recv_resp(sockfd);
+out:
+	if (opts.mode == MODE_CRR)
+		close(sockfd);
+	return ret;
+}
+
+static int tcp_request(struct addrinfo *rp, struct conn *c)
+{
+	struct conn nc;
+	int ret;
+
+	if (opts.mode == MODE_CRR) {
+		if (tcp_connect(rp, &nc))
+			return -1;
+		c = &nc;
+	}
+	ret = conn_send(c, req_msg, opts.req_len);
+	if (!ret)
+		ret = conn_recv(c, resp_msg, opts.resp_len) == 1 ? 0 : -1;
+	if (ret)
+		printf("tcp request failed %d\n", errno);
+	if (opts.mode == MODE_CRR)
+		conn_close(c);
+	return ret;
+}
+
+static void print_result(struct hist *h, uint64_t ns)
+{
+	double us = 1000;
+
+	printf("%s %s: %" PRIu64 " requests of %u/%u bytes, %.0f trans/Sec\n",
+	       proto_names[opts.proto], mode_names[opts.mode], h->total, opts.req_len,
+	       opts.resp_len, (double)h->total * 1e9 / ns);
+	printf("  latency (us): mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+	       (double)h->sum / h->total / us, hist_percentile(h, 50) / us,
+	       hist_percentile(h, 90) / us, hist_percentile(h, 99) / us,
+	       hist_percentile(h, 99.9) / us, h->max / us);
+	printf("{\"proto\": \"%s\", \"mode\": \"%s\", \"cong\": \"%s\", \"req_len\": %u, "
+	       "\"resp_len\": %u, \"count\": %" PRIu64 ", \"tps\": %.0f, \"mean_us\": %.1f, "
+	       "\"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, "
+	       "\"max_us\": %.1f}\n", proto_names[opts.proto], mode_names[opts.mode],
+	       opts.proto == PROTO_QUIC ? cong_names[opts.cong] : "-", opts.req_len, opts.resp_len,
+	       h->total, (double)h->total * 1e9 / ns, (double)h->sum / h->total / us,
+	       hist_percentile(h, 50) / us, hist_percentile(h, 90) / us,
+	       hist_percentile(h, 99) / us, hist_percentile(h, 99.9) / us, h->max / us);
+}
+
+static int do_client(void)
+{
+	struct conn c = { .sockfd = -1 };
+	uint64_t start, now, begin = 0;
+	struct addrinfo *rp;
+	struct hist *h;
+	uint32_t i;
+	int ret = 0;
+
+	if (getaddrinfo(opts.addr, opts.port, NULL, &rp)) {
+		printf("getaddrinfo error\n");
+		return -1;
+	}
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+		return -1;
+
+	if (opts.mode != MODE_CRR) {
+		if (opts.proto == PROTO_QUIC) {
+			c.sockfd = quic_connect(rp);
+			ret = c.sockfd < 0 ? -1 : 0;
+		} else {
+			ret = tcp_connect(rp, &c);
+		}
+		if (ret)
+			goto out;
+	}
+#if GNUTLS_VERSION_NUMBER >= 0x030703
+	if (c.session)
+		printf("kTLS: %s\n", gnutls_transport_is_ktls_enabled(c.session) ==
+				     GNUTLS_KTLS_DUPLEX ? "on" : "off");
+#endif
+
+	for (i = 0; i < opts.warmup + opts.count; i++) {
+		if (i == opts.warmup)
+			begin = get_now_ns();
+		start = get_now_ns();
+		if (opts.proto == PROTO_QUIC)
+			ret = quic_request(rp, c.sockfd, i);
+		else
+			ret = tcp_request(rp, &c);
+		if (ret)
+			goto out;
+		now = get_now_ns();
+		if (i >= opts.warmup)
+			hist_record(h, now - start);
+	}
+	print_result(h, get_now_ns() - begin);
+out:
+	if (c.sockfd >= 0) {
+		if (opts.proto == PROTO_QUIC)
+			close(c.sockfd);
+		else
+			conn_close(&c);
+	}
+	free(h);
+	return ret;
+}
+
+/* Replies to each request, i.e. req_len bytes or data up to a stream FIN, with resp_len
+ * bytes on the same stream, and with a FIN if the request had one.
+ */
+static void *quic_server_worker(void *arg)
+{
+	int sockfd = (int)(intptr_t)arg, ret;
+	uint32_t got = 0, flags;
+	int64_t sid;
+	char *buf;
+
+	buf = malloc(MAX_MSG_LEN);
+	if (!buf || quic_server_handshake(sockfd, opts.pkey, opts.cert, ALPN))
+		goto out;
+
+	while (1) {
+		flags = 0;
+		ret = quic_recvmsg(sockfd, buf, MAX_MSG_LEN, &sid, &flags);
+		if (ret == -1)
+			break; /* Closed by the client. */
+		got += ret;
+		if (got < opts.req_len && !(flags & MSG_QUIC_STREAM_FIN))
+			continue;
+		got = 0;
+		ret = quic_sendmsg(sockfd, resp_msg, opts.resp_len, sid,
+				   flags & MSG_QUIC_STREAM_FIN);
+		if (ret == -1)
+			break;
+	}
+out:
+	free(buf);
+	close(sockfd);
+	return NULL;
+}
+
+static void *tcp_server_worker(void *arg)
+{
+	struct conn c = { .sockfd = (int)(intptr_t)arg };
+	char *buf;
+
+	buf = malloc(MAX_MSG_LEN);
+	if (!buf || (opts.proto == PROTO_TLS && tls_start(&c, 1)))
+		goto out;
+
+	while (conn_recv(&c, buf, opts.req_len) == 1)
+		if (conn_send(&c, resp_msg, opts.resp_len))
+			break;
+out:
+	free(buf);
+	conn_close(&c);
+	return NULL;
+}
+
+static int do_server(void)
+{
+	struct sockaddr_storage ra = {};
+	int sockfd, listenfd, one = 1;
+	struct addrinfo *rp;
+	socklen_t addrlen;
+	pthread_t thread;
+
+	if (getaddrinfo(opts.addr, opts.port, NULL, &rp)) {
+		printf("getaddrinfo error\n");
+		return -1;
+	}
+
+	if (opts.proto == PROTO_QUIC) {
+		listenfd = socket(rp->ai_family, SOCK_DGRAM, IPPROTO_QUIC);
+	} else {
+		listenfd = socket(rp->ai_family, SOCK_STREAM, IPPROTO_TCP);
+		if (listenfd >= 0)
+			setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	}
+	if (listenfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	if (bind(listenfd, rp->ai_addr, rp->ai_addrlen)) {
+		printf("socket bind failed\n");
+		return -1;
+	}
+	if (opts.proto == PROTO_QUIC &&
+	    setsockopt(listenfd, SOL_QUIC, QUIC_SOCKOPT_ALPN, ALPN, strlen(ALPN))) {
+		printf("socket setsockopt alpn failed\n");
+		return -1;
+	}
+	if (opts.proto == PROTO_QUIC && quic_set_cong(listenfd))
+		return -1;
+	if (listen(listenfd, 128)) {
+		printf("socket listen failed\n");
+		return -1;
+	}
+
+	while (1) {
+		addrlen = sizeof(ra);
+		sockfd = accept(listenfd, (struct sockaddr *)&ra, &addrlen);
+		if (sockfd < 0) {
+			printf("socket accept failed %d %d\n", errno, sockfd);
+			return -1;
+		}
+		if (opts.proto != PROTO_QUIC)
+			setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (pthread_create(&thread, NULL, opts.proto == PROTO_QUIC ? quic_server_worker :
+				   tcp_server_worker, (void *)(intptr_t)sockfd)) {
+			printf("pthread create failed\n");
+			return -1;
+		}
+		pthread_detach(thread);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	opts.count = 10000;
+	opts.warmup = 100;
+	opts.req_len = 64;
+	opts.resp_len = 64;
+	opts.addr = "::";
+	opts.port = "1234";
+
+	ret = parse_options(argc, argv, &opts);
+	if (ret) {
+		if (ret < 0)
+			printf("parse options error\n");
+		return -1;
+	}
+
+	quic_set_log_level(LOG_NOTICE);
+
+	if (opts.proto == PROTO_TLS) {
+		if (gnutls_certificate_allocate_credentials(&tls_cred))
+			return -1;
+		if (opts.is_serv && gnutls_certificate_set_x509_key_file(tls_cred, opts.cert,
+									 opts.pkey,
+									 GNUTLS_X509_FMT_PEM))
+			return -1;
+	}
+
+	if (!opts.is_serv)
+		return do_client();
+
+	return do_server();
+}
@@ -26,13 +26,24 @@ cleanup()
 	ip -6 addr del ::2/128 dev lo > /dev/null 2>&1
 	ip addr del 127.0.0.2/8 dev lo > /dev/null 2>&1
 	tc qdisc del dev lo root netem loss 30% > /dev/null 2>&1
+	tc qdisc del dev lo root netem delay 20ms limit 100000 > /dev/null 2>&1
 	pkill func_test > /dev/null 2>&1
 	pkill perf_test > /dev/null 2>&1
+	pkill bench_test > /dev/null 2>&1
+	pkill rr_test > /dev/null 2>&1
+	pkill handshake_test > /dev/null 2>&1
+	pkill qlog_conv > /dev/null 2>&1
+	ip netns del quic_bench > /dev/null 2>&1
+	ip netns del quic_regress > /dev/null 2>&1
 	pkill alpn_test > /dev/null 2>&1
 	pkill ticket_test > /dev/null 2>&1
+	pkill connid_test > /dev/null 2>&1
 	pkill sample_test > /dev/null 2>&1
 	pkill http3_test > /dev/null 2>&1
+	pkill uring_test > /dev/null 2>&1
 	rmmod quic_sample_test > /dev/null 2>&1
+	rmmod quic_microbench_test > /dev/null 2>&1
+	rmmod quic_diag > /dev/null 2>&1
 	rmmod quic > /dev/null 2>&1
 	exit $exit_code
 }
@@ -113,10 +124,251 @@ perf_tests()
 	daemon_run ./perf_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem
 	./perf_test --addr ::1 || return 1
 	daemon_stop "perf_test"
+
+	# Compare the ACK FRAMES count against the default delayed-ACK run above.
+	print_start "Performance Tests (IPv4, ACK every 2 packets)"
+	daemon_run ./perf_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem \
+				  --ack_threshold 2
+	./perf_test --addr 127.0.0.1 --ack_threshold 2 || return 1
+	daemon_stop "perf_test"
+
+	print_start "Performance Tests (IPv4, ACK Frequency)"
+	daemon_run ./perf_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem \
+				  --min_ack_delay 1000
+	./perf_test --addr 127.0.0.1 --min_ack_delay 1000 || return 1
+	daemon_stop "perf_test"
+
+	print_start "Performance Tests (IPv4, 4 Weighted Streams)"
+	daemon_run ./perf_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem
+	./perf_test --addr 127.0.0.1 --streams 4 || return 1
+	daemon_stop "perf_test"
+
+	print_start "Performance Tests (IPv4, Ping-Pong Latency)"
+	daemon_run ./perf_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem \
+				  --pingpong 1
+	./perf_test --addr 127.0.0.1 --msg_len 64 --pingpong 10000 || return 1
+	daemon_stop "perf_test"
+}
+
+# Runs a bench_test client against a server, optionally in a netns, and appends the JSON
+# results of both sides, tagged with the test name, to $bench_results.
+bench_run()
+{
+	local name=$1 netns=$2 addr=$3
+
+	shift 3
+	print_start "Benchmark Tests ($name)"
+	$netns ./bench_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem \
+		--addr $addr $@ > bench_server.log 2>&1 &
+	sleep 2
+	if ! ./bench_test --addr $addr $@ > bench_client.log 2>&1; then
+		cat bench_client.log
+		return 1
+	fi
+	daemon_stop "bench_test"
+	cat bench_client.log bench_server.log | grep "^{" | \
+		sed "s/^{/{\"test\": \"$name\", /" | tee -a $bench_results
+	rm -f bench_client.log bench_server.log
+}
+
+bench_tests()
+{
+	local ret busy_poll
+
+	bench_results=${BENCH_RESULTS:-bench_results.json}
+
+	bench_run "loopback, 1x1x1" "" 127.0.0.1 -T 1 -C 1 -n 1 -w 1 -d 5 || return 1
+	bench_run "loopback, 4x4x4" "" 127.0.0.1 -T 4 -C 4 -n 4 -w 1 -d 5 || return 1
+	bench_run "loopback, 4x4x4, 1k msgs" "" 127.0.0.1 -T 4 -C 4 -n 4 -m 1024 -w 1 -d 5 || \
+		return 1
+
+	ip netns add quic_bench || return 1
+	ip link add quic_bench0 type veth peer name quic_bench1 netns quic_bench
+	ip addr add 192.0.2.1/24 dev quic_bench0
+	ip link set quic_bench0 up
+	ip -n quic_bench addr add 192.0.2.2/24 dev quic_bench1
+	ip -n quic_bench link set quic_bench1 up
+	ip -n quic_bench link set lo up
+
+	# Busy polling needs a NAPI context to poll, which loopback does not have, so compare
+	# the ping-pong latency with and without it over the veth pair, where GRO gives both
+	# devices one, before netem adds its delay.
+	ethtool -K quic_bench0 gro on > /dev/null 2>&1
+	ip netns exec quic_bench ethtool -K quic_bench1 gro on > /dev/null 2>&1
+	for busy_poll in 0 50; do
+		print_start "Performance Tests (veth, Ping-Pong Latency, Busy Poll ${busy_poll}us)"
+		ip netns exec quic_bench ./perf_test -l --pkey ./keys/server-key.pem \
+			--cert ./keys/server-cert.pem --pingpong 1 --busy_poll $busy_poll \
+			> /dev/null 2>&1 &
+		sleep 2
+		./perf_test --addr 192.0.2.2 --msg_len 64 --pingpong 10000 \
+			--busy_poll $busy_poll || return 1
+		daemon_stop "perf_test"
+	done
+
+	if modprobe -q sch_netem; then
+		tc qdisc add dev quic_bench0 root netem delay 5ms limit 100000
+		tc -n quic_bench qdisc add dev quic_bench1 root netem delay 5ms limit 100000
+	fi
+	bench_run "veth, 10ms RTT, 4x4x4" "ip netns exec quic_bench" 192.0.2.2 \
+		-T 4 -C 4 -n 4 -w 2 -d 5
+	ret=$?
+	ip netns del quic_bench
+	return $ret
+}
+
+# Loads quic_microbench_test.ko, which runs the microbenchmarks under KUnit, and compares
+# the ns/op of each with microbench_baseline.txt.  A result more than MICROBENCH_TOLERANCE
+# percent (10 by default) above its baseline fails, and so do a missing result and a
+# benchmark with no baseline or "-" in it.  With MICROBENCH_RECORD=1 the results replace
+# the baseline instead.  It is not in the default TESTS; run it with "./runtest.sh
+# microbench" on the reference machine.
+microbench_tests()
+{
+	local baseline=../modules/net/quic/microbench_baseline.txt ret=0
+	local tolerance=${MICROBENCH_TOLERANCE:-10} lines name value base
+
+	print_start "Microbenchmark Tests (quic_microbench_test.ko)"
+	lines=$(dmesg | wc -l)
+	if [ -f ../modules/net/quic/quic_microbench_test.ko ]; then
+		insmod ../modules/net/quic/quic_microbench_test.ko || return 1
+	else
+		modprobe quic_microbench_test || return 1
+	fi
+	rmmod quic_microbench_test
+	dmesg | tail -n +$((lines + 1)) | grep -o 'quic_bench: .* ops/s' > microbench_results.txt
+	cat microbench_results.txt
+	if [ ! -s microbench_results.txt ]; then
+		echo "FAIL: no results from quic_microbench_test"
+		return 1
+	fi
+
+	if [ "$MICROBENCH_RECORD" = "1" ]; then
+		{ grep '^#' $baseline; cat microbench_results.txt; } > microbench_baseline.tmp
+		mv microbench_baseline.tmp $baseline
+		rm -f microbench_results.txt
+		echo "Recorded the results in $baseline"
+		return 0
+	fi
+
+	for name in $(awk '$1 == "quic_bench:" { print $2 }' $baseline microbench_results.txt | \
+		      sort -u); do
+		value=$(awk -v n=$name '$2 == n { print $3 }' microbench_results.txt)
+		base=$(awk -v n=$name '$2 == n { print $3 }' $baseline)
+		if [ "$value" = "" ]; then
+			echo "FAIL: $name: no result"
+			ret=1
+		elif [ "$base" = "" -o "$base" = "-" ]; then
+			echo "FAIL: $name: no baseline, record one with MICROBENCH_RECORD=1"
+			ret=1
+		elif awk -v v=$value -v b=$base -v t=$tolerance \
+				'BEGIN { exit !(v > b * (1 + t / 100)) }'; then
+			echo "REGRESSION: $name $value ns/op, baseline $base ns/op"
+			ret=1
+		fi
+	done
+	rm -f microbench_results.txt
+	return $ret
+}
+
+rr_run()
+{
+	local proto=$1 mode=$2
+
+	shift 2
+	print_start "Request/Response Tests ($proto, $mode $*)"
+	daemon_run ./rr_test -l --proto $proto --pkey ./keys/server-key.pem \
+		--cert ./keys/server-cert.pem "$@"
+	./rr_test --addr 127.0.0.1 --proto $proto --mode $mode "$@" || return 1
+	daemon_stop "rr_test"
+}
+
+rr_tests()
+{
+	rr_run quic rr || return 1
+	rr_run quic srr || return 1
+	rr_run quic crr --count 1000 --warmup 10 || return 1
+	rr_run quic rr --req_len 1024 --resp_len 16384 || return 1
+
+	# Baselines on the same host: TCP, and TLS 1.3 over TCP (kTLS when GnuTLS enables it).
+	rr_run tcp rr || return 1
+	rr_run tcp crr --count 1000 --warmup 10 || return 1
+	rr_run tls rr || return 1
+	rr_run tls crr --count 1000 --warmup 10 || return 1
+}
+
+handshake_tests()
+{
+	local trace
+
+	# Break the server setup time down by the quic tracepoints when tracefs has them.
+	[ -d /sys/kernel/tracing/events/quic ] && trace="--trace"
+
+	print_start "Handshake Tests (16 threads, 2000 connections)"
+	daemon_run ./handshake_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem \
+				       --threads 16
+	./handshake_test --addr 127.0.0.1 --threads 16 --conns 2000 $trace || return 1
+	daemon_stop "handshake_test"
+
+	print_start "Handshake Tests (64 threads, 4000 connections held open)"
+	daemon_run ./handshake_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem \
+				       --threads 64
+	./handshake_test --addr 127.0.0.1 --threads 64 --conns 4000 --hold $trace || return 1
+	daemon_stop "handshake_test"
+}
+
+diag_tests()
+{
+	if [ -f ../modules/net/quic/quic_diag.ko ]; then
+		[ -d /sys/module/quic_diag ] || insmod ../modules/net/quic/quic_diag.ko || return 1
+	else
+		modprobe -q quic_diag || return 0
+	fi
+
+	print_start "Socket Diag Tests (listing a transfer in progress)"
+	daemon_run ./perf_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem
+	daemon_run ./perf_test --addr 127.0.0.1
+	./diag_test --listening --sport 1234 || return 1
+	./diag_test --info --dport 1234 || return 1
+	./diag_test --info --saddr 127.0.0.1 --sport 1234 || return 1
+	./diag_test --count --all || return 1
+	daemon_stop "perf_test"
+}
+
+# Records the quic events of a func_test run from tracefs, and checks the qlog names of the
+# stream states that func_test always goes through.  "size_known" is left out, as it needs a
+# FIN to arrive out of order, which loopback does not guarantee.
+qlog_tests()
+{
+	local side state
+
+	[ -d /sys/kernel/tracing/events/quic ] ||
+		[ -d /sys/kernel/debug/tracing/events/quic ] || return 0
+
+	print_start "Qlog Tests (stream states of a func_test run)"
+	daemon_run ./qlog_conv --live --output qlog_trace.qlog
+	daemon_run ./func_test server 0.0.0.0 1234 ./keys/server-key.pem ./keys/server-cert.pem
+	./func_test client 127.0.0.1 1234 || return 1
+	daemon_stop "func_test"
+	pkill -INT qlog_conv > /dev/null 2>&1
+	sleep 3
+	for state in sending:send sending:data_sent sending:data_received sending:reset_sent \
+		     sending:reset_received receiving:receive receiving:data_received \
+		     receiving:data_read receiving:reset_received; do
+		side=${state%%:*}
+		state=${state#*:}
+		if ! grep -q "\"stream_side\": \"$side\", \"new\": \"$state\"" qlog_trace.qlog; then
+			echo "FAIL: no $side stream state $state in qlog_trace.qlog"
+			return 1
+		fi
+	done
+	rm -f qlog_trace.qlog
 }
 
 netem_tests()
 {
+	local rate ret
+
 	modprobe -q sch_netem || return 0
 	tc qdisc add dev lo root netem loss 30%
 	print_start "Performance Tests (IPv4, 30% packet loss on both sides)"
@@ -129,6 +381,164 @@ netem_tests()
 	./perf_test --addr ::1 --tot_len 1048576 --msg_len 1024 || return 1
 	daemon_stop "perf_test"
 	tc qdisc del dev lo root netem loss 30%
+
+	# No window tuning on either side: the receive windows start from the default
+	# max_data and grow with the read rate until the 40ms BDP is covered.  The default
+	# 1 MiB stream window alone caps a 40ms RTT at about 210 Mbits/Sec, so a rate well
+	# above it means the windows did grow.
+	tc qdisc add dev lo root netem delay 20ms limit 100000
+	print_start "Performance Tests (IPv4, 40ms RTT, receive window auto-tuning)"
+	daemon_run ./perf_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem
+	./perf_test --addr 127.0.0.1 --tot_len 268435456 > perf_client.log
+	ret=$?
+	cat perf_client.log
+	daemon_stop "perf_test"
+	tc qdisc del dev lo root netem delay 20ms limit 100000
+	[ $ret -eq 0 ] || return 1
+	rate=$(sed -n 's/^ALL RECVD: \([0-9.]*\) Mbits\/Sec$/\1/p' perf_client.log)
+	rm -f perf_client.log
+	if ! awk -v r="$rate" 'BEGIN { exit !(r != "" && r >= 300) }'; then
+		echo "FAIL: ${rate:-no} Mbits/Sec at 40ms RTT, the receive windows did not grow"
+		return 1
+	fi
+}
+
+# Checks one result of regress_tests against regress_baseline.txt and records it in
+# $regress_results in the same format.  A result that is lower (or, for latency, higher)
+# than the baseline by more than $regress_tolerance percent is a regression.  A result that
+# could not be parsed from the logs fails, and so does a result with no baseline, or with
+# "-" in it, unless the run only records the baseline.
+regress_check()
+{
+	local key=$1 metric=$2 value=$3 better=$4 base
+
+	if [ "$value" = "" ]; then
+		echo "FAIL: $key $metric: no result"
+		regress_failed=1
+		return 0
+	fi
+	echo "$key $metric $value" >> $regress_results
+	[ "$REGRESS_RECORD" = "1" ] && return 0
+	base=$(awk -v k=$key -v m=$metric '$1 == k && $2 == m { print $3 }' regress_baseline.txt)
+	if [ "$base" = "" -o "$base" = "-" ]; then
+		echo "FAIL: $key $metric: no baseline, record one with REGRESS_RECORD=1"
+		regress_failed=1
+		return 0
+	fi
+	if awk -v v=$value -v b=$base -v t=$regress_tolerance -v d=$better 'BEGIN {
+		exit !(d == "higher" ? v < b * (1 - t / 100) : v > b * (1 + t / 100)) }'; then
+		echo "REGRESSION: $key $metric $value, baseline $base"
+		regress_failed=1
+	fi
+}
+
+# Runs the bulk and request/response workloads of one case, with the servers in the
+# quic_regress netns and the clients in the current one.
+regress_run()
+{
+	local key=$1 addr=$2 cong=$3 count=$4 netns="ip netns exec quic_regress"
+
+	print_start "Regression Tests ($key)"
+	$netns ./bench_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem \
+		--addr $addr --cong $cong -T 1 -C 1 -n 4 -w 2 -d 5 > regress_server.log 2>&1 &
+	sleep 2
+	if ! ./bench_test --addr $addr --cong $cong -T 1 -C 1 -n 4 -w 2 -d 5 \
+			> regress_client.log 2>&1; then
+		cat regress_client.log
+		return 1
+	fi
+	daemon_stop "bench_test"
+	grep "^{" regress_server.log
+	regress_check $key bulk_gbps \
+		"$(sed -n 's/.*"gbps": \([0-9.]*\).*/\1/p' regress_server.log)" higher
+
+	$netns ./rr_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem \
+		--addr $addr --cong $cong > regress_server.log 2>&1 &
+	sleep 2
+	if ! ./rr_test --addr $addr --cong $cong --count $count --warmup 10 \
+			> regress_client.log 2>&1; then
+		cat regress_client.log
+		return 1
+	fi
+	daemon_stop "rr_test"
+	grep "^{" regress_client.log
+	regress_check $key rr_tps \
+		"$(sed -n 's/.*"tps": \([0-9.]*\).*/\1/p' regress_client.log)" higher
+	regress_check $key rr_p99_us \
+		"$(sed -n 's/.*"p99_us": \([0-9.]*\).*/\1/p' regress_client.log)" lower
+	rm -f regress_client.log regress_server.log
+}
+
+# The netem profiles of regress_tests, as "name|netem args|rr requests".  The netem args
+# apply to each direction, so the RTT is twice the delay.
+regress_profiles="
+	rtt1ms|delay 500us limit 100000|5000
+	rtt1ms_loss0.1|delay 500us loss 0.1% limit 100000|5000
+	rtt1ms_loss1|delay 500us loss 1% limit 100000|5000
+	rtt20ms|delay 10ms limit 100000|500
+	rtt20ms_loss0.1|delay 10ms loss 0.1% limit 100000|500
+	rtt20ms_loss1|delay 10ms loss 1% limit 100000|500
+	rtt100ms|delay 50ms limit 100000|100
+	rtt100ms_loss0.1|delay 50ms loss 0.1% limit 100000|100
+	rtt100ms_loss1|delay 50ms loss 1% limit 100000|100
+	rtt20ms_reorder|delay 10ms reorder 25% 50% limit 100000|500
+	rtt20ms_100mbit|delay 10ms rate 100mbit limit 1000|500
+"
+
+# Bulk throughput and request/response latency over a veth pair between two netns, for
+# each netem profile, address family and congestion control, compared with the results
+# in regress_baseline.txt.  It takes about half an hour, so it is not in the default
+# TESTS; run it with "./runtest.sh regress" on an otherwise idle machine.  Set
+# REGRESS_TOLERANCE (in percent, 15 by default) to widen or narrow the allowed change.
+# The results go to $REGRESS_RESULTS (regress_results.txt by default), in the format of
+# regress_baseline.txt.  With REGRESS_RECORD=1 on the reference machine, nothing is
+# compared, and the results replace the lines below the header of regress_baseline.txt.
+regress_tests()
+{
+	local profile name args count family addr cong ret=0
+
+	modprobe -q sch_netem || return 0
+	regress_results=${REGRESS_RESULTS:-regress_results.txt}
+	regress_tolerance=${REGRESS_TOLERANCE:-15}
+	regress_failed=0
+	rm -f $regress_results
+
+	ip netns add quic_regress || return 1
+	ip link add quic_regress0 type veth peer name quic_regress1 netns quic_regress
+	ip addr add 198.51.100.1/24 dev quic_regress0
+	ip -6 addr add 2001:db8:1::1/64 dev quic_regress0 nodad
+	ip link set quic_regress0 up
+	ip -n quic_regress addr add 198.51.100.2/24 dev quic_regress1
+	ip -n quic_regress -6 addr add 2001:db8:1::2/64 dev quic_regress1 nodad
+	ip -n quic_regress link set quic_regress1 up
+	ip -n quic_regress link set lo up
+
+	for profile in $(echo "$regress_profiles" | tr -d '\t' | tr ' ' '+'); do
+		name=$(echo $profile | cut -d'|' -f1)
+		args=$(echo $profile | cut -d'|' -f2 | tr '+' ' ')
+		count=$(echo $profile | cut -d'|' -f3)
+		tc qdisc replace dev quic_regress0 root netem $args || ret=1
+		tc -n quic_regress qdisc replace dev quic_regress1 root netem $args || ret=1
+		[ $ret = 0 ] || break
+		for family in ipv4 ipv6; do
+			addr=198.51.100.2
+			[ $family = ipv6 ] && addr=2001:db8:1::2
+			for cong in reno cubic prague; do
+				regress_run $family-$cong-$name $addr $cong $count || ret=1
+				[ $ret = 0 ] || break 3
+			done
+		done
+	done
+
+	ip netns del quic_regress
+	[ $ret = 0 ] || return $ret
+	if [ "$REGRESS_RECORD" = "1" -a $regress_failed = 0 ]; then
+		{ grep '^#' regress_baseline.txt; cat $regress_results; } > regress_baseline.tmp
+		mv regress_baseline.tmp regress_baseline.txt
+		echo "Recorded the results in regress_baseline.txt"
+	fi
+	[ $regress_failed = 0 ] || echo "Regressions found, see $regress_results"
+	return $regress_failed
 }
 
 http3_tests() {
@@ -158,6 +568,24 @@ http3_tests() {
 	daemon_stop "http3_test"
 }
 
+uring_tests()
+{
+	[ -f /usr/local/include/liburing.h -o -f /usr/include/liburing.h ] || return 0
+	make uring_test > /dev/null || return 1
+
+	# Same 4096-byte messages and 1G total as uring_test: compare its Mbits/Sec with the
+	# ALL RECVD rate of perf_test, which does one blocking sendmsg() per message.
+	print_start "io_uring Tests (IPv4, perf_test Baseline)"
+	daemon_run ./perf_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem
+	./perf_test --addr 127.0.0.1 --msg_len 4096 || return 1
+	daemon_stop "perf_test"
+
+	print_start "io_uring Tests (IPv4, Batched Send and Multishot Recvmsg)"
+	daemon_run ./uring_test -l --pkey ./keys/server-key.pem --cert ./keys/server-cert.pem
+	./uring_test --addr 127.0.0.1 --depth 16 || return 1
+	daemon_stop "uring_test"
+}
+
 tlshd_tests()
 {
 	systemctl is-active --quiet tlshd || return 0
@@ -282,6 +710,14 @@ ticket_tests()
 	daemon_stop "ticket_test"
 }
 
+connid_tests()
+{
+	print_start "QUIC-LB and CPU-Affine Connection ID Tests"
+	daemon_run ./connid_test server 0.0.0.0 1234 ./keys/server-key.pem ./keys/server-cert.pem
+	./connid_test client 127.0.0.1 1234 || return 1
+	daemon_stop "connid_test"
+}
+
 sample_tests()
 {
 	print_start "Sample Tests"
@@ -291,7 +727,7 @@ sample_tests()
 
 }
 
-TESTS="func perf netem http3 tlshd alpn ticket sample"
+TESTS="func perf bench rr handshake diag qlog netem http3 uring tlshd alpn ticket connid sample"
 trap cleanup EXIT
 
 [ "$1" = "" ] || TESTS=$1
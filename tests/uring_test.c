@@ -0,0 +1,491 @@
+#include <stdio.h>
+#include <errno.h>
+#include <netdb.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <liburing.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <netinet/quic.h>
+#include <sys/syslog.h>
+
+#define SND_MSG_LEN	4096 * 16
+#define RCV_MSG_LEN	4096 * 16
+#define TOT_LEN		1 * 1024 * 1024 * 1024
+
+#define SECONDS		1000000
+#define MAX_DEPTH	256
+
+/* Provided buffers for multishot recvmsg: each one holds a struct io_uring_recvmsg_out, the
+ * QUIC_STREAM_INFO cmsg and the payload of one message.
+ */
+#define BUF_GROUP	1
+#define BUF_COUNT	64
+#define BUF_LEN		(RCV_MSG_LEN + 256)
+
+char snd_msg[SND_MSG_LEN];
+char rcv_msg[RCV_MSG_LEN];
+char alpn[] = "sample";
+
+struct options {
+	char *pkey;
+	char *cert;
+	char *addr;
+	char *port;
+	uint8_t is_serv;
+	uint32_t depth;
+	uint64_t tot_len;
+	uint64_t msg_len;
+};
+
+struct stats {
+	uint64_t bytes;
+	uint64_t syscalls;
+	uint64_t start;
+	struct rusage ru;
+};
+
+static struct option long_options[] = {
+	{"addr",	required_argument,	0,	'a'},
+	{"port",	required_argument,	0,	'p'},
+	{"pkey",	required_argument,	0,	'k'},
+	{"cert",	required_argument,	0,	'c'},
+	{"msg_len",	required_argument,	0,	'm'},
+	{"tot_len",	required_argument,	0,	't'},
+	{"depth",	required_argument,	0,	'd'},
+	{"listen",	no_argument,		0,	'l'},
+	{"help",	no_argument,		0,	'h'},
+	{0,		0,			0,	 0 }
+};
+
+static void print_usage(char *cmd)
+{
+	printf("%s:\n\n", cmd);
+	printf("    --listen/-l:            work as a server\n");
+	printf("    --addr/-a <a>:          server IP address\n");
+	printf("    --port/-p <p>:          server port\n");
+	printf("    --pkey/-k <k>:          private key file\n");
+	printf("    --cert/-c <c>:          certificate file\n");
+	printf("    --help/-h <h>:          show help\n");
+	printf("    --msg_len/-m <m>:       msg_len to send\n");
+	printf("    --tot_len/-t <t>:       tot_len to send\n");
+	printf("    --depth/-d <d>:         sends submitted per io_uring_enter()\n\n");
+}
+
+static int parse_options(int argc, char *argv[], struct options *opts)
+{
+	int c, option_index = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, "la:p:m:t:k:c:d:h", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'l':
+			opts->is_serv = 1;
+			break;
+		case 'a':
+			opts->addr = optarg;
+			break;
+		case 'p':
+			opts->port = optarg;
+			break;
+		case 'c':
+			opts->cert = optarg;
+			break;
+		case 'k':
+			opts->pkey = optarg;
+			break;
+		case 'm':
+			opts->msg_len = atoi(optarg);
+			if (!opts->msg_len || opts->msg_len > SND_MSG_LEN)
+				return -1;
+			break;
+		case 't':
+			opts->tot_len = atoll(optarg);
+			if (opts->tot_len > TOT_LEN)
+				return -1;
+			break;
+		case 'd':
+			opts->depth = atoi(optarg);
+			if (!opts->depth || opts->depth > MAX_DEPTH)
+				return -1;
+			break;
+		case 'h':
+			print_usage(argv[0]);
+			return 1;
+		default:
+			return -1;
+		}
+	}
+
+	if (opts->is_serv && (!opts->cert || !opts->pkey))
+		return -1;
+	return 0;
+}
+
+static uint64_t get_now_us(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+static uint64_t get_cpu_us(struct rusage *ru)
+{
+	return ru->ru_utime.tv_sec * 1000000ULL + ru->ru_utime.tv_usec +
+	       ru->ru_stime.tv_sec * 1000000ULL + ru->ru_stime.tv_usec;
+}
+
+static void stats_start(struct stats *st)
+{
+	memset(st, 0, sizeof(*st));
+	getrusage(RUSAGE_SELF, &st->ru);
+	st->start = get_now_us();
+}
+
+/* Syscalls are the io_uring_enter() calls made to submit and reap, plus the sendmsg() calls
+ * for the last message, and CPU is the user plus system time of this process.
+ */
+static void stats_print(struct stats *st, const char *mode)
+{
+	double mbytes = (double)st->bytes / (1024 * 1024);
+	uint64_t usecs = get_now_us() - st->start;
+	struct rusage ru;
+	uint64_t cpu;
+
+	getrusage(RUSAGE_SELF, &ru);
+	cpu = get_cpu_us(&ru) - get_cpu_us(&st->ru);
+	if (mbytes == 0)
+		mbytes = 1;
+	printf("%s: %" PRIu64 " bytes, %.1f Mbits/Sec, %" PRIu64 " syscalls, "
+	       "%.1f syscalls/MB, %.3f CPU Sec/GB\n", mode, st->bytes,
+	       (double)st->bytes * 8 / (usecs ? usecs : 1), st->syscalls,
+	       st->syscalls / mbytes, (double)cpu / SECONDS / (mbytes / 1024));
+}
+
+/* Receives until a stream FIN with one multishot recvmsg, which posts a CQE with the payload
+ * and its QUIC_STREAM_INFO cmsg in a provided buffer for each message.
+ */
+static int64_t recv_uring(int sockfd, struct stats *st)
+{
+	struct io_uring_buf_ring *br = NULL;
+	struct quic_stream_info *info;
+	struct io_uring_recvmsg_out *o;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int ret, armed = 0, fin = 0;
+	struct msghdr msg = {};
+	struct io_uring ring;
+	struct cmsghdr *cmsg;
+	unsigned int head, count, bid;
+	int64_t sid = -1;
+	char *bufs, *buf;
+
+	bufs = malloc(BUF_COUNT * BUF_LEN);
+	if (!bufs)
+		return -1;
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		printf("io_uring init failed %d\n", ret);
+		free(bufs);
+		return -1;
+	}
+	br = io_uring_setup_buf_ring(&ring, BUF_COUNT, BUF_GROUP, 0, &ret);
+	if (!br) {
+		printf("io_uring setup buf ring failed %d\n", ret);
+		sid = -1;
+		goto out;
+	}
+	for (bid = 0; bid < BUF_COUNT; bid++)
+		io_uring_buf_ring_add(br, bufs + bid * BUF_LEN, BUF_LEN, bid,
+				      io_uring_buf_ring_mask(BUF_COUNT), bid);
+	io_uring_buf_ring_advance(br, BUF_COUNT);
+
+	msg.msg_controllen = CMSG_SPACE(sizeof(struct quic_stream_info));
+	while (!fin) {
+		if (!armed) {
+			sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_recvmsg_multishot(sqe, sockfd, &msg, 0);
+			sqe->flags |= IOSQE_BUFFER_SELECT;
+			sqe->buf_group = BUF_GROUP;
+			armed = 1;
+		}
+		ret = io_uring_submit_and_wait(&ring, 1);
+		st->syscalls++;
+		if (ret < 0) {
+			printf("io_uring submit failed %d\n", ret);
+			sid = -1;
+			goto out;
+		}
+
+		count = 0;
+		io_uring_for_each_cqe(&ring, head, cqe) {
+			count++;
+			if (!(cqe->flags & IORING_CQE_F_MORE))
+				armed = 0; /* Re-arm, e.g. after -ENOBUFS. */
+			if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+				printf("recv error %d\n", cqe->res);
+				sid = -1;
+				goto out;
+			}
+			if (!(cqe->flags & IORING_CQE_F_BUFFER))
+				continue;
+
+			bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			buf = bufs + bid * BUF_LEN;
+			o = io_uring_recvmsg_validate(buf, cqe->res, &msg);
+			if (!o) {
+				printf("recv invalid buffer %d\n", cqe->res);
+				sid = -1;
+				goto out;
+			}
+			st->bytes += io_uring_recvmsg_payload_length(o, cqe->res, &msg);
+			for (cmsg = io_uring_recvmsg_cmsg_firsthdr(o, &msg); cmsg;
+			     cmsg = io_uring_recvmsg_cmsg_nexthdr(o, &msg, cmsg)) {
+				if (cmsg->cmsg_level != SOL_QUIC || cmsg->cmsg_type != QUIC_STREAM_INFO)
+					continue;
+				info = (struct quic_stream_info *)CMSG_DATA(cmsg);
+				sid = info->stream_id;
+				if (info->stream_flags & MSG_QUIC_STREAM_FIN)
+					fin = 1;
+			}
+			/* Give the buffer back for the next message. */
+			io_uring_buf_ring_add(br, buf, BUF_LEN, bid, io_uring_buf_ring_mask(BUF_COUNT), 0);
+			io_uring_buf_ring_advance(br, 1);
+		}
+		io_uring_cq_advance(&ring, count);
+	}
+out:
+	if (br)
+		io_uring_free_buf_ring(&ring, br, BUF_COUNT, BUF_GROUP);
+	io_uring_queue_exit(&ring); /* Also cancels the multishot recvmsg if still armed. */
+	free(bufs);
+	return sid;
+}
+
+static int do_server(struct options *opts)
+{
+	struct sockaddr_storage la = {}, ra = {};
+	int sockfd, listenfd, family;
+	uint32_t flags, addrlen;
+	struct addrinfo *rp;
+	struct stats st;
+	int64_t sid;
+
+	if (getaddrinfo(opts->addr, opts->port, NULL, &rp)) {
+		printf("getaddrinfo error\n");
+		return -1;
+	}
+	family = rp->ai_family;
+	memcpy(&la, rp->ai_addr, rp->ai_addrlen);
+
+	listenfd = socket(family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (listenfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	if (bind(listenfd, (struct sockaddr *)&la, rp->ai_addrlen)) {
+		printf("socket bind failed\n");
+		return -1;
+	}
+	if (setsockopt(listenfd, SOL_QUIC, QUIC_SOCKOPT_ALPN, alpn, strlen(alpn))) {
+		printf("socket setsockopt alpn failed\n");
+		return -1;
+	}
+	if (listen(listenfd, 1)) {
+		printf("socket listen failed\n");
+		return -1;
+	}
+
+	while (1) {
+		printf("Waiting for New Socket...\n");
+		addrlen = sizeof(ra);
+		sockfd = accept(listenfd, (struct sockaddr *)&ra, &addrlen);
+		if (sockfd < 0) {
+			printf("socket accept failed %d %d\n", errno, sockfd);
+			return -1;
+		}
+		if (quic_server_handshake(sockfd, opts->pkey, opts->cert, alpn))
+			return -1;
+		printf("HANDSHAKE DONE\n");
+
+		stats_start(&st);
+		sid = recv_uring(sockfd, &st);
+		if (sid < 0)
+			return -1;
+		stats_print(&st, "RECV DONE (io_uring multishot)");
+
+		strcpy(snd_msg, "recv done");
+		if (quic_sendmsg(sockfd, snd_msg, strlen(snd_msg), sid, MSG_QUIC_STREAM_FIN) == -1) {
+			printf("send %d\n", errno);
+			return -1;
+		}
+
+		flags = 0;
+		quic_recvmsg(sockfd, rcv_msg, sizeof(rcv_msg), &sid, &flags);
+		close(sockfd);
+		printf("CLOSE DONE\n");
+	}
+	return 0;
+}
+
+/* Sends all but the last message as batches of opts->depth linked IORING_OP_SENDs, one
+ * io_uring_enter() per batch.  The sends carry no cmsg and go to the stream opened by
+ * QUIC_SOCKOPT_STREAM_OPEN; the links keep their data in order on the stream.
+ */
+static int send_uring(int sockfd, struct options *opts, struct stats *st)
+{
+	struct io_uring_sqe *sqe = NULL;
+	struct io_uring_cqe *cqe;
+	struct io_uring ring;
+	uint64_t left;
+	uint32_t i, n;
+	int ret;
+
+	ret = io_uring_queue_init(opts->depth, &ring, 0);
+	if (ret) {
+		printf("io_uring init failed %d\n", ret);
+		return -1;
+	}
+
+	while (st->bytes + opts->msg_len < opts->tot_len) {
+		left = opts->tot_len - opts->msg_len - st->bytes;
+		for (n = 0; n < opts->depth && left; n++) {
+			sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_send(sqe, sockfd, snd_msg,
+					   left < opts->msg_len ? left : opts->msg_len, 0);
+			sqe->flags |= IOSQE_IO_LINK;
+			left -= left < opts->msg_len ? left : opts->msg_len;
+		}
+		sqe->flags &= ~IOSQE_IO_LINK; /* End of the chain. */
+
+		ret = io_uring_submit_and_wait(&ring, n);
+		st->syscalls++;
+		if (ret < 0) {
+			printf("io_uring submit failed %d\n", ret);
+			goto out;
+		}
+		for (i = 0; i < n; i++) {
+			ret = io_uring_wait_cqe(&ring, &cqe);
+			if (ret < 0) {
+				printf("io_uring wait failed %d\n", ret);
+				goto out;
+			}
+			ret = cqe->res;
+			io_uring_cqe_seen(&ring, cqe);
+			if (ret == -ECANCELED) /* A previous send in the chain failed. */
+				continue;
+			if (ret < 0) {
+				printf("send error %d\n", ret);
+				goto out;
+			}
+			st->bytes += ret;
+		}
+	}
+	ret = 0;
+out:
+	io_uring_queue_exit(&ring);
+	return ret;
+}
+
+static int do_client(struct options *opts)
+{
+	struct quic_transport_param param = {};
+	struct quic_stream_info sinfo = {};
+	uint32_t flags = 0, optlen;
+	struct addrinfo *rp;
+	struct stats st;
+	int ret, sockfd;
+	int64_t sid = 0;
+
+	if (getaddrinfo(opts->addr, opts->port, NULL, &rp)) {
+		printf("getaddrinfo error\n");
+		return -1;
+	}
+
+	sockfd = socket(rp->ai_family, SOCK_DGRAM, IPPROTO_QUIC);
+	if (sockfd < 0) {
+		printf("socket create failed\n");
+		return -1;
+	}
+	param.max_idle_timeout = 120 * SECONDS;
+	if (setsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_TRANSPORT_PARAM, &param, sizeof(param))) {
+		printf("socket setsockopt transport param failed\n");
+		return -1;
+	}
+	if (connect(sockfd, rp->ai_addr, rp->ai_addrlen)) {
+		printf("socket connect failed\n");
+		return -1;
+	}
+
+	if (quic_client_handshake(sockfd, NULL, NULL, alpn))
+		return -1;
+
+	printf("HANDSHAKE DONE.\n");
+
+	optlen = sizeof(sinfo);
+	sinfo.stream_id = 0;
+	sinfo.stream_flags = 0;
+	if (getsockopt(sockfd, SOL_QUIC, QUIC_SOCKOPT_STREAM_OPEN, &sinfo, &optlen)) {
+		printf("socket getsockopt stream open failed\n");
+		return -1;
+	}
+
+	stats_start(&st);
+	ret = send_uring(sockfd, opts, &st);
+	if (ret)
+		return -1;
+	while (st.bytes < opts->tot_len) { /* The last message, with the stream FIN. */
+		ret = quic_sendmsg(sockfd, snd_msg, opts->tot_len - st.bytes, 0,
+				   MSG_QUIC_STREAM_FIN);
+		st.syscalls++;
+		if (ret == -1) {
+			printf("send %d %d\n", ret, errno);
+			return -1;
+		}
+		st.bytes += ret;
+	}
+
+	ret = quic_recvmsg(sockfd, rcv_msg, sizeof(rcv_msg), &sid, &flags);
+	if (ret == -1) {
+		printf("recv error %d %d\n", ret, errno);
+		return -1;
+	}
+	stats_print(&st, "SEND DONE (io_uring)");
+
+	close(sockfd);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct options opts = {};
+	int ret;
+
+	opts.msg_len = 4096;
+	opts.tot_len = TOT_LEN;
+	opts.depth = 16;
+	opts.addr = "::";
+	opts.port = "1234";
+
+	ret = parse_options(argc, argv, &opts);
+	if (ret) {
+		if (ret < 0)
+			printf("parse options error\n");
+		return -1;
+	}
+
+	quic_set_log_level(LOG_NOTICE);
+
+	if (!opts.is_serv)
+		return do_client(&opts);
+
+	return do_server(&opts);
+}